@@ -0,0 +1,99 @@
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <vector>
+
+#include "util/input_stream.h"
+#include "util/output_stream.h"
+
+using namespace xuanqiong::util;
+
+// copy everything queued in output into input, as a recv would
+static void transfer(OutputBuffer& output, InputBuffer& input) {
+    for (auto& iov : output.get_iovecs()) {
+        size_t done = 0;
+        while (done < iov.iov_len) {
+            auto [buf, cap] = input.get_buffer();
+            int n = std::min<size_t>(cap, iov.iov_len - done);
+            memcpy(buf, static_cast<uint8_t*>(iov.iov_base) + done, n);
+            input.recv_add(n);
+            done += n;
+        }
+    }
+    output.send_add(output.bytes());
+}
+
+static void BM_OutputBufferAppend(benchmark::State& state) {
+    std::vector<uint8_t> data(state.range(0), 'x');
+    OutputBuffer output;
+    for (auto _ : state) {
+        output.append(data.data(), data.size());
+        if (output.bytes() >= 1 << 20) {
+            output.send_add(output.bytes());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_OutputBufferAppend)->Arg(4)->Arg(64)->Arg(1024)->Arg(16 << 10);
+
+static void BM_OutputBufferGetIovecs(benchmark::State& state) {
+    std::vector<uint8_t> data(state.range(0), 'x');
+    OutputBuffer output;
+    output.append(data.data(), data.size());
+    for (auto _ : state) {
+        auto iovs = output.get_iovecs();
+        benchmark::DoNotOptimize(iovs.data());
+    }
+}
+BENCHMARK(BM_OutputBufferGetIovecs)->Arg(64)->Arg(64 << 10)->Arg(1 << 20);
+
+static void BM_InputBufferFetchUint32(benchmark::State& state) {
+    constexpr int kCount = 4096;
+    OutputBuffer output;
+    for (uint32_t i = 0; i < kCount; ++i) {
+        output.append(&i, sizeof(i));
+    }
+    std::vector<uint8_t> bytes;
+    for (auto& iov : output.get_iovecs()) {
+        auto base = static_cast<uint8_t*>(iov.iov_base);
+        bytes.insert(bytes.end(), base, base + iov.iov_len);
+    }
+    for (auto _ : state) {
+        state.PauseTiming();
+        InputBuffer input;
+        size_t off = 0;
+        while (off < bytes.size()) {
+            auto [buf, cap] = input.get_buffer();
+            int n = std::min<size_t>(cap, bytes.size() - off);
+            memcpy(buf, bytes.data() + off, n);
+            input.recv_add(n);
+            off += n;
+        }
+        state.ResumeTiming();
+        uint32_t value;
+        while (input.fetch_uint32(&value)) {
+            benchmark::DoNotOptimize(value);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kCount);
+}
+BENCHMARK(BM_InputBufferFetchUint32);
+
+static void BM_InputStreamNext(benchmark::State& state) {
+    std::vector<uint8_t> data(state.range(0), 'x');
+    OutputBuffer output;
+    InputBuffer input;
+    for (auto _ : state) {
+        output.append(data.data(), data.size());
+        transfer(output, input);
+        NetInputStream stream(&input);
+        const void* ptr;
+        int size;
+        while (stream.Next(&ptr, &size)) {
+            benchmark::DoNotOptimize(ptr);
+        }
+        // releases the consumed blocks
+        stream.BackUp(0);
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_InputStreamNext)->Arg(64)->Arg(4096)->Arg(64 << 10);
@@ -0,0 +1,86 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+#include "example/echo.pb.h"
+#include "example/echo_service.h"
+#include "server/rpc_server.h"
+#include "client/client_channel.h"
+#include "util/service.h"
+
+using namespace xuanqiong;
+
+constexpr static int kBasePort = 18880;
+
+// one loopback server per policy, kept for the lifetime of the process
+static int start_server(SchedPolicy policy) {
+    int port = kBasePort + static_cast<int>(policy);
+    RpcServerOptions options(port);
+    options.sched_policy = policy;
+    options.poll_timeout = 1000;
+    auto server = new RpcServer(options);
+    server->register_service("EchoService", new EchoServiceImpl);
+    std::thread([server]() { server->start(); }).detach();
+    return port;
+}
+
+static int server_port(SchedPolicy policy) {
+    static std::unordered_map<SchedPolicy, int> ports;
+    auto iter = ports.find(policy);
+    if (iter == ports.end()) {
+        iter = ports.emplace(policy, start_server(policy)).first;
+    }
+    return iter->second;
+}
+
+struct EchoCall {
+    EchoResponse response;
+    std::atomic<int>* done;
+    void finish() { done->fetch_add(1, std::memory_order_release); delete this; }
+};
+
+// one call at a time over a single connection, the server and the client
+// run the same policy
+static void BM_EchoRoundTrip(benchmark::State& state) {
+    auto policy = static_cast<SchedPolicy>(state.range(0));
+    std::string payload(state.range(1), 'x');
+
+    // client connections only support POLL_POLICY
+    auto scheduler = std::make_unique<Scheduler>(SchedulerOptions(1000, SchedPolicy::POLL_POLICY));
+    auto executor = scheduler->alloc_executor();
+    ClientOptions client_options;
+    client_options.ip = "127.0.0.1";
+    client_options.port = server_port(policy);
+    auto channel = std::make_unique<ClientChannel>(client_options, executor);
+    EchoService_Stub stub(channel.get());
+
+    std::atomic<int> done{0};
+    int sent = 0;
+    for (auto _ : state) {
+        auto request = new EchoRequest;
+        request->set_message(payload);
+        auto call = new EchoCall{EchoResponse(), &done};
+        stub.Echo(new RpcController, request, &call->response,
+                  google::protobuf::NewCallback(call, &EchoCall::finish));
+        ++sent;
+        while (done.load(std::memory_order_acquire) < sent) {
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * payload.size());
+    channel->close();
+    scheduler->stop();
+    // join the executor before the connection it polls goes away
+    scheduler.reset();
+}
+BENCHMARK(BM_EchoRoundTrip)
+    ->ArgNames({"policy", "payload"})
+    ->ArgsProduct({{static_cast<int>(SchedPolicy::POLL_POLICY),
+#ifdef __linux__
+                    static_cast<int>(SchedPolicy::URING_POLICY),
+#endif
+                   }, {16, 4096}})
+    ->UseRealTime();
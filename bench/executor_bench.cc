@@ -0,0 +1,68 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "scheduler/scheduler.h"
+#include "util/histogram.h"
+
+using namespace xuanqiong;
+
+// time from spawn() on the caller to the task running on the executor,
+// blocking at once or spinning before it blocks
+static void BM_SpawnToRun(benchmark::State& state) {
+    auto policy = static_cast<SchedPolicy>(state.range(0));
+    SchedulerOptions options(1000, policy);
+    options.spin_us = state.range(1);
+    Scheduler scheduler(options);
+    auto executor = scheduler.alloc_executor();
+    std::atomic<int64_t> ran_at{0};
+    int64_t total_ns = 0;
+    for (auto _ : state) {
+        ran_at.store(0, std::memory_order_relaxed);
+        int64_t start = util::now_ns();
+        executor->spawn([&ran_at]() {
+            ran_at.store(util::now_ns(), std::memory_order_release);
+        });
+        int64_t end;
+        while ((end = ran_at.load(std::memory_order_acquire)) == 0) {
+        }
+        total_ns += end - start;
+    }
+    state.counters["spawn_to_run_ns"] = benchmark::Counter(
+        static_cast<double>(total_ns), benchmark::Counter::kAvgIterations);
+    scheduler.stop();
+}
+BENCHMARK(BM_SpawnToRun)
+    ->ArgNames({"policy", "spin_us"})
+    ->ArgsProduct({{static_cast<int>(SchedPolicy::POLL_POLICY),
+#ifdef __linux__
+                    static_cast<int>(SchedPolicy::URING_POLICY),
+#endif
+                   }, {0, 50}})
+    ->UseRealTime();
+
+// spawns from the caller without waiting, the executor drains in batches
+static void BM_SpawnThroughput(benchmark::State& state) {
+    auto policy = static_cast<SchedPolicy>(state.range(0));
+    Scheduler scheduler(SchedulerOptions(1000, policy));
+    auto executor = scheduler.alloc_executor();
+    std::atomic<int64_t> done{0};
+    int64_t spawned = 0;
+    for (auto _ : state) {
+        executor->spawn([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+        ++spawned;
+    }
+    while (done.load(std::memory_order_relaxed) < spawned) {
+        std::this_thread::yield();
+    }
+    state.SetItemsProcessed(spawned);
+    scheduler.stop();
+}
+BENCHMARK(BM_SpawnThroughput)
+    ->ArgName("policy")
+    ->Arg(static_cast<int>(SchedPolicy::POLL_POLICY))
+#ifdef __linux__
+    ->Arg(static_cast<int>(SchedPolicy::URING_POLICY))
+#endif
+    ->UseRealTime();
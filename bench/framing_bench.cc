@@ -0,0 +1,72 @@
+#include <benchmark/benchmark.h>
+#include <cstring>
+
+#include "rpc/compress.h"
+#include "util/common.h"
+#include "util/input_stream.h"
+#include "util/output_stream.h"
+#include "proto/message.pb.h"
+
+using namespace xuanqiong;
+
+static proto::Header make_header(int64_t request_id) {
+    proto::Header header;
+    header.set_magic(MAGIC_NUM);
+    header.set_version(VERSION);
+    header.set_message_type(proto::MessageType::REQUEST);
+    header.set_request_id(request_id);
+    header.set_service_name("EchoService");
+    header.set_method_name("Echo");
+    return header;
+}
+
+// length-prefixed header, as written by ClientChannel::CallMethod
+static void encode(const proto::Header& header, util::OutputBuffer* output) {
+    util::NetOutputStream stream(output);
+    append_header(&stream, header);
+}
+
+static void BM_HeaderEncode(benchmark::State& state) {
+    util::OutputBuffer output;
+    int64_t request_id = 0;
+    for (auto _ : state) {
+        encode(make_header(request_id++), &output);
+        output.send_add(output.bytes());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HeaderEncode);
+
+static void BM_HeaderDecode(benchmark::State& state) {
+    util::OutputBuffer output;
+    encode(make_header(42), &output);
+    auto iovs = output.get_iovecs();
+    util::InputBuffer input;
+    for (auto _ : state) {
+        for (auto& iov : iovs) {
+            size_t off = 0;
+            while (off < iov.iov_len) {
+                auto [buf, cap] = input.get_buffer();
+                int n = std::min<size_t>(cap, iov.iov_len - off);
+                memcpy(buf, static_cast<uint8_t*>(iov.iov_base) + off, n);
+                input.recv_add(n);
+                off += n;
+            }
+        }
+        util::NetInputStream stream(&input);
+        uint32_t header_len;
+        stream.fetch_uint32(&header_len);
+        stream.push_limit(header_len);
+        proto::Header header;
+        if (!header.ParseFromZeroCopyStream(&stream)) {
+            state.SkipWithError("failed to parse header");
+            break;
+        }
+        stream.pop_limit();
+        // releases the consumed blocks
+        stream.BackUp(0);
+        benchmark::DoNotOptimize(header.request_id());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HeaderDecode);
@@ -0,0 +1,83 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "util/closure.h"
+#include "util/mpmc_queue.h"
+
+using namespace xuanqiong::util;
+
+static void BM_MPMCQueuePushPop(benchmark::State& state) {
+    MPMCQueue<int> queue;
+    int value = 0;
+    for (auto _ : state) {
+        queue.push(1);
+        queue.pop(value);
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MPMCQueuePushPop);
+
+// every thread pushes and then pops, so producers and consumers contend
+static void BM_MPMCQueueContended(benchmark::State& state) {
+    static MPMCQueue<int> queue;
+    int value = 0;
+    for (auto _ : state) {
+        queue.push(1);
+        while (!queue.pop(value)) {
+        }
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MPMCQueueContended)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_MPMCQueueClosure(benchmark::State& state) {
+    MPMCQueue<Closure> queue;
+    int counter = 0;
+    Closure task;
+    for (auto _ : state) {
+        queue.push([&counter]() { ++counter; });
+        queue.pop(task);
+        task();
+    }
+    benchmark::DoNotOptimize(counter);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MPMCQueueClosure);
+
+// range(0) producers and as many consumers move 1M items per iteration
+static void BM_MPMCQueueProducersConsumers(benchmark::State& state) {
+    constexpr int kItems = 1 << 20;
+    int threads = static_cast<int>(state.range(0));
+    int items_per_producer = kItems / threads;
+    for (auto _ : state) {
+        MPMCQueue<int> queue;
+        std::atomic<int> popped{0};
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads; ++i) {
+            workers.emplace_back([&]() {
+                for (int j = 0; j < items_per_producer; ++j) {
+                    queue.push(j);
+                }
+            });
+            workers.emplace_back([&]() {
+                int value;
+                while (popped.load(std::memory_order_relaxed) < items_per_producer * threads) {
+                    if (queue.pop(value)) {
+                        popped.fetch_add(1, std::memory_order_relaxed);
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * items_per_producer * threads);
+}
+BENCHMARK(BM_MPMCQueueProducersConsumers)->Arg(1)->Arg(4)->Arg(16)->UseRealTime();
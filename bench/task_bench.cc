@@ -0,0 +1,54 @@
+#include <benchmark/benchmark.h>
+#include <coroutine>
+#include <memory>
+
+#include "scheduler/task.h"
+
+using namespace xuanqiong;
+
+struct Park {
+    std::coroutine_handle<>* slot;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) noexcept { *slot = handle; }
+    void await_resume() const noexcept {}
+};
+
+// about the locals of a connection coroutine
+static Task connection_like(std::shared_ptr<int> state, std::coroutine_handle<>* slot) {
+    char scratch[512];
+    benchmark::DoNotOptimize(scratch);
+    co_await Park{slot};
+    benchmark::DoNotOptimize(*state);
+}
+
+// start a coroutine, suspend it and let it finish: one frame each
+static void BM_TaskLifecycle(benchmark::State& state) {
+    auto shared = std::make_shared<int>(0);
+    std::coroutine_handle<> handle;
+    for (auto _ : state) {
+        connection_like(shared, &handle);
+        Resumer::resume(handle);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TaskLifecycle);
+
+static Task nested(int depth, std::coroutine_handle<>* slot) {
+    if (depth == 0) {
+        co_await Park{slot};
+        co_return;
+    }
+    co_await nested(depth - 1, slot);
+}
+
+// a chain of awaiting coroutines unwinds by symmetric transfer
+static void BM_TaskAwaitChain(benchmark::State& state) {
+    std::coroutine_handle<> handle;
+    for (auto _ : state) {
+        auto task = nested(state.range(0), &handle);
+        Resumer::resume(handle);
+    }
+    state.SetItemsProcessed(state.iterations() * (state.range(0) + 1));
+}
+BENCHMARK(BM_TaskAwaitChain)->Arg(1)->Arg(16)->Arg(1024);
@@ -4,7 +4,10 @@
 #include <google/protobuf/io/coded_stream.h>
 
 #include "util/common.h"
+#include "util/service.h"
+#include "net/endpoint.h"
 #include "net/poll_connection.h"
+#include "net/shm_connection.h"
 #include "net/socket_utils.h"
 #include "client/client_channel.h"
 #include "proto/message.pb.h"
@@ -12,23 +15,37 @@
 namespace xuanqiong {
 
 ClientChannel::ClientChannel(const ClientOptions& options, Executor* executor)
-    : executor_(executor) {
-    int sockfd = net::SocketUtils::socket();
-
-    struct sockaddr_in addr;
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(options.port);
-
-    net::SocketUtils::inet_pton(AF_INET, options.ip.c_str(), &addr.sin_addr);
-    net::SocketUtils::connect(sockfd, (struct sockaddr*)&addr, sizeof(addr));
+    : executor_(executor), compress_(options.compress) {
+    net::Endpoint endpoint;
+    auto address = options.endpoint.empty()
+        ? std::format("{}:{}", options.ip, options.port) : options.endpoint;
+    if (!net::Endpoint::parse(address, &endpoint)) {
+        error("invalid endpoint: {}", address);
+        exit(EXIT_FAILURE);
+    }
+    int sockfd = net::SocketUtils::socket(endpoint.family());
+    net::SocketUtils::connect(sockfd, endpoint.addr(), endpoint.addr_len());
 
     fcntl(sockfd, F_SETFL, O_NONBLOCK | O_CLOEXEC);
 
+#ifdef __linux__
+    if (endpoint.is_shm()) {
+        auto conn = std::make_unique<net::ShmConnection>(sockfd, executor);
+        if (!conn->connect(options.shm_ring_size)) {
+            error("failed to set up shared memory with {}", endpoint.to_string());
+            exit(EXIT_FAILURE);
+        }
+        conn_ = std::move(conn);
+    } else
+#endif
     if (options.sched_policy == SchedPolicy::POLL_POLICY) {
         conn_ = std::make_unique<net::PollConnection>(sockfd, executor);
     } else {
         // conn_ = std::make_unique<net::Socket>(sockfd, executor);
+        error("client connections support the poll policy only");
+        exit(EXIT_FAILURE);
     }
+    conn_->socket()->set_endpoints(net::Endpoint(), endpoint);
 
     int sendbuf = 512 * 1024;
     net::SocketUtils::setsocketopt(sockfd, SOL_SOCKET, SO_SNDBUF, &sendbuf, sizeof(sendbuf));
@@ -36,15 +53,17 @@ ClientChannel::ClientChannel(const ClientOptions& options, Executor* executor)
     int recvbuf = 512 * 1024;
     net::SocketUtils::setsocketopt(sockfd, SOL_SOCKET, SO_RCVBUF, &recvbuf, sizeof(recvbuf));
 
-    // close nagle
-    int nodelay = 1;
-    net::SocketUtils::setsocketopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    if (!endpoint.is_unix()) {
+        // close nagle
+        int nodelay = 1;
+        net::SocketUtils::setsocketopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
 
-    // set close linger: default
-    struct linger linger;
-    linger.l_onoff = 0;
-    linger.l_linger = 0;
-    net::SocketUtils::setsocketopt(sockfd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        // set close linger: default
+        struct linger linger;
+        linger.l_onoff = 0;
+        linger.l_linger = 0;
+        net::SocketUtils::setsocketopt(sockfd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    }
 
     // start recv and send coroutine
     executor->spawn([this]() { send_fn(); });
@@ -54,7 +73,9 @@ ClientChannel::ClientChannel(const ClientOptions& options, Executor* executor)
 ClientChannel::~ClientChannel() = default;
 
 void ClientChannel::close() {
-    conn_->close();
+    // end both directions and let the executor see the hang-up: it closes
+    // conn_ and wakes recv_fn, which fails the calls and streams still open
+    ::shutdown(conn_->fd(), SHUT_RDWR);
 }
 
 Task ClientChannel::recv_fn() {
@@ -94,6 +115,7 @@ Task ClientChannel::recv_fn() {
             break;
         }
         input_stream.pop_limit();
+        learn_compress(conn_.get(), header);
         // info("header: {}", header.DebugString());
 
         // deserialize request
@@ -118,33 +140,114 @@ Task ClientChannel::recv_fn() {
         if (conn_->closed() && conn_->read_bytes() < response_len) {
             break;
         }
+        // the attachment after the body
+        size_t attachment_size = header.attachment_size();
+        while (conn_->read_bytes() < response_len + attachment_size && !conn_->closed()) {
+            co_await conn_->async_read();
+        }
+        if (conn_->closed() && conn_->read_bytes() < response_len + attachment_size) {
+            break;
+        }
+        auto message_type = header.message_type();
+        if (message_type == proto::MessageType::GOAWAY) {
+            info("server sent goaway");
+            goaway_.store(true, std::memory_order_release);
+            input_stream.Skip(response_len);
+            input_stream.cut(attachment_size, nullptr);
+            continue;
+        }
+        if (message_type == proto::MessageType::STREAM_DATA ||
+            message_type == proto::MessageType::STREAM_END ||
+            message_type == proto::MessageType::WINDOW_UPDATE) {
+            dispatch_stream_frame(streams_, header, &input_stream, response_len);
+            input_stream.cut(attachment_size, nullptr);
+            continue;
+        }
         auto request_id = header.request_id();
+        // the server refused to open a stream
+        if (auto stream = streams_.find(request_id); stream != streams_.end()) {
+            input_stream.Skip(response_len);
+            input_stream.cut(attachment_size, nullptr);
+            stream->second->on_end(header.status(), header.error_text());
+            continue;
+        }
         auto iter = id2session_.find(request_id);
         if (iter == id2session_.end()) {
             error("session not found: {}", request_id);
+            input_stream.Skip(response_len);
+            input_stream.cut(attachment_size, nullptr);
             continue;
         }
-        auto [response, done] = iter->second;
+        auto session = iter->second;
         id2session_.erase(iter);
+        auto controller = dynamic_cast<RpcController*>(session.controller);
+        auto attachment = controller ? &controller->response_attachment() : nullptr;
 
-        input_stream.push_limit(response_len);
-        if (!response->ParseFromZeroCopyStream(&input_stream)) {
+        // error responses are header-only
+        if (header.status() != proto::StatusCode::OK) {
+            debug("request {} failed: {}", request_id, header.error_text());
+            input_stream.Skip(response_len);
+            input_stream.cut(attachment_size, nullptr);
+            finish(session, header.status(), header.error_text());
+            continue;
+        }
+        bool ok;
+        auto compress = static_cast<CompressType>(header.compress());
+        if (compress == CompressType::NONE) {
+            auto start = input_stream.ByteCount();
+            input_stream.push_limit(response_len);
+            ok = session.response->ParseFromZeroCopyStream(&input_stream);
+            input_stream.pop_limit();
+            if (!ok) {
+                input_stream.Skip(response_len - (input_stream.ByteCount() - start));
+            }
+        } else {
+            ok = parse_compressed(session.response, &input_stream, response_len, compress);
+        }
+        input_stream.cut(attachment_size, ok ? attachment : nullptr);
+        if (!ok) {
             error("failed to parse response");
+            finish(session, proto::StatusCode::BAD_REQUEST, "failed to parse response");
             continue;
         }
-        input_stream.pop_limit();
 
         // handle response
-        if (done) {
-            done->Run();  // delete response in done
-        } else {
-            delete response;
-        }
+        finish(session, proto::StatusCode::OK, "");
     }
 
     if (!conn_->closed()) {
         conn_->close();
     }
+    // nothing more will arrive for the calls still waiting
+    auto sessions = std::move(id2session_);
+    id2session_.clear();
+    for (auto& [_, session] : sessions) {
+        finish(session, proto::StatusCode::UNAVAILABLE, "connection closed");
+    }
+    for (auto& [_, stream] : streams_) {
+        stream->reset(proto::StatusCode::UNAVAILABLE, "connection closed");
+    }
+    streams_.clear();
+}
+
+void ClientChannel::finish(const Session& session, int32_t status, const std::string& error_text) {
+    if (status != proto::StatusCode::OK && session.controller) {
+        if (auto controller = dynamic_cast<RpcController*>(session.controller)) {
+            controller->SetFailed(status, error_text);
+        } else {
+            session.controller->SetFailed(error_text);
+        }
+    }
+    if (session.done) {
+        session.done->Run();  // delete response in done
+    } else {
+        delete session.response;
+    }
+    delete session.controller;
+    if (session.group && --session.group->pending == 0) {
+        session.group->done->Run();
+        delete session.group;
+    }
 }
 
 Task ClientChannel::send_fn() {
@@ -152,7 +255,92 @@ Task ClientChannel::send_fn() {
         // wait data for write ready
         co_await WaitWriteAwaiter{conn_.get()};
         co_await conn_->async_write();
+        if (!streams_.empty() && conn_->write_bytes() < kStreamHighWater) {
+            for (auto& [_, stream] : streams_) {
+                stream->on_output_drained();
+            }
+        }
+    }
+}
+
+std::shared_ptr<Stream> ClientChannel::open_stream(const std::string& service_name,
+                                                   const std::string& method_name) {
+    auto id = request_id_++;
+    auto stream = std::make_shared<Stream>(conn_.get(), id);
+    stream->set_compress(compress_.for_method(service_name, method_name), compress_.min_bytes);
+    if (goaway_.load(std::memory_order_relaxed) || conn_->closed()) {
+        stream->reset(proto::StatusCode::UNAVAILABLE,
+                      conn_->closed() ? "connection closed" : "server is going away");
+        return stream;
     }
+    stream->on_done = [this](int64_t id) { streams_.erase(id); };
+    streams_[id] = stream;
+
+    util::NetOutputStream output_stream = conn_->get_output_stream();
+    proto::Header header;
+    header.set_magic(MAGIC_NUM);
+    header.set_version(VERSION);
+    header.set_message_type(proto::MessageType::REQUEST);
+    header.set_request_id(id);
+    header.set_service_name(service_name);
+    header.set_method_name(method_name);
+    header.set_stream(true);
+    advertise_compress(conn_.get(), &header);
+    append_header(&output_stream, header);
+    uint32_t body_len = 0;
+    output_stream.append(&body_len, sizeof(body_len));
+    conn_->resume_write();
+    return stream;
+}
+
+bool ClientChannel::append_request(const google::protobuf::MethodDescriptor* method,
+                                   google::protobuf::RpcController* controller,
+                                   const google::protobuf::Message* request,
+                                   google::protobuf::Message* response,
+                                   google::protobuf::Closure* done, BatchGroup* group) {
+    if (controller && controller->IsCanceled()) {
+        delete request;
+        finish({controller, response, done, group}, proto::StatusCode::CANCELED, "canceled");
+        return false;
+    }
+    if (goaway_.load(std::memory_order_relaxed) || conn_->closed()) {
+        delete request;
+        finish({controller, response, done, group}, proto::StatusCode::UNAVAILABLE,
+               conn_->closed() ? "connection closed" : "server is going away");
+        return false;
+    }
+    util::NetOutputStream output_stream = conn_->get_output_stream();
+
+    // serialize header
+    proto::Header header;
+    header.set_magic(MAGIC_NUM);
+    header.set_version(VERSION);
+    header.set_message_type(proto::MessageType::REQUEST);
+    header.set_request_id(request_id_++);
+    header.set_service_name(method->service()->full_name());
+    header.set_method_name(method->name());
+    size_t request_len = request->ByteSizeLong();
+    auto compress = negotiate(compress_.for_method(header.service_name(), header.method_name()),
+                              request_len, compress_.min_bytes, conn_->peer_compress());
+    header.set_compress(static_cast<proto::CompressType>(compress));
+    advertise_compress(conn_.get(), &header);
+    auto rpc_controller = dynamic_cast<RpcController*>(controller);
+    if (rpc_controller) {
+        header.set_attachment_size(rpc_controller->request_attachment().size());
+    }
+
+    append_header(&output_stream, header);
+
+    // serialize request
+    append_body(&output_stream, *request, request_len, compress);
+    if (rpc_controller) {
+        output_stream.append(std::move(rpc_controller->request_attachment()));
+    }
+
+    delete request;
+
+    id2session_[header.request_id()] = {controller, response, done, group};
+    return true;
 }
 
 void ClientChannel::CallMethod(
@@ -163,33 +351,34 @@ void ClientChannel::CallMethod(
     google::protobuf::Closure* done
 ) {
     auto send_request = [=, this] {
-        util::NetOutputStream output_stream = conn_->get_output_stream();
-
-        // serialize header
-        proto::Header header;
-        header.set_magic(MAGIC_NUM);
-        header.set_version(VERSION);
-        header.set_message_type(proto::MessageType::REQUEST);
-        header.set_request_id(request_id_++);
-        header.set_service_name(method->service()->full_name());
-        header.set_method_name(method->name());
-
-        uint32_t header_len = header.ByteSizeLong();
-        output_stream.append(&header_len, sizeof(header_len));
-        header.SerializeToZeroCopyStream(&output_stream);
-
-        // serialize request
-        uint32_t request_len = request->ByteSizeLong();
-        output_stream.append(&request_len, sizeof(request_len));
-        request->SerializeToZeroCopyStream(&output_stream);
-
-        delete controller;
-        delete request;
-
-        id2session_[header.request_id()] = {response, done};
-        conn_->resume_write();
+        if (append_request(method, controller, request, response, done, nullptr)) {
+            conn_->resume_write();
+        }
     };
     executor_->spawn(std::move(send_request));
 }
 
+void ClientChannel::call_batch(std::vector<BatchCall> calls, google::protobuf::Closure* all_done) {
+    BatchGroup* group = nullptr;
+    if (all_done) {
+        if (calls.empty()) {
+            all_done->Run();
+            return;
+        }
+        group = new BatchGroup{calls.size(), all_done};
+    }
+    auto send_requests = [this, calls = std::move(calls), group]() {
+        bool appended = false;
+        for (const auto& call : calls) {
+            appended |= append_request(call.method, call.controller, call.request,
+                                       call.response, call.done, group);
+        }
+        // one write for the whole batch
+        if (appended) {
+            conn_->resume_write();
+        }
+    };
+    executor_->spawn(std::move(send_requests));
+}
+
 } // namespace xuanqiong
@@ -1,12 +1,16 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <memory>
 #include <mutex>
+#include <vector>
 #include <google/protobuf/service.h>
 
 #include "scheduler/task.h"
 #include "scheduler/scheduler.h"
+#include "rpc/compress.h"
+#include "rpc/stream.h"
 #include "util/output_stream.h"
 
 namespace xuanqiong {
@@ -19,7 +23,25 @@ class Connection;
 struct ClientOptions {
     std::string ip;
     int port;
+    // "unix:/path" or "unix-abstract:name" to connect over a unix domain
+    // socket, "shm:/path" for shared memory, or "ip:port". used instead of
+    // ip and port when set
+    std::string endpoint;
+    // bytes of each of the two rings of a "shm:" endpoint, a power of two
+    size_t shm_ring_size = 1 << 20;
     SchedPolicy sched_policy = SchedPolicy::POLL_POLICY;
+    // request and stream compression, used once the server advertised the
+    // algorithm
+    CompressOptions compress;
+};
+
+// one call of ClientChannel::call_batch, owned as by CallMethod
+struct BatchCall {
+    const google::protobuf::MethodDescriptor* method;
+    google::protobuf::RpcController* controller;
+    const google::protobuf::Message* request;
+    google::protobuf::Message* response;
+    google::protobuf::Closure* done;
 };
 
 class ClientChannel : public google::protobuf::RpcChannel {
@@ -29,9 +51,22 @@ public:
 
     void close();
 
+    Executor* executor() const { return executor_; }
+
+    // open a streaming call to service_name.method_name. must run on
+    // executor(), from a task or coroutine spawned there
+    std::shared_ptr<Stream> open_stream(const std::string& service_name,
+                                        const std::string& method_name);
+
+    // server asked for new calls to go elsewhere, they now fail fast
+    bool goaway() const { return goaway_.load(std::memory_order_acquire); }
+
     Task recv_fn();
     Task send_fn();
 
+    // takes ownership of controller and request. done runs once the call
+    // finished or failed, the controller is deleted after it returns. a
+    // controller canceled before the request is written fails with CANCELED
     void CallMethod(
         const google::protobuf::MethodDescriptor* method,
         google::protobuf::RpcController* controller,
@@ -40,14 +75,43 @@ public:
         google::protobuf::Closure* done
     ) override;
 
+    // send calls from one task and write them at once. each call is owned
+    // and completed as by CallMethod, its done may be null. all_done, if
+    // any, runs once after every call finished or failed
+    void call_batch(std::vector<BatchCall> calls, google::protobuf::Closure* all_done = nullptr);
+
 private:
     std::unique_ptr<net::Connection> conn_;
-    using Session = std::pair<google::protobuf::Message*, google::protobuf::Closure*>;
+    // calls of a batch left to finish
+    struct BatchGroup {
+        size_t pending;
+        google::protobuf::Closure* done;
+    };
+    struct Session {
+        google::protobuf::RpcController* controller;
+        google::protobuf::Message* response;
+        google::protobuf::Closure* done;
+        BatchGroup* group = nullptr;
+    };
+
+    // serialize one request into the output buffer without writing it.
+    // false if it failed instead, its done already ran
+    bool append_request(const google::protobuf::MethodDescriptor* method,
+                        google::protobuf::RpcController* controller,
+                        const google::protobuf::Message* request,
+                        google::protobuf::Message* response,
+                        google::protobuf::Closure* done, BatchGroup* group);
+
+    // status is a proto::StatusCode, OK runs done as a success
+    static void finish(const Session& session, int32_t status, const std::string& error_text);
     std::unordered_map<int64_t, Session> id2session_;
+    StreamMap streams_;
 
     Executor* executor_;
+    CompressOptions compress_;
 
     int64_t request_id_ = 0;
+    std::atomic<bool> goaway_{false};
 
     DISALLOW_COPY_AND_ASSIGN(ClientChannel);
 };
@@ -0,0 +1,238 @@
+#include <algorithm>
+
+#include "client/hedging_channel.h"
+#include "client/client_channel.h"
+#include "proto/message.pb.h"
+#include "scheduler/timer.h"
+#include "util/service.h"
+
+namespace xuanqiong {
+
+// successful attempts observed before hedging on their latency quantile,
+// which is also refreshed this often
+constexpr static uint64_t kQuantileSamples = 128;
+
+struct HedgingChannel::Call {
+    const google::protobuf::MethodDescriptor* method;
+    google::protobuf::RpcController* controller;
+    const google::protobuf::Message* request;
+    google::protobuf::Message* response;
+    google::protobuf::Closure* done;
+
+    MethodState* state = nullptr;
+    int max_attempts = 1;
+    int sent = 0;
+    size_t first_channel = 0;
+    bool finished = false;
+    // attempts whose done has not run yet
+    std::vector<Attempt*> pending;
+    // of the last failed attempt
+    int32_t status = proto::StatusCode::UNAVAILABLE;
+    std::string error_text;
+
+    ~Call() { delete request; }
+};
+
+// one send of a call, the done of its ClientChannel call
+struct HedgingChannel::Attempt : google::protobuf::Closure {
+    HedgingChannel* channel;
+    std::shared_ptr<Call> call;
+    // owned by the ClientChannel, deleted once Run returns
+    RpcController* controller;
+    google::protobuf::Message* response;
+    int index;
+    int64_t start_ns;
+
+    void Run() override {
+        channel->on_attempt_done(this);
+        delete this;
+    }
+};
+
+HedgingChannel::HedgingChannel(std::vector<ClientChannel*> channels, const HedgingOptions& options)
+    : channels_(std::move(channels)), options_(options),
+      budget_(options.budget_ratio, options.budget_max) {
+    if (channels_.empty()) {
+        error("hedging channel without channels");
+        exit(EXIT_FAILURE);
+    }
+    executor_ = channels_[0]->executor();
+    for (auto channel : channels_) {
+        if (channel->executor() != executor_) {
+            error("channels of a hedging channel must share one executor");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+HedgingChannel::~HedgingChannel() = default;
+
+HedgingChannel::MethodState& HedgingChannel::method_state(const google::protobuf::MethodDescriptor* method) {
+    auto& state = methods_[method];
+    if (!state) {
+        state = std::make_unique<MethodState>();
+        state->policy = &options_.policy;
+        auto iter = options_.methods.find(method->service()->full_name() + "/" + method->name());
+        if (iter != options_.methods.end()) {
+            state->policy = &iter->second;
+        }
+    }
+    return *state;
+}
+
+void HedgingChannel::record_latency(MethodState& state, int64_t latency_ns) {
+    if (state.policy->hedge_quantile <= 0) {
+        return;
+    }
+    state.latency.record(latency_ns);
+    if (++state.samples % kQuantileSamples == 0) {
+        util::HistogramSnapshot snapshot;
+        snapshot.merge(state.latency);
+        state.quantile_ns = snapshot.percentile(state.policy->hedge_quantile);
+    }
+}
+
+void HedgingChannel::CallMethod(
+    const google::protobuf::MethodDescriptor* method,
+    google::protobuf::RpcController* controller,
+    const google::protobuf::Message* request,
+    google::protobuf::Message* response,
+    google::protobuf::Closure* done
+) {
+    auto call = std::make_shared<Call>();
+    call->method = method;
+    call->controller = controller;
+    call->request = request;
+    call->response = response;
+    call->done = done;
+    executor_->spawn([this, call = std::move(call)]() { start(call); });
+}
+
+void HedgingChannel::start(const std::shared_ptr<Call>& call) {
+    HedgingStats::add(stats_.calls);
+    budget_.deposit();
+    call->state = &method_state(call->method);
+    const auto& policy = *call->state->policy;
+    if (policy.idempotent) {
+        call->max_attempts = std::max(policy.max_attempts, 1);
+    }
+    // an attachment is moved into the first attempt, there is no second one
+    auto controller = dynamic_cast<RpcController*>(call->controller);
+    if (controller && !controller->request_attachment().empty()) {
+        call->max_attempts = 1;
+    }
+    call->first_channel = next_channel_++ % channels_.size();
+    send_attempt(call);
+    schedule_hedge(call);
+}
+
+void HedgingChannel::send_attempt(const std::shared_ptr<Call>& call) {
+    auto attempt = new Attempt;
+    attempt->channel = this;
+    attempt->call = call;
+    attempt->controller = new RpcController;
+    attempt->response = call->response->New();
+    attempt->index = call->sent++;
+    attempt->start_ns = util::now_ns();
+    if (auto controller = dynamic_cast<RpcController*>(call->controller)) {
+        attempt->controller->request_attachment() = std::move(controller->request_attachment());
+    }
+    // the channel takes the request, every attempt gets its own copy
+    auto request = call->request->New();
+    request->CopyFrom(*call->request);
+    call->pending.push_back(attempt);
+
+    auto channel = channels_[(call->first_channel + attempt->index) % channels_.size()];
+    channel->CallMethod(call->method, attempt->controller, request, attempt->response, attempt);
+}
+
+void HedgingChannel::schedule_hedge(const std::shared_ptr<Call>& call) {
+    if (call->sent >= call->max_attempts) {
+        return;
+    }
+    const auto& state = *call->state;
+    int64_t delay_ns = state.policy->hedge_delay_ms * 1000000;
+    if (state.policy->hedge_quantile > 0 && state.samples >= kQuantileSamples) {
+        delay_ns = state.quantile_ns;
+    }
+    if (delay_ns <= 0) {
+        return;
+    }
+    // a retry in the meantime sent an attempt of its own and scheduled anew
+    run_after(executor_, delay_ns, [this, call, sent = call->sent]() {
+        if (call->finished || call->sent != sent) {
+            return;
+        }
+        if (!budget_.withdraw()) {
+            HedgingStats::add(stats_.throttled);
+            return;
+        }
+        HedgingStats::add(stats_.hedges);
+        send_attempt(call);
+        schedule_hedge(call);
+    });
+}
+
+void HedgingChannel::on_attempt_done(Attempt* attempt) {
+    auto call = attempt->call;
+    std::erase(call->pending, attempt);
+    std::unique_ptr<google::protobuf::Message> response(attempt->response);
+    if (call->finished) {
+        return;
+    }
+    auto controller = attempt->controller;
+    if (!controller->Failed()) {
+        record_latency(*call->state, util::now_ns() - attempt->start_ns);
+        if (attempt->index > 0) {
+            HedgingStats::add(stats_.hedge_wins);
+        }
+        call->response->GetReflection()->Swap(call->response, response.get());
+        if (auto user_controller = dynamic_cast<RpcController*>(call->controller)) {
+            user_controller->response_attachment() = std::move(controller->response_attachment());
+        }
+        complete(call, proto::StatusCode::OK, "");
+        return;
+    }
+
+    call->status = controller->ErrorCode();
+    call->error_text = controller->ErrorText();
+    // neither status means the handler ran, anything else is final
+    bool retryable = call->status == proto::StatusCode::UNAVAILABLE ||
+                     call->status == proto::StatusCode::OVERLOADED;
+    if (retryable && call->sent < call->max_attempts) {
+        if (budget_.withdraw()) {
+            HedgingStats::add(stats_.retries);
+            send_attempt(call);
+            schedule_hedge(call);
+            return;
+        }
+        HedgingStats::add(stats_.throttled);
+    }
+    if (call->pending.empty()) {
+        complete(call, call->status, call->error_text);
+    }
+}
+
+void HedgingChannel::complete(const std::shared_ptr<Call>& call, int32_t status,
+                              const std::string& error_text) {
+    call->finished = true;
+    // those still queued are never written, the others answer in vain
+    for (auto attempt : call->pending) {
+        attempt->controller->StartCancel();
+    }
+    if (status != proto::StatusCode::OK && call->controller) {
+        if (auto controller = dynamic_cast<RpcController*>(call->controller)) {
+            controller->SetFailed(status, error_text);
+        } else {
+            call->controller->SetFailed(error_text);
+        }
+    }
+    if (call->done) {
+        call->done->Run();
+    } else {
+        delete call->response;
+    }
+    delete call->controller;
+}
+
+} // namespace xuanqiong
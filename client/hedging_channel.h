@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <google/protobuf/service.h>
+
+#include "util/common.h"
+#include "util/histogram.h"
+
+namespace xuanqiong {
+
+class ClientChannel;
+class Executor;
+
+// how one method is retried and hedged
+struct HedgingPolicy {
+    // the method may run more than once per call. nothing else is retried
+    // or hedged
+    bool idempotent = false;
+    // attempts per call, the first one included
+    int max_attempts = 2;
+    // send another attempt once the last one is this late, 0 for none
+    int64_t hedge_delay_ms = 0;
+    // hedge after this quantile of the observed latency instead, e.g. 0.95.
+    // hedge_delay_ms applies until enough calls were observed
+    double hedge_quantile = 0;
+};
+
+struct HedgingOptions {
+    // for every method not listed in methods
+    HedgingPolicy policy;
+    // "service/method" -> policy
+    std::unordered_map<std::string, HedgingPolicy> methods;
+    // every call earns this fraction of an extra attempt, every retry or
+    // hedge spends a whole one, so extra load stays near this ratio
+    double budget_ratio = 0.1;
+    // extra attempts saved up at most, and available from the start
+    int budget_max = 10;
+};
+
+// counters of a HedgingChannel, only its executor writes
+struct HedgingStats {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> retries{0};       // attempts after a failed one
+    std::atomic<uint64_t> hedges{0};        // attempts after a late one
+    std::atomic<uint64_t> hedge_wins{0};    // calls answered by a later attempt
+    std::atomic<uint64_t> throttled{0};     // extra attempts the budget denied
+
+    static void add(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+// extra attempts allowed by HedgingOptions::budget_ratio, executor only
+class RetryBudget {
+public:
+    RetryBudget(double ratio, int max)
+        : earn_(ratio * kScale), max_(int64_t(max) * kScale), balance_(max_) {}
+
+    // a call was made
+    void deposit() { balance_ = std::min(balance_ + earn_, max_); }
+    // false if no extra attempt is left
+    bool withdraw() {
+        if (balance_ < kScale) {
+            return false;
+        }
+        balance_ -= kScale;
+        return true;
+    }
+
+private:
+    constexpr static int64_t kScale = 1000;
+
+    int64_t earn_;
+    int64_t max_;
+    int64_t balance_;
+};
+
+// spreads the attempts of each call over channels, which must share one
+// executor: a failed attempt of an idempotent method is retried on the next
+// channel, and one that is late gets a hedge there. the first success
+// answers the call, attempts not written yet are canceled and answers of
+// the others are dropped. it and its channels must outlive its calls
+class HedgingChannel : public google::protobuf::RpcChannel {
+public:
+    HedgingChannel(std::vector<ClientChannel*> channels, const HedgingOptions& options);
+    ~HedgingChannel();
+
+    const HedgingStats& stats() const { return stats_; }
+
+    // same contract as ClientChannel::CallMethod. calls with a request
+    // attachment are sent once, the attachment moves to the only attempt
+    void CallMethod(
+        const google::protobuf::MethodDescriptor* method,
+        google::protobuf::RpcController* controller,
+        const google::protobuf::Message* request,
+        google::protobuf::Message* response,
+        google::protobuf::Closure* done
+    ) override;
+
+private:
+    struct Call;
+    struct Attempt;
+    // policy and latency of one method
+    struct MethodState {
+        const HedgingPolicy* policy;
+        // of successful attempts, kept if the policy hedges on a quantile
+        util::Histogram latency;
+        uint64_t samples = 0;
+        // hedge_quantile of latency, refreshed every few samples
+        int64_t quantile_ns = 0;
+    };
+
+    MethodState& method_state(const google::protobuf::MethodDescriptor* method);
+    void record_latency(MethodState& state, int64_t latency_ns);
+
+    void start(const std::shared_ptr<Call>& call);
+    void send_attempt(const std::shared_ptr<Call>& call);
+    void schedule_hedge(const std::shared_ptr<Call>& call);
+    void on_attempt_done(Attempt* attempt);
+    void complete(const std::shared_ptr<Call>& call, int32_t status, const std::string& error_text);
+
+    std::vector<ClientChannel*> channels_;
+    Executor* executor_;
+    HedgingOptions options_;
+    RetryBudget budget_;
+    size_t next_channel_ = 0;
+    std::unordered_map<const google::protobuf::MethodDescriptor*, std::unique_ptr<MethodState>> methods_;
+    HedgingStats stats_;
+
+    DISALLOW_COPY_AND_ASSIGN(HedgingChannel);
+};
+
+} // namespace xuanqiong
@@ -1,5 +1,6 @@
 #include <string_view>
 #include <thread>
+#include <vector>
 
 #include "example/echo.pb.h"
 #include "util/common.h"
@@ -11,11 +12,20 @@
 
 using namespace xuanqiong;
 
-void handle_response(EchoResponse* response) {
-    info("response: {}", response->DebugString());
+// the controller stays valid until this returns
+void handle_response(RpcController* controller, EchoResponse* response) {
+    if (controller->Failed()) {
+        warn("call failed, status {}: {}", controller->ErrorCode(), controller->ErrorText());
+    } else {
+        info("response: {}", response->DebugString());
+    }
     delete response;
 }
 
+void handle_batch() {
+    info("batch finished");
+}
+
 int main() {
     SchedulerOptions sched_options(1000, SchedPolicy::POLL_POLICY);
     Scheduler scheduler(sched_options);
@@ -25,17 +35,19 @@ int main() {
     client_options.port = 8888;
     ClientChannel channel(client_options, executor);
 
+    // all calls go out in one batch, a single write
+    auto method = EchoService::descriptor()->FindMethodByName("Echo1");
     std::string data("echo request");
+    std::vector<BatchCall> calls;
     for (int i = 0; i <= 1000; ++i) {
-        EchoService_Stub stub(&channel);
         auto request = new EchoRequest;
         request->set_message(data.data() + std::to_string(i));
         auto response = new EchoResponse;
         auto controller = new RpcController;
-        auto done = google::protobuf::NewCallback(handle_response, response);
-        stub.Echo1(controller, request, response, done);
-        // std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        auto done = google::protobuf::NewCallback(handle_response, controller, response);
+        calls.push_back({method, controller, request, response, done});
     }
+    channel.call_batch(std::move(calls), google::protobuf::NewCallback(handle_batch));
     std::this_thread::sleep_for(std::chrono::seconds(5));
     scheduler.stop();
 }
@@ -1,16 +1,56 @@
+#include <string>
+
+#include "example/echo.pb.h"
 #include "example/echo_service.h"
 #include "server/rpc_server.h"
 
 using namespace xuanqiong;
 
-int main() {
+// bidirectional stream: answers every message until the client finishes
+static Task chat(std::shared_ptr<Stream> stream) {
+    EchoRequest request;
+    EchoResponse response;
+    while (co_await stream->read(&request)) {
+        response.set_message("[Chat] " + request.message());
+        if (!co_await stream->write(response)) {
+            co_return;
+        }
+    }
+    stream->finish();
+}
+
+// server stream: one request holding a count, then that many 1KB pages
+static Task pages(std::shared_ptr<Stream> stream) {
+    EchoRequest request;
+    if (!co_await stream->read(&request)) {
+        co_return;
+    }
+    int count = std::atoi(request.message().c_str());
+    EchoResponse response;
+    for (int i = 0; i < count; ++i) {
+        response.set_message(std::string(1024, 'a' + i % 26));
+        if (!co_await stream->write(response)) {
+            co_return;
+        }
+    }
+    stream->finish();
+}
+
+// echo_server [endpoint...], e.g. "[::]:8888" shm:/tmp/echo.sock. tcp port
+// 8888 on every ipv4 interface by default
+int main(int argc, char** argv) {
     RpcServerOptions options(8888);
+    for (int i = 1; i < argc; ++i) {
+        options.endpoints.push_back(argv[i]);
+    }
     // options.sched_policy = SchedPolicy::POLL_POLICY;
     RpcServer rpc_server(options);
 
     // register service
     EchoServiceImpl echo_service;
     rpc_server.register_service("EchoService", &echo_service);
+    rpc_server.register_stream("EchoService", "Chat", chat);
+    rpc_server.register_stream("EchoService", "Pages", pages);
 
     rpc_server.start();
     return 0;
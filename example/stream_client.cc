@@ -0,0 +1,67 @@
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "example/echo.pb.h"
+#include "util/common.h"
+#include "util/histogram.h"
+#include "scheduler/scheduler.h"
+#include "client/client_channel.h"
+
+using namespace xuanqiong;
+
+// a short chat, then a paged download, over one connection
+static Task run(ClientChannel* channel, std::atomic<bool>* done) {
+    EchoRequest request;
+    EchoResponse response;
+
+    auto chat = channel->open_stream("EchoService", "Chat");
+    for (int i = 0; i < 3; ++i) {
+        request.set_message("hello " + std::to_string(i));
+        if (!co_await chat->write(request) || !co_await chat->read(&response)) {
+            break;
+        }
+        info("chat: {}", response.message());
+    }
+    chat->finish();
+    while (co_await chat->read(&response)) {}
+    if (chat->status() != 0) {
+        warn("chat failed, status {}: {}", chat->status(), chat->error_text());
+    }
+
+    auto pages = chat->status() == 0 ? channel->open_stream("EchoService", "Pages") : nullptr;
+    if (pages) {
+        request.set_message("100000");
+        co_await pages->write(request);
+        pages->finish();
+        size_t count = 0;
+        size_t bytes = 0;
+        auto start_ns = util::now_ns();
+        while (co_await pages->read(&response)) {
+            ++count;
+            bytes += response.message().size();
+        }
+        auto elapsed_us = (util::now_ns() - start_ns) / 1000;
+        info("pages: {} messages, {} bytes in {} us, status {}",
+             count, bytes, elapsed_us, pages->status());
+    }
+    done->store(true, std::memory_order_release);
+}
+
+int main() {
+    SchedulerOptions sched_options(1000, SchedPolicy::POLL_POLICY);
+    Scheduler scheduler(sched_options);
+    auto executor = scheduler.alloc_executor();
+    ClientOptions client_options;
+    client_options.ip = "127.0.0.1";
+    client_options.port = 8888;
+    ClientChannel channel(client_options, executor);
+
+    std::atomic<bool> done{false};
+    executor->spawn([&channel, &done]() { run(&channel, &done); });
+    while (!done.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    scheduler.stop();
+    scheduler.join();
+}
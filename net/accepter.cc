@@ -6,6 +6,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <cstring>
 
 #include "util/common.h"
@@ -14,25 +15,42 @@
 
 namespace xuanqiong::net {
 
-Accepter::Accepter(int port, int backlog, int nodelay)
-    : sockfd_(-1), port_(port), backlog_(backlog), nodelay_(nodelay) {
+Accepter::Accepter(const Endpoint& endpoint, int backlog, int nodelay, int busy_poll_us,
+                   bool ipv6_only)
+    : sockfd_(-1), endpoint_(endpoint), backlog_(backlog), nodelay_(nodelay), busy_poll_us_(busy_poll_us) {
 
     // create socket
-    sockfd_ = SocketUtils::socket();
-
-    int opt = 1;
-    SocketUtils::setsocketopt(sockfd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port_);
-    server_addr.sin_addr.s_addr = INADDR_ANY;
+    sockfd_ = SocketUtils::socket(endpoint_.family());
+
+    if (endpoint_.is_unix()) {
+        // a socket file left behind by an earlier run makes bind fail
+        struct stat st;
+        auto path = endpoint_.path();
+        if (!path.empty() && ::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            ::unlink(path.c_str());
+        }
+    } else {
+        int opt = 1;
+        SocketUtils::setsocketopt(sockfd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        if (endpoint_.family() == AF_INET6) {
+            // the system default varies, dual-stack unless asked otherwise
+            int v6only = ipv6_only;
+            SocketUtils::setsocketopt(sockfd_, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+        }
+#ifdef SO_BINDTODEVICE
+        // only take connections arriving on this interface
+        const auto& interface = endpoint_.interface();
+        if (!interface.empty()) {
+            SocketUtils::setsocketopt(sockfd_, SOL_SOCKET, SO_BINDTODEVICE,
+                                      interface.c_str(), interface.size());
+        }
+#endif
+    }
 
-    SocketUtils::bind(sockfd_, (struct sockaddr*)&server_addr, sizeof(server_addr));
+    SocketUtils::bind(sockfd_, endpoint_.addr(), endpoint_.addr_len());
 
     // start listen
-    info("Accepter start listen on port {}", port_);
+    info("Accepter start listen on {}", endpoint_.to_string());
     SocketUtils::listen(sockfd_, backlog_);
 }
 
@@ -40,6 +58,9 @@ Accepter::~Accepter() {
     if (sockfd_ != -1) {
         ::close(sockfd_);
     }
+    if (auto path = endpoint_.path(); !path.empty()) {
+        ::unlink(path.c_str());
+    }
 }
 
 void Accepter::set_fd_param(int client_fd) {
@@ -57,22 +78,43 @@ void Accepter::set_fd_param(int client_fd) {
     int recvbuf = 512 * 1024;
     SocketUtils::setsocketopt(client_fd, SOL_SOCKET, SO_RCVBUF, &recvbuf, sizeof(recvbuf));
 
+    // the rest is tcp only
+    if (endpoint_.is_unix()) {
+        return;
+    }
+
     // set keepalive
     int keepalive = 1;
     SocketUtils::setsocketopt(client_fd, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive));
 
     // set nodelay
     SocketUtils::setsocketopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay_, sizeof(nodelay_));
+
+#ifdef SO_BUSY_POLL
+    // busy poll the device queue on blocking reads and epoll_wait
+    if (busy_poll_us_ > 0) {
+        SocketUtils::setsocketopt(
+            client_fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us_, sizeof(busy_poll_us_));
+    }
+#endif
+}
+
+void Accepter::close() {
+    // shutdown instead of close, the fd may be in use by a blocked accept()
+    ::shutdown(sockfd_, SHUT_RDWR);
 }
 
-int Accepter::accept() {
-    struct sockaddr_in client_addr;
+int Accepter::accept(Endpoint* peer) {
+    struct sockaddr_storage client_addr;
     socklen_t client_len = sizeof(client_addr);
     int client_fd =
         SocketUtils::accept(sockfd_, (struct sockaddr*)&client_addr, &client_len);
 
     if (client_fd != -1) {
         set_fd_param(client_fd);
+        if (peer) {
+            *peer = Endpoint((struct sockaddr*)&client_addr, client_len);
+        }
     }
 
     return client_fd;
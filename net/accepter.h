@@ -2,23 +2,39 @@
 
 #include <string>
 
+#include "net/endpoint.h"
 #include "util/common.h"
 
 namespace xuanqiong::net {
 
 class Accepter {
 public:
-    Accepter(int port, int backlog, int nodelay);
+    // busy_poll_us: SO_BUSY_POLL of accepted sockets, 0 to leave it unset.
+    // nodelay and busy_poll_us only apply to tcp. an ipv6 endpoint also
+    // accepts ipv4 connections unless ipv6_only is set
+    Accepter(const Endpoint& endpoint, int backlog, int nodelay, int busy_poll_us = 0,
+             bool ipv6_only = false);
+    // every ipv4 interface
+    Accepter(int port, int backlog, int nodelay, int busy_poll_us = 0)
+        : Accepter(Endpoint::any(port), backlog, nodelay, busy_poll_us) {}
 
     ~Accepter();
 
-    int accept();
+    int fd() const { return sockfd_; }
+    const Endpoint& endpoint() const { return endpoint_; }
+
+    // peer, if given, is set to the address of the accepted connection
+    int accept(Endpoint* peer = nullptr);
+
+    // stop listening, a blocked accept() returns -1
+    void close();
 
 private:
     int sockfd_;
-    int port_;           // listen port
+    Endpoint endpoint_;  // listen address
     int backlog_;
     int nodelay_;
+    int busy_poll_us_;
 
     void set_fd_param(int client_fd);
 
@@ -0,0 +1,80 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/socket.h>
+#include <sys/uio.h>
+#else
+#include <sys/sendfile.h>
+#endif
+
+#include "net/connection.h"
+
+namespace xuanqiong::net {
+
+Connection::~Connection() {
+    for (auto& [_, region] : files_) {
+        ::close(region.fd);
+    }
+}
+
+void Connection::append_file(const util::FileRegion& region) {
+    if (region.len == 0) {
+        ::close(region.fd);
+        return;
+    }
+    files_.emplace_back(write_buf_.sent_bytes() + write_buf_.bytes(), region);
+    file_bytes_ += region.len;
+}
+
+void Connection::file_sent(size_t n) {
+    auto& region = files_.front().second;
+    region.offset += n;
+    region.len -= n;
+    file_bytes_ -= n;
+    ConnStats::add(stats_.bytes_out, n);
+    if (region.len == 0) {
+        ::close(region.fd);
+        files_.pop_front();
+    }
+}
+
+bool Connection::send_file() {
+    auto& region = files_.front().second;
+    while (true) {
+#ifdef __APPLE__
+        off_t n = region.len;
+        int ret = ::sendfile(region.fd, fd(), region.offset, &n, nullptr, 0);
+        // a partial send also fails with EAGAIN
+        if (ret == -1 && n == 0) {
+            n = -1;
+        }
+#else
+        off_t offset = region.offset;
+        ssize_t n = ::sendfile(fd(), region.fd, &offset, region.len);
+#endif
+        if (n > 0) {
+            bool done = static_cast<size_t>(n) == region.len;
+            file_sent(n);
+            // region is gone once done
+            if (done) {
+                return true;
+            }
+            continue;
+        }
+        if (n == 0) {
+            // the file is shorter than the region, the frame can not be completed
+            error("file of fd {} ended {} bytes early", fd(), region.len);
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return false;
+        } else {
+            error("sendfile, errno: {}", errno);
+        }
+        close();
+        return false;
+    }
+}
+
+} // namespace xuanqiong::net
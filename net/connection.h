@@ -1,18 +1,39 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <coroutine>
+#include <deque>
+#include <utility>
 
 #include "net/socket.h"
+#include "scheduler/awaitable.h"
 #include "util/input_stream.h"
 #include "util/output_stream.h"
+#include "util/histogram.h"
+#include "util/attachment.h"
 
 namespace xuanqiong::net {
 
+// per-connection counters, written by the owning executor and
+// read by the stats service
+struct ConnStats {
+    std::atomic<uint64_t> bytes_in{0};
+    std::atomic<uint64_t> bytes_out{0};
+    std::atomic<uint64_t> frames_in{0};
+    std::atomic<uint64_t> frames_out{0};
+    std::atomic<uint64_t> errors{0};
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    }
+};
+
 class Connection {
 public:
     Connection(int fd, bool dummy)
         : is_dummy_(dummy), socket_(std::make_unique<Socket>(fd)) {}
-    virtual ~Connection() = default;
+    virtual ~Connection();
 
     bool is_dummy() const { return is_dummy_; }
 
@@ -34,28 +55,65 @@ public:
     void set_read_handle(void* handle) { read_handle_ = handle; }
     void set_write_handle(void* handle) { write_handle_ = handle; }
 
-    // resume read/write coroutine handle
+    // resume read/write coroutine handle, queued if a coroutine is running,
+    // see Resumer
     void resume_read() const {
-        std::coroutine_handle<>::from_address(read_handle_).resume();
+        Resumer::resume(std::coroutine_handle<>::from_address(read_handle_));
     }
     void resume_write() const {
-        std::coroutine_handle<>::from_address(write_handle_).resume();
+        Resumer::resume(std::coroutine_handle<>::from_address(write_handle_));
     }
 
+    // fd() became readable, called by the epoll executor
+    virtual void on_readable() { resume_read(); }
+    // the write coroutine suspends until it can write more
+    virtual void wait_writable() { executor()->add_event({EventType::WRITE, this}); }
+
     void recv_add(int recv_bytes) {
         read_buf_.recv_add(recv_bytes);
+        if (recv_bytes > 0) {
+            ConnStats::add(stats_.bytes_in, recv_bytes);
+            last_recv_ns_ = util::now_ns();
+        }
     }
     // add send data size in bytes
     void send_add(int send_bytes) {
         write_buf_.send_add(send_bytes);
+        if (send_bytes > 0) {
+            ConnStats::add(stats_.bytes_out, send_bytes);
+        }
     }
 
+    // send region once the bytes now in the output buffer are sent, without
+    // copying it through the buffer where the transport allows. the
+    // connection owns region.fd from here on
+    virtual void append_file(const util::FileRegion& region);
+
+    ConnStats& stats() { return stats_; }
+    const ConnStats& stats() const { return stats_; }
+
+    // time of the last successful read, in util::now_ns()
+    int64_t last_recv_ns() const { return last_recv_ns_; }
+
     size_t read_bytes() const {
         return read_buf_.bytes();
     }
 
+    // output not sent yet, file regions included
     size_t write_bytes() const {
-        return write_buf_.bytes();
+        return write_buf_.bytes() + file_bytes_;
+    }
+    // some of it can be sent now, it is not all held by a length slot
+    bool write_due() const {
+        return buffer_writable() > 0 || file_due();
+    }
+
+    // fill in a length slot of the output and wake the writer, which stops
+    // at the slot until then
+    uint32_t patch_length(util::OutputSlot slot) {
+        auto length = write_buf_.patch_length(slot);
+        resume_write();
+        return length;
     }
 
     util::NetInputStream get_input_stream() {
@@ -66,7 +124,30 @@ public:
         return util::NetOutputStream(&write_buf_);
     }
 
+    // compression negotiation, a bit per algorithm the peer can decode.
+    // learned from its frames, 0 until it told us
+    uint32_t peer_compress() const { return peer_compress_; }
+    void set_peer_compress(uint32_t mask) { peer_compress_ = mask; }
+    // true for the first frame we send, which advertises our algorithms
+    bool take_compress_advert() { return !std::exchange(compress_advertised_, true); }
+
 protected:
+    // bytes of the output buffer to send before the next file region or
+    // unpatched length slot
+    size_t buffer_writable() const {
+        size_t sendable = write_buf_.sendable();
+        return files_.empty() ? sendable : std::min(sendable, files_.front().first - write_buf_.sent_bytes());
+    }
+    // the next bytes to send are those of files_.front()
+    bool file_due() const {
+        return !files_.empty() && files_.front().first == write_buf_.sent_bytes();
+    }
+    // n bytes of the due file region were sent
+    void file_sent(size_t n);
+    // sendfile() the due region on a non-blocking socket. false once the
+    // socket is full, or the connection closed on an error
+    bool send_file();
+
     bool is_dummy_;              // dummy connection, for event notify
 
     util::InputBuffer read_buf_;    // read buffer
@@ -77,6 +158,17 @@ protected:
 
     std::unique_ptr<Socket> socket_;  // socket
 
+    ConnStats stats_;
+    int64_t last_recv_ns_ = 0;
+
+    uint32_t peer_compress_ = 0;
+    bool compress_advertised_ = false;
+
+    // file regions in output order, each due once the bytes of write_buf_
+    // sent reach the first of its pair
+    std::deque<std::pair<uint64_t, util::FileRegion>> files_;
+    size_t file_bytes_ = 0;         // bytes of files_ not sent yet
+
     DISALLOW_COPY_AND_ASSIGN(Connection);
 };
 
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <charconv>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/un.h>
+#include <net/if.h>
+
+#include "net/endpoint.h"
+#include "util/common.h"
+
+namespace xuanqiong::net {
+
+constexpr static std::string_view kUnixPrefix = "unix:";
+constexpr static std::string_view kAbstractPrefix = "unix-abstract:";
+constexpr static std::string_view kShmPrefix = "shm:";
+
+Endpoint::Endpoint(const struct sockaddr* addr, socklen_t addr_len)
+    : addr_len_(std::min<socklen_t>(addr_len, sizeof(addr_))) {
+    memcpy(&addr_, addr, addr_len_);
+}
+
+bool Endpoint::parse(std::string_view text, Endpoint* endpoint) {
+    *endpoint = Endpoint();
+    bool abstract = text.starts_with(kAbstractPrefix);
+    bool shm = text.starts_with(kShmPrefix);
+    if (abstract || shm || text.starts_with(kUnixPrefix)) {
+        auto name = text.substr(abstract ? kAbstractPrefix.size()
+                              : shm ? kShmPrefix.size() : kUnixPrefix.size());
+        auto un = reinterpret_cast<struct sockaddr_un*>(&endpoint->addr_);
+        // abstract names start with a nul byte and are not nul terminated
+        size_t offset = abstract ? 1 : 0;
+        if (name.empty() || offset + name.size() >= sizeof(un->sun_path)) {
+            return false;
+        }
+#ifndef __linux__
+        if (abstract || shm) {
+            return false;
+        }
+#endif
+        endpoint->shm_ = shm;
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path + offset, name.data(), name.size());
+        endpoint->addr_len_ = offsetof(struct sockaddr_un, sun_path) + offset + name.size()
+                            + (abstract ? 0 : 1);
+        return true;
+    }
+
+    auto colon = text.rfind(':');
+    if (colon == std::string_view::npos) {
+        return false;
+    }
+    int port;
+    auto port_text = text.substr(colon + 1);
+    auto [ptr, ec] = std::from_chars(port_text.data(), port_text.data() + port_text.size(), port);
+    if (ec != std::errc() || ptr != port_text.data() + port_text.size() || port < 0 || port > 65535) {
+        return false;
+    }
+    auto host = text.substr(0, colon);
+    bool v6 = host.starts_with('[') && host.ends_with(']');
+    if (v6) {
+        host = host.substr(1, host.size() - 2);
+    }
+    if (auto percent = host.find('%'); percent != std::string_view::npos) {
+        endpoint->interface_ = host.substr(percent + 1);
+        host = host.substr(0, percent);
+        if (endpoint->interface_.empty() || endpoint->interface_.size() >= IF_NAMESIZE) {
+            return false;
+        }
+    }
+    std::string ip(host);
+    if (v6) {
+        auto in6 = reinterpret_cast<struct sockaddr_in6*>(&endpoint->addr_);
+        if (::inet_pton(AF_INET6, ip.c_str(), &in6->sin6_addr) != 1) {
+            return false;
+        }
+        if (!endpoint->interface_.empty()) {
+            in6->sin6_scope_id = ::if_nametoindex(endpoint->interface_.c_str());
+            if (in6->sin6_scope_id == 0) {
+                return false;
+            }
+        }
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        endpoint->addr_len_ = sizeof(struct sockaddr_in6);
+        return true;
+    }
+    auto in = reinterpret_cast<struct sockaddr_in*>(&endpoint->addr_);
+    if (::inet_pton(AF_INET, ip.c_str(), &in->sin_addr) != 1) {
+        return false;
+    }
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port);
+    endpoint->addr_len_ = sizeof(struct sockaddr_in);
+    return true;
+}
+
+Endpoint Endpoint::any(int port) {
+    Endpoint endpoint;
+    auto in = reinterpret_cast<struct sockaddr_in*>(&endpoint.addr_);
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port);
+    in->sin_addr.s_addr = INADDR_ANY;
+    endpoint.addr_len_ = sizeof(struct sockaddr_in);
+    return endpoint;
+}
+
+std::string Endpoint::path() const {
+    auto un = reinterpret_cast<const struct sockaddr_un*>(&addr_);
+    if (!is_unix() || addr_len_ <= offsetof(struct sockaddr_un, sun_path) || un->sun_path[0] == '\0') {
+        return "";
+    }
+    return std::string(un->sun_path, strnlen(un->sun_path, addr_len_ - offsetof(struct sockaddr_un, sun_path)));
+}
+
+bool Endpoint::is_wildcard() const {
+    switch (family()) {
+        case AF_INET:
+            return reinterpret_cast<const struct sockaddr_in*>(&addr_)->sin_addr.s_addr == INADDR_ANY;
+        case AF_INET6:
+            return IN6_IS_ADDR_UNSPECIFIED(&reinterpret_cast<const struct sockaddr_in6*>(&addr_)->sin6_addr);
+        default:
+            return false;
+    }
+}
+
+std::string Endpoint::host() const {
+    switch (family()) {
+        case AF_INET: {
+            char ip[INET_ADDRSTRLEN];
+            auto in = reinterpret_cast<const struct sockaddr_in*>(&addr_);
+            return ::inet_ntop(AF_INET, &in->sin_addr, ip, sizeof(ip)) ? ip : "";
+        }
+        case AF_INET6: {
+            char ip[INET6_ADDRSTRLEN];
+            auto in6 = reinterpret_cast<const struct sockaddr_in6*>(&addr_);
+            return ::inet_ntop(AF_INET6, &in6->sin6_addr, ip, sizeof(ip)) ? ip : "";
+        }
+        case AF_UNIX: {
+            // the connecting end of a unix socket is usually unnamed
+            size_t name_len = addr_len_ > offsetof(struct sockaddr_un, sun_path)
+                            ? addr_len_ - offsetof(struct sockaddr_un, sun_path) : 0;
+            auto un = reinterpret_cast<const struct sockaddr_un*>(&addr_);
+            if (name_len > 0 && un->sun_path[0] == '\0') {
+                return std::string(kAbstractPrefix) + std::string(un->sun_path + 1, name_len - 1);
+            }
+            return std::string(shm_ ? kShmPrefix : kUnixPrefix) + path();
+        }
+        default:
+            return "";
+    }
+}
+
+int Endpoint::port() const {
+    switch (family()) {
+        case AF_INET:
+            return ntohs(reinterpret_cast<const struct sockaddr_in*>(&addr_)->sin_port);
+        case AF_INET6:
+            return ntohs(reinterpret_cast<const struct sockaddr_in6*>(&addr_)->sin6_port);
+        default:
+            return 0;
+    }
+}
+
+std::string Endpoint::to_string() const {
+    auto scope = interface_.empty() ? "" : "%" + interface_;
+    switch (family()) {
+        case AF_INET:
+            return std::format("{}{}:{}", host(), scope, port());
+        case AF_INET6:
+            return std::format("[{}{}]:{}", host(), scope, port());
+        default:
+            return host();
+    }
+}
+
+} // namespace xuanqiong::net
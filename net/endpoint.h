@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+
+namespace xuanqiong::net {
+
+// an address to listen on or connect to, kept in binary form and only
+// formatted on demand:
+//   "ip:port"              tcp over ipv4
+//   "[ip6]:port"           tcp over ipv6, "[::]:port" is every interface
+//   "unix:/path"           unix domain socket bound to a file
+//   "unix-abstract:name"   linux abstract namespace, no file involved
+//   "shm:/path"            unix socket which hands over shared memory rings,
+//                          see ShmConnection. linux only
+// tcp addresses may name an interface, "ip%eth0:port" or "[ip6%eth0]:port".
+// it is the scope of a link-local ipv6 address, and listeners bind to it
+class Endpoint {
+public:
+    Endpoint() = default;
+    // from an address returned by accept, getsockname or getpeername
+    Endpoint(const struct sockaddr* addr, socklen_t addr_len);
+
+    // false if text is not one of the forms above
+    static bool parse(std::string_view text, Endpoint* endpoint);
+    // every ipv4 interface
+    static Endpoint any(int port);
+
+    int family() const { return addr_.ss_family; }
+    bool is_unix() const { return family() == AF_UNIX; }
+    bool is_shm() const { return shm_; }
+    bool is_tcp() const { return family() == AF_INET || family() == AF_INET6; }
+    // INADDR_ANY or in6addr_any, the local address of a connection is not
+    // known before it is accepted
+    bool is_wildcard() const;
+    // the socket file of a "unix:" endpoint, empty otherwise
+    std::string path() const;
+    // from a "%name" suffix, empty if none
+    const std::string& interface() const { return interface_; }
+
+    // ip or "unix:..." name, and the port, 0 for unix sockets
+    std::string host() const;
+    int port() const;
+    std::string to_string() const;
+
+    const struct sockaddr* addr() const { return reinterpret_cast<const struct sockaddr*>(&addr_); }
+    socklen_t addr_len() const { return addr_len_; }
+
+private:
+    struct sockaddr_storage addr_{};
+    socklen_t addr_len_ = 0;
+    std::string interface_;
+    bool shm_ = false;
+};
+
+} // namespace xuanqiong::net
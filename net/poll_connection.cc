@@ -35,20 +35,28 @@ ReadAwaiter PollConnection::async_read() {
     if (closed()) {
         resume_write();
     }
-    read_buf_.recv_add(read_bytes);
+    recv_add(read_bytes);
     bool should_suspend = !closed() && read_bytes <= 0;
     return {this, should_suspend};
 }
 
 WriteAwaiter PollConnection::async_write() {
-    int need_write = write_buf_.bytes();
-    int nwrite = 0;
-    // info("[start] async_write, need_write: {}", need_write);
-    while (nwrite < need_write) {
-        auto iovs = write_buf_.get_iovecs();
+    bool blocked = false;
+    // info("[start] async_write, need_write: {}", write_bytes());
+    while (!blocked && !closed()) {
+        if (file_due()) {
+            blocked = !send_file();
+            continue;
+        }
+        size_t writable = buffer_writable();
+        if (writable == 0) {
+            break;
+        }
+        auto iovs = write_buf_.get_iovecs(writable);
         int n = ::writev(fd(), iovs.data(), iovs.size());
         if (n >= 0) {
-            nwrite += n;
+            // consume now, the next writev must start after these bytes
+            send_add(n);
             continue;
         } else {
             // retry
@@ -56,15 +64,16 @@ WriteAwaiter PollConnection::async_write() {
                 continue;
             }
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                blocked = true;
                 break;
             }
-            // other error
+            // other error, the peer is gone
             error("write data, errno: {}", errno);
+            close();
             break;
         }
     }
-    write_buf_.send_add(nwrite);
-    bool should_suspend = !closed() && nwrite < need_write;
+    bool should_suspend = !closed() && blocked;
     return {this, should_suspend};
 }
 
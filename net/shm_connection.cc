@@ -0,0 +1,363 @@
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "net/shm_connection.h"
+
+namespace xuanqiong::net {
+
+constexpr static uint32_t kShmMagic = 0x58514d53;  // "XQMS"
+constexpr static uint32_t kShmVersion = 1;
+constexpr static size_t kMinRingSize = 4096;
+constexpr static size_t kMaxRingSize = 1 << 30;
+// a segment that could shrink under the server would fault it with SIGBUS
+constexpr static int kShmSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+// single producer, single consumer byte ring. positions only grow, the
+// offset in the data is position & (ring_size - 1)
+struct ShmRing {
+    // written by the producer
+    alignas(64) std::atomic<uint64_t> head;          // bytes written
+    std::atomic<uint32_t> writer_waiting;            // found it full, wants a doorbell
+    // written by the consumer
+    alignas(64) std::atomic<uint64_t> tail;          // bytes read
+    std::atomic<uint32_t> reader_waiting;            // found it empty, wants a doorbell
+};
+
+// start of the shared memory, the data of both rings follows
+struct ShmSegment {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ring_size;
+    ShmRing rings[2];   // client to server, server to client
+};
+
+// the first message on the socket, carries the memfd
+struct ShmHello {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+};
+
+// shared with another process, must not fall back to a lock
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+static bool valid_ring_size(size_t ring_size) {
+    return ring_size >= kMinRingSize && ring_size <= kMaxRingSize
+        && (ring_size & (ring_size - 1)) == 0;
+}
+
+static void copy_in(uint8_t* data, size_t ring_size, uint64_t pos, const uint8_t* src, size_t n) {
+    size_t offset = pos & (ring_size - 1);
+    size_t first = std::min(n, ring_size - offset);
+    memcpy(data + offset, src, first);
+    memcpy(data, src + first, n - first);
+}
+
+static void copy_out(const uint8_t* data, size_t ring_size, uint64_t pos, uint8_t* dst, size_t n) {
+    size_t offset = pos & (ring_size - 1);
+    size_t first = std::min(n, ring_size - offset);
+    memcpy(dst, data + offset, first);
+    memcpy(dst + first, data, n - first);
+}
+
+ShmConnection::ShmConnection(int fd, Executor* executor)
+    : Connection(fd, false), executor_(executor) {
+}
+
+ShmConnection::~ShmConnection() {
+    if (segment_) {
+        ::munmap(segment_, segment_size_);
+    }
+}
+
+bool ShmConnection::map(int memfd, size_t size, bool server) {
+    void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, memfd, 0);
+    if (addr == MAP_FAILED) {
+        error("mmap shm failed: {}", strerror(errno));
+        return false;
+    }
+    segment_ = static_cast<ShmSegment*>(addr);
+    segment_size_ = size;
+    ring_size_ = (size - sizeof(ShmSegment)) / 2;
+    auto data = reinterpret_cast<uint8_t*>(segment_ + 1);
+    tx_ = &segment_->rings[server ? 1 : 0];
+    rx_ = &segment_->rings[server ? 0 : 1];
+    tx_data_ = data + (server ? ring_size_ : 0);
+    rx_data_ = data + (server ? 0 : ring_size_);
+    return true;
+}
+
+bool ShmConnection::connect(size_t ring_size) {
+    if (!valid_ring_size(ring_size)) {
+        error("shm ring size {} is not a power of two in [{}, {}]", ring_size, kMinRingSize, kMaxRingSize);
+        return false;
+    }
+    size_t size = sizeof(ShmSegment) + 2 * ring_size;
+    int memfd = ::memfd_create("xq-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd == -1) {
+        error("memfd_create failed: {}", strerror(errno));
+        return false;
+    }
+    // fresh pages are zero, so are the positions and flags of both rings
+    bool ok = ::ftruncate(memfd, size) == 0 && ::fcntl(memfd, F_ADD_SEALS, kShmSeals) == 0
+           && map(memfd, size, false);
+    if (ok) {
+        segment_->magic = kShmMagic;
+        segment_->version = kShmVersion;
+        segment_->ring_size = ring_size;
+
+        ShmHello hello{kShmMagic, kShmVersion, size};
+        struct iovec iov{&hello, sizeof(hello)};
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+        ok = ::sendmsg(fd(), &msg, MSG_NOSIGNAL) == sizeof(hello);
+        if (!ok) {
+            error("send shm segment failed: {}", strerror(errno));
+        }
+    } else {
+        error("create shm segment of {} bytes failed: {}", size, strerror(errno));
+    }
+    ::close(memfd);
+    return ok;
+}
+
+bool ShmConnection::recv_segment() {
+    ShmHello hello{};
+    struct iovec iov{&hello, sizeof(hello)};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = ::recvmsg(fd(), &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        // not here yet
+        return true;
+    }
+    int memfd = -1;
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    if (n > 0 && cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (n != sizeof(hello) || memfd == -1 || hello.magic != kShmMagic || hello.version != kShmVersion) {
+        if (n != 0) {
+            error("bad shm handshake on fd {}", fd());
+        }
+        if (memfd != -1) {
+            ::close(memfd);
+        }
+        return false;
+    }
+    // the size has to stay what it is now, the peer could truncate it later
+    int seals = ::fcntl(memfd, F_GET_SEALS);
+    if (seals == -1 || (seals & kShmSeals) != kShmSeals) {
+        error("shm segment on fd {} is not sealed", fd());
+        ::close(memfd);
+        return false;
+    }
+    // the peer could have lied about the size, check it against the memfd
+    struct stat st;
+    bool ok = ::fstat(memfd, &st) == 0 && static_cast<uint64_t>(st.st_size) == hello.size
+           && hello.size > sizeof(ShmSegment)
+           && valid_ring_size((hello.size - sizeof(ShmSegment)) / 2)
+           && map(memfd, hello.size, true);
+    ::close(memfd);
+    if (ok && segment_->ring_size != ring_size_) {
+        error("shm ring size {} does not match segment of {} bytes", segment_->ring_size, hello.size);
+        ok = false;
+    }
+    return ok;
+}
+
+void ShmConnection::ring_doorbell() {
+    // a full socket buffer already holds a wakeup, and a peer that is gone
+    // shows up as a hangup
+    uint8_t byte = 1;
+    ::send(fd(), &byte, 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+ReadAwaiter ShmConnection::async_read() {
+    if (closed()) {
+        return {this, false};
+    }
+    if (!attached() && !recv_segment()) {
+        close();
+        resume_write();
+        return {this, false};
+    }
+    if (!attached()) {
+        return {this, true};
+    }
+
+    uint64_t tail = rx_tail_;
+    uint64_t head = rx_->head.load(std::memory_order_acquire);
+    if (head == tail) {
+        // ask for a doorbell, then look once more, the writer may have
+        // checked the flag before it was set
+        rx_->reader_waiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        head = rx_->head.load(std::memory_order_acquire);
+        if (head == tail) {
+            return {this, true};
+        }
+        rx_->reader_waiting.store(0, std::memory_order_relaxed);
+    }
+    // positions live in memory the peer can write, do not trust them
+    if (head - tail > ring_size_) {
+        error("shm ring of fd {} is corrupt", fd());
+        close();
+        resume_write();
+        return {this, false};
+    }
+    while (tail < head) {
+        auto [buffer, max_size] = read_buf_.get_buffer();
+        size_t n = std::min<uint64_t>(head - tail, max_size);
+        copy_out(rx_data_, ring_size_, tail, buffer, n);
+        tail += n;
+        recv_add(n);
+    }
+    rx_tail_ = tail;
+    rx_->tail.store(tail, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (rx_->writer_waiting.load(std::memory_order_relaxed)
+            && rx_->writer_waiting.exchange(0, std::memory_order_relaxed)) {
+        ring_doorbell();
+    }
+    return {this, false};
+}
+
+WriteAwaiter ShmConnection::async_write() {
+    if (closed()) {
+        return {this, false};
+    }
+    size_t need_write = write_buf_.sendable();
+    if (!attached()) {
+        // the server has not read the rings yet, it answers nothing before
+        write_blocked_ = need_write > 0;
+        return {this, write_blocked_};
+    }
+    size_t nwrite = 0;
+    while (nwrite < need_write) {
+        uint64_t head = tx_head_;
+        uint64_t tail = tx_->tail.load(std::memory_order_acquire);
+        if (head - tail == ring_size_) {
+            tx_->writer_waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            tail = tx_->tail.load(std::memory_order_acquire);
+            if (head - tail == ring_size_) {
+                break;
+            }
+            tx_->writer_waiting.store(0, std::memory_order_relaxed);
+        }
+        if (head - tail > ring_size_) {
+            error("shm ring of fd {} is corrupt", fd());
+            close();
+            break;
+        }
+        size_t space = ring_size_ - (head - tail);
+        size_t n = 0;
+        for (const auto& iov : write_buf_.get_iovecs(need_write - nwrite)) {
+            size_t len = std::min(iov.iov_len, space - n);
+            copy_in(tx_data_, ring_size_, head + n, static_cast<const uint8_t*>(iov.iov_base), len);
+            n += len;
+            if (n == space) {
+                break;
+            }
+        }
+        tx_head_ = head + n;
+        tx_->head.store(tx_head_, std::memory_order_release);
+        send_add(n);
+        nwrite += n;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (tx_->reader_waiting.load(std::memory_order_relaxed)
+                && tx_->reader_waiting.exchange(0, std::memory_order_relaxed)) {
+            ring_doorbell();
+        }
+    }
+    write_blocked_ = nwrite < need_write && !closed();
+    return {this, write_blocked_};
+}
+
+void ShmConnection::append_file(const util::FileRegion& region) {
+    auto output_stream = get_output_stream();
+    auto offset = region.offset;
+    size_t left = region.len;
+    while (left > 0 && !closed()) {
+        void* data;
+        int size;
+        output_stream.Next(&data, &size);
+        ssize_t n = ::pread(region.fd, data, std::min<size_t>(size, left), offset);
+        if (n < 0 && errno == EINTR) {
+            output_stream.BackUp(size);
+            continue;
+        }
+        if (n <= 0) {
+            // the frame can not be completed any more
+            error("read file for fd {} failed, errno: {}", fd(), n < 0 ? errno : 0);
+            output_stream.BackUp(size);
+            close();
+            break;
+        }
+        output_stream.BackUp(size - n);
+        offset += n;
+        left -= n;
+    }
+    ::close(region.fd);
+}
+
+void ShmConnection::on_readable() {
+    // a hangup seen before, the coroutines know
+    if (closed()) {
+        return;
+    }
+    if (!attached() && !recv_segment()) {
+        close();
+    }
+    // doorbells only say to look at the rings, drop them
+    uint8_t bytes[64];
+    while (attached() && !closed()) {
+        ssize_t n = ::read(fd(), bytes, sizeof(bytes));
+        if (n > 0) {
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            close();
+        }
+        break;
+    }
+    if (closed()) {
+        resume_write();
+    } else if (write_blocked_ && attached()) {
+        if (tx_head_ - tx_->tail.load(std::memory_order_acquire) != ring_size_) {
+            write_blocked_ = false;
+            resume_write();
+        }
+    }
+    // last, the read side may drop the last reference to this
+    resume_read();
+}
+
+} // namespace xuanqiong::net
+
+#endif
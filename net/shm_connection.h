@@ -0,0 +1,78 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cstddef>
+
+#include "util/input_stream.h"
+#include "util/output_stream.h"
+#include "net/connection.h"
+
+namespace xuanqiong {
+class Executor;
+}
+
+namespace xuanqiong::net {
+
+struct ShmSegment;
+struct ShmRing;
+
+// connection to a process on the same host through a pair of shared memory
+// rings, one per direction. the client creates them and passes them over a
+// connected unix socket, which then only carries wakeups: a byte is sent
+// when the peer found its ring empty (or full) and went to sleep. a peer
+// that exits hangs up the socket like any other connection.
+// driven by the epoll executor only
+class ShmConnection : public Connection {
+public:
+    ShmConnection(int fd, Executor* executor);
+    ~ShmConnection();
+
+    // client side: create rings of ring_size bytes, a power of two, and
+    // send them. the server side attaches on its first read
+    bool connect(size_t ring_size);
+    bool attached() const { return segment_ != nullptr; }
+
+    Executor* executor() const override { return executor_; }
+
+    // copy between the rings and the connection buffers
+    ReadAwaiter async_read() override;
+    WriteAwaiter async_write() override;
+
+    void on_readable() override;
+    // woken by the reader of the ring instead of by fd()
+    void wait_writable() override {}
+
+    // the peer reads from memory anyway, the region is copied into the ring
+    // through the output buffer
+    void append_file(const util::FileRegion& region) override;
+
+private:
+    bool map(int memfd, size_t size, bool server);
+    // read the rings from the socket once, returns false if they are bad
+    bool recv_segment();
+    // wake the peer
+    void ring_doorbell();
+
+    Executor* executor_;
+
+    ShmSegment* segment_ = nullptr;
+    size_t segment_size_ = 0;
+    ShmRing* tx_ = nullptr;       // we write, the peer reads
+    ShmRing* rx_ = nullptr;       // the peer writes, we read
+    uint8_t* tx_data_ = nullptr;
+    uint8_t* rx_data_ = nullptr;
+    size_t ring_size_ = 0;
+    // our own positions, the copies in shared memory are for the peer
+    uint64_t tx_head_ = 0;
+    uint64_t rx_tail_ = 0;
+
+    bool write_blocked_ = false;  // tx_ was full when the write coroutine suspended
+
+    DISALLOW_COPY_AND_ASSIGN(ShmConnection);
+};
+
+} // namespace xuanqiong::net
+
+#endif
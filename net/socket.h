@@ -3,6 +3,7 @@
 #include <unistd.h>
 #include <sys/socket.h>
 
+#include "net/endpoint.h"
 #include "util/common.h"
 #include "scheduler/awaitable.h"
 
@@ -14,10 +15,14 @@ public:
     ~Socket();
 
     int fd() const { return sockfd_; }
-    const std::string& local_addr() const { return local_addr_; }
-    int local_port() const { return local_port_; }
-    const std::string& peer_addr() const { return peer_addr_; }
-    int peer_port() const { return peer_port_; }
+    // addresses as known to whoever created the socket, empty if unknown.
+    // set before the socket is shared with other threads
+    const Endpoint& local() const { return local_; }
+    const Endpoint& peer() const { return peer_; }
+    void set_endpoints(const Endpoint& local, const Endpoint& peer) {
+        local_ = local;
+        peer_ = peer;
+    }
 
     // close socket
     void close() {
@@ -31,10 +36,8 @@ public:
 private:
     int sockfd_;              // peer socket
 
-    std::string local_addr_;  // local address
-    int local_port_;          // local port
-    std::string peer_addr_;   // peer address
-    int peer_port_;           // peer port
+    Endpoint local_;          // local address
+    Endpoint peer_;           // peer address
 
     bool closed_;             // socket closed
 };
@@ -5,15 +5,19 @@
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
 
 #include "net/socket_utils.h"
 #include "util/common.h"
 
 namespace xuanqiong::net {
 
-int SocketUtils::socket() {
+int SocketUtils::socket(int family) {
     int sockfd;
-    if ((sockfd = ::socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    if ((sockfd = ::socket(family, SOCK_STREAM, 0)) < 0) {
         error("create socket failed: {}", strerror(errno));
         exit(EXIT_FAILURE);
     }
@@ -51,11 +55,6 @@ void SocketUtils::inet_pton(int af, const char *src, void *dst) {
     }
 }
 
-std::string SocketUtils::inet_ntoa(struct in_addr in) {
-    const char* ip = ::inet_ntoa(in);
-    return ip;
-}
-
 int SocketUtils::connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
     int ret = ::connect(sockfd, addr, addrlen);
     if (ret < 0) {
@@ -81,4 +80,57 @@ void SocketUtils::setsocketopt(int sockfd, int level, int optname, const void* o
     }
 }
 
+// the address bytes of an ipv4 or ipv6 socket address, ipv4-mapped ipv6
+// addresses as plain ipv4 so dual-stack listeners match ipv4 interfaces
+static std::string_view address_bytes(const struct sockaddr* addr) {
+    if (addr->sa_family == AF_INET) {
+        auto in = &reinterpret_cast<const struct sockaddr_in*>(addr)->sin_addr;
+        return {reinterpret_cast<const char*>(in), sizeof(*in)};
+    }
+    if (addr->sa_family == AF_INET6) {
+        auto in6 = &reinterpret_cast<const struct sockaddr_in6*>(addr)->sin6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(in6)) {
+            return {reinterpret_cast<const char*>(in6) + 12, 4};
+        }
+        return {reinterpret_cast<const char*>(in6), sizeof(*in6)};
+    }
+    return {};
+}
+
+int SocketUtils::numa_node(const Endpoint& local) {
+    auto addr = address_bytes(local.addr());
+    if (addr.empty()) {
+        return -1;
+    }
+
+    static std::mutex mutex;
+    static std::unordered_map<std::string, int> addr2node;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = addr2node.find(std::string(addr));
+    if (iter != addr2node.end()) {
+        return iter->second;
+    }
+
+    int node = -1;
+#ifdef __linux__
+    struct ifaddrs* ifaddr;
+    if (getifaddrs(&ifaddr) == 0) {
+        for (auto ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+            if (!ifa->ifa_addr || address_bytes(ifa->ifa_addr) != addr) {
+                continue;
+            }
+            // virtual interfaces (lo, bridges) have no device
+            std::ifstream file(std::string("/sys/class/net/") + ifa->ifa_name + "/device/numa_node");
+            if (!(file >> node)) {
+                node = -1;
+            }
+            break;
+        }
+        freeifaddrs(ifaddr);
+    }
+#endif
+    addr2node[std::string(addr)] = node;
+    return node;
+}
+
 } // namespace xuanqiong::net
@@ -3,11 +3,14 @@
 #include <string>
 #include <arpa/inet.h>
 
+#include "net/endpoint.h"
+
 namespace xuanqiong::net {
 
 class SocketUtils {
 public:
-    static int socket();
+    // stream socket of family, AF_INET or AF_UNIX
+    static int socket(int family = AF_INET);
 
     static void bind(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
 
@@ -17,13 +20,15 @@ public:
 
     static void inet_pton(int af, const char *src, void *dst);
 
-    static std::string inet_ntoa(struct in_addr in);
-
     static int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
 
     static int send(int sockfd, const void* buf, size_t len);
 
     static void setsocketopt(int sockfd, int level, int optname, const void* optval, socklen_t optlen);
+
+    // numa node of the NIC owning the local address of a connection, -1 for
+    // loopback, unix sockets or if unknown. cached per address
+    static int numa_node(const Endpoint& local);
 };
 
 } // namespace xuanqiong::net
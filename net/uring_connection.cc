@@ -1,16 +1,27 @@
 #ifdef __linux__
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "net/uring_connection.h"
 #include "scheduler/uring_executor.h"
 
 namespace xuanqiong::net {
 
+// default capacity of a pipe, a splice into it never blocks
+constexpr static size_t kPipeChunk = 64 * 1024;
+
 UringConnection::UringConnection(int fd, Executor* executor, bool dummy)
     : Connection(fd, dummy), executor_(executor), back_left_(0) {
     uring_ = static_cast<UringExecutor*>(executor)->uring();
 }
 
-UringConnection::~UringConnection() = default;
+UringConnection::~UringConnection() {
+    if (pipe_[0] != -1) {
+        ::close(pipe_[0]);
+        ::close(pipe_[1]);
+    }
+}
 
 void UringConnection::send_add(int nwrite) {
     back_left_ -= nwrite;
@@ -34,17 +45,22 @@ ReadAwaiter UringConnection::async_read() {
 
 WriteAwaiter UringConnection::async_write() {
     // if there are bytes left to back, suspend
-    if (back_left_ > 0) {
+    if (back_left_ > 0 || splicing_) {
         return {this, true};
     }
 
-    back_left_ = write_buf_.bytes();
+    if (file_due()) {
+        splice_next();
+        return {this, !closed()};
+    }
+
+    back_left_ = buffer_writable();
     if (back_left_ == 0) {
         // no bytes to write, do not suspend
         return {this, false};
     }
 
-    write_buf_.get_iovecs().swap(ioves_);
+    write_buf_.get_iovecs(back_left_).swap(ioves_);
 
     auto sqe = io_uring_get_sqe(uring_);
     if (!sqe) {
@@ -59,6 +75,58 @@ WriteAwaiter UringConnection::async_write() {
     return {this, should_suspend};
 }
 
+void UringConnection::splice_next() {
+    if (pipe_[0] == -1 && ::pipe2(pipe_, O_CLOEXEC) == -1) {
+        error("pipe2 failed, errno: {}", errno);
+        close();
+        return;
+    }
+    auto& region = files_.front().second;
+    auto sqe = io_uring_get_sqe(uring_);
+    if (!sqe) {
+        io_uring_submit(uring_);
+        sqe = io_uring_get_sqe(uring_);
+    }
+    splice_out_ = piped_ > 0;
+    if (splice_out_) {
+        io_uring_prep_splice(sqe, pipe_[0], -1, fd(), -1, piped_, 0);
+    } else {
+        auto len = std::min(region.len, kPipeChunk);
+        io_uring_prep_splice(sqe, region.fd, region.offset, pipe_[1], -1, len, 0);
+    }
+    sqe->user_data =
+        (static_cast<uint64_t>(EventType::SPLICE) << 56) | reinterpret_cast<uint64_t>(this);
+    splicing_ = true;
+}
+
+void UringConnection::splice_done(int res) {
+    splicing_ = false;
+    if (closed()) {
+        resume_write();
+        return;
+    }
+    if (res <= 0) {
+        // 0 into the pipe: the file is shorter than the region
+        error("splice of fd {} failed: {}", fd(), res);
+        close();
+        resume_write();
+        return;
+    }
+    if (!splice_out_) {
+        piped_ += res;
+        splice_next();
+        return;
+    }
+    piped_ -= res;
+    bool more = piped_ > 0 || files_.front().second.len > static_cast<size_t>(res);
+    file_sent(res);
+    if (more) {
+        splice_next();
+        return;
+    }
+    resume_write();
+}
+
 } // namespace xuanqiong::net
 
 #endif
@@ -24,11 +24,21 @@ public:
 
     size_t back_left() const { return back_left_; }
 
+    // a writev or splice is in flight, its completion resumes the writer
+    bool write_in_flight() const { return back_left_ > 0 || splicing_; }
+
+    // completion of the splice started by splice_next()
+    void splice_done(int res);
+
     // async read/write
     ReadAwaiter async_read() override;
     WriteAwaiter async_write() override;
 
 private:
+    // moves the due file region to the socket through pipe_, one splice
+    // sqe at a time: file into the pipe, then the pipe into the socket
+    void splice_next();
+
     bool dummy_;              // dummy connection, for event notify
     Executor* executor_;      // coroutine executor
     io_uring* uring_;        // io_uring instance
@@ -36,6 +46,11 @@ private:
     size_t back_left_;      // bytes left to back
     std::vector<iovec> ioves_; // iovecs for write
 
+    int pipe_[2] = {-1, -1};    // created on the first file region
+    size_t piped_ = 0;          // bytes of the due region in the pipe
+    bool splicing_ = false;     // a splice sqe is in flight
+    bool splice_out_ = false;   // ...from the pipe into the socket
+
     DISALLOW_COPY_AND_ASSIGN(UringConnection);
 };
 
@@ -2,139 +2,593 @@
 #include <chrono>
 #include <thread>
 #include <vector>
-#include <mutex>
-#include <algorithm>
+#include <random>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <fstream>
 #include <iostream>
-#include <future>
 
 #include "example/echo.pb.h"
 #include "util/common.h"
 #include "util/service.h"
+#include "util/histogram.h"
 #include "client/client_channel.h"
+#include "net/endpoint.h"
 #include "scheduler/scheduler.h"
 
 using namespace xuanqiong;
 
-// ============ config ============
-constexpr int kConcurrency = 32;
-constexpr int kTotalRequests = 100000;
-constexpr bool kRecordLatency = false;
-constexpr const char* kServerAddr = "127.0.0.1";
-constexpr int kServerPort = 8888;
-// =================================
+constexpr static int64_t kNsPerSec = 1'000'000'000;
+// how long to wait for in-flight calls once the measured window ends
+constexpr static int64_t kDrainTimeoutNs = 5 * kNsPerSec;
 
-std::atomic<int> g_sent{0};
-std::atomic<int> g_completed{0};
+enum class PayloadDist : uint8_t {
+    FIXED,      // always min
+    UNIFORM,    // uniform in [min, max]
+    EXP,        // exponential with mean min, clamped to max
+};
 
-std::vector<std::chrono::nanoseconds> g_latencies;
-std::mutex g_latencies_mutex;
+struct MethodWeight {
+    const google::protobuf::MethodDescriptor* method;
+    uint32_t weight;
+};
 
-void handle_response(
-    EchoResponse* response,
-    std::chrono::steady_clock::time_point start_time) {
-    
-    auto end = std::chrono::steady_clock::now();
-    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_time);
+struct PressOptions {
+    // see net::Endpoint, e.g. unix:/tmp/echo.sock
+    std::string server = "127.0.0.1:8888";
+    // measured first with the same load, the result is reported against it
+    std::string baseline;
+    int connections = 32;
+    // each thread owns a scheduler and an equal share of the connections
+    int threads = 1;
+    // 0 runs closed-loop with `inflight` outstanding calls per connection,
+    // otherwise calls are sent open-loop at this aggregate rate
+    int64_t qps = 0;
+    int inflight = 1;
+    PayloadDist payload_dist = PayloadDist::FIXED;
+    size_t payload_min = 16;
+    size_t payload_max = 16;
+    std::vector<MethodWeight> methods;
+    int64_t duration_ns = 10 * kNsPerSec;
+    int64_t warmup_ns = 1 * kNsPerSec;
+    CompressOptions compress;
+    // result files, empty to skip, "-" for stdout
+    std::string json_path;
+    std::string hgrm_path;
+};
 
-    if (kRecordLatency) {
-        std::lock_guard<std::mutex> lk(g_latencies_mutex);
-        g_latencies.push_back(latency);
+static void usage() {
+    std::cerr <<
+        "usage: rpc_press [flags]\n"
+        "  --server=ENDPOINT       IP:PORT | unix:PATH | unix-abstract:NAME | shm:PATH (127.0.0.1:8888)\n"
+        "  --baseline=ENDPOINT     run the same load against it first and compare\n"
+        "  --connections=N         connections in total (32)\n"
+        "  --threads=N             client scheduler threads (1)\n"
+        "  --qps=N                 open-loop aggregate rate, 0 for closed-loop (0)\n"
+        "  --inflight=N            closed-loop outstanding calls per connection (1)\n"
+        "  --payload=DIST          fixed:N | uniform:MIN:MAX | exp:MEAN[:MAX] (fixed:16)\n"
+        "  --methods=MIX           weighted mix, e.g. Echo:9,Echo1:1 (Echo)\n"
+        "  --duration=SEC          measured duration (10)\n"
+        "  --warmup=SEC            unrecorded warmup before measuring (1)\n"
+        "  --compress=ALGO[:MIN]   none | lz4 | zstd for requests of MIN bytes and more (none:4096)\n"
+        "  --json=PATH             write results as json, - for stdout\n"
+        "  --hgrm=PATH             write the latency distribution in HdrHistogram format\n";
+}
+
+static bool parse_int(std::string_view text, int64_t* value) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), *value);
+    return ec == std::errc() && ptr == text.data() + text.size() && *value >= 0;
+}
+
+static bool parse_seconds(std::string_view text, int64_t* ns) {
+    double sec = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), sec);
+    if (ec != std::errc() || ptr != text.data() + text.size() || sec < 0) {
+        return false;
     }
+    *ns = static_cast<int64_t>(sec * kNsPerSec);
+    return true;
+}
 
-    // info("response: {}", response->DebugString());
+static std::vector<std::string_view> split(std::string_view text, char sep) {
+    std::vector<std::string_view> parts;
+    while (true) {
+        auto pos = text.find(sep);
+        parts.push_back(text.substr(0, pos));
+        if (pos == std::string_view::npos) {
+            return parts;
+        }
+        text.remove_prefix(pos + 1);
+    }
+}
 
-    delete response;
-    ++g_completed;
+static bool parse_payload(std::string_view text, PressOptions* options) {
+    auto parts = split(text, ':');
+    int64_t a = 0, b = 0;
+    if (parts.size() < 2 || !parse_int(parts[1], &a)) {
+        return false;
+    }
+    if (parts[0] == "fixed" && parts.size() == 2) {
+        options->payload_dist = PayloadDist::FIXED;
+        b = a;
+    } else if (parts[0] == "uniform" && parts.size() == 3 && parse_int(parts[2], &b) && a <= b) {
+        options->payload_dist = PayloadDist::UNIFORM;
+    } else if (parts[0] == "exp" && parts.size() <= 3) {
+        options->payload_dist = PayloadDist::EXP;
+        b = a * 16;
+        if (parts.size() == 3 && (!parse_int(parts[2], &b) || b < a)) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    options->payload_min = a;
+    options->payload_max = b;
+    return true;
 }
 
-void worker_thread(std::shared_ptr<ClientChannel> channel, int worker_id) {
-    EchoService_Stub stub(channel.get());
+static bool parse_methods(std::string_view text, PressOptions* options) {
+    auto service = EchoService::descriptor();
+    options->methods.clear();
+    for (auto item : split(text, ',')) {
+        auto parts = split(item, ':');
+        int64_t weight = 1;
+        if (parts.size() > 2 || (parts.size() == 2 && !parse_int(parts[1], &weight))) {
+            return false;
+        }
+        auto method = service->FindMethodByName(std::string(parts[0]));
+        if (!method) {
+            std::cerr << "unknown method: " << parts[0] << "\n";
+            return false;
+        }
+        if (weight > 0) {
+            options->methods.push_back({method, static_cast<uint32_t>(weight)});
+        }
+    }
+    return !options->methods.empty();
+}
 
-    while (true) {
-        int idx = g_sent.fetch_add(1);
-        if (idx >= kTotalRequests) break;
+static bool parse_compress(std::string_view text, PressOptions* options) {
+    auto colon = text.find(':');
+    auto algo = text.substr(0, colon);
+    if (algo == "none") {
+        options->compress.type = CompressType::NONE;
+    } else if (algo == "lz4") {
+        options->compress.type = CompressType::LZ4;
+    } else if (algo == "zstd") {
+        options->compress.type = CompressType::ZSTD;
+    } else {
+        return false;
+    }
+    if (colon == std::string_view::npos) {
+        return true;
+    }
+    int64_t min_bytes;
+    if (!parse_int(text.substr(colon + 1), &min_bytes)) {
+        return false;
+    }
+    options->compress.min_bytes = static_cast<size_t>(min_bytes);
+    return true;
+}
+
+static bool parse_options(int argc, char** argv, PressOptions* options) {
+    options->methods = {{EchoService::descriptor()->FindMethodByName("Echo"), 1}};
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        auto eq = arg.find('=');
+        if (!arg.starts_with("--") || eq == std::string_view::npos) {
+            return false;
+        }
+        auto name = arg.substr(2, eq - 2);
+        auto value = arg.substr(eq + 1);
+        int64_t n = 0;
+        bool ok = true;
+        net::Endpoint endpoint;
+        if (name == "server") {
+            ok = net::Endpoint::parse(value, &endpoint);
+            options->server = value;
+        } else if (name == "baseline") {
+            ok = net::Endpoint::parse(value, &endpoint);
+            options->baseline = value;
+        } else if (name == "connections") {
+            ok = parse_int(value, &n) && n > 0;
+            options->connections = static_cast<int>(n);
+        } else if (name == "threads") {
+            ok = parse_int(value, &n) && n > 0;
+            options->threads = static_cast<int>(n);
+        } else if (name == "qps") {
+            ok = parse_int(value, &options->qps);
+        } else if (name == "inflight") {
+            ok = parse_int(value, &n) && n > 0;
+            options->inflight = static_cast<int>(n);
+        } else if (name == "payload") {
+            ok = parse_payload(value, options);
+        } else if (name == "methods") {
+            ok = parse_methods(value, options);
+        } else if (name == "duration") {
+            ok = parse_seconds(value, &options->duration_ns) && options->duration_ns > 0;
+        } else if (name == "warmup") {
+            ok = parse_seconds(value, &options->warmup_ns);
+        } else if (name == "compress") {
+            ok = parse_compress(value, options);
+        } else if (name == "json") {
+            options->json_path = value;
+        } else if (name == "hgrm") {
+            options->hgrm_path = value;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "invalid flag: " << arg << "\n";
+            return false;
+        }
+    }
+    options->threads = std::min(options->threads, options->connections);
+    return true;
+}
+
+// one client thread: a scheduler, its connections and the histogram
+// written by the executor which runs the response callbacks
+class PressWorker {
+public:
+    PressWorker(const PressOptions& options, int connections, int64_t qps, uint64_t seed)
+        : options_(options), qps_(qps), rng_(seed),
+          // ClientChannel only connects with poll
+          scheduler_(SchedulerOptions(1000, SchedPolicy::POLL_POLICY)) {
+        executor_ = scheduler_.alloc_executor();
+        ClientOptions client_options;
+        client_options.endpoint = options.server;
+        client_options.compress = options.compress;
+        for (int i = 0; i < connections; ++i) {
+            channels_.push_back(std::make_unique<ClientChannel>(client_options, executor_));
+        }
+        payload_.assign(options.payload_max, 'x');
+        for (auto& m : options.methods) {
+            total_weight_ += m.weight;
+        }
+    }
+
+    // window in which issued calls are recorded, calls stop at measure_end
+    void run(int64_t measure_begin, int64_t measure_end) {
+        measure_begin_ = measure_begin;
+        measure_end_ = measure_end;
+        if (qps_ == 0) {
+            // closed-loop: each completion issues the next call, all of them
+            // on the executor thread so that it is the only user of rng_
+            executor_->spawn([this]() {
+                for (size_t i = 0; i < channels_.size(); ++i) {
+                    for (int j = 0; j < options_.inflight; ++j) {
+                        issue(i, util::now_ns());
+                    }
+                }
+            });
+            return;
+        }
+        thread_ = std::thread([this]() { pace(); });
+    }
+
+    void join() {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    void stop() {
+        scheduler_.stop();
+    }
+
+    uint64_t inflight() const {
+        return issued_.load(std::memory_order_acquire) - completed_.load(std::memory_order_acquire);
+    }
+    uint64_t issued() const { return issued_.load(std::memory_order_relaxed); }
+    uint64_t failed() const { return failed_.load(std::memory_order_relaxed); }
+    const util::Histogram& histogram() const { return histogram_; }
+
+private:
+    struct PendingCall {
+        EchoResponse response;
+        size_t channel;
+        int64_t start_ns;
+        // owned by the channel, valid until on_response returns
+        RpcController* controller = nullptr;
+    };
 
-        auto request = new EchoRequest();
-        request->set_message("echo_req_" + std::to_string(idx));
+    // open-loop: the n-th call is due at measure_begin - warmup + n / qps.
+    // latency is taken from the due time, not the actual send time, so a
+    // stalled sender or server is not hidden by coordinated omission
+    void pace() {
+        int64_t origin = measure_begin_ - options_.warmup_ns;
+        size_t next_channel = 0;
+        for (int64_t n = 0;; ++n) {
+            int64_t due = origin + n * kNsPerSec / qps_;
+            if (due >= measure_end_) {
+                break;
+            }
+            int64_t now = util::now_ns();
+            if (due > now) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+            }
+            issue(next_channel, due);
+            next_channel = (next_channel + 1) % channels_.size();
+        }
+    }
+
+    size_t next_payload_size() {
+        switch (options_.payload_dist) {
+            case PayloadDist::UNIFORM:
+                return std::uniform_int_distribution<size_t>(
+                    options_.payload_min, options_.payload_max)(rng_);
+            case PayloadDist::EXP:
+                return std::min<size_t>(options_.payload_max, static_cast<size_t>(
+                    std::exponential_distribution<double>(
+                        1.0 / std::max<size_t>(options_.payload_min, 1))(rng_)));
+            default:
+                return options_.payload_min;
+        }
+    }
+
+    const google::protobuf::MethodDescriptor* next_method() {
+        auto pick = std::uniform_int_distribution<uint32_t>(0, total_weight_ - 1)(rng_);
+        for (auto& m : options_.methods) {
+            if (pick < m.weight) {
+                return m.method;
+            }
+            pick -= m.weight;
+        }
+        return options_.methods.back().method;
+    }
+
+    void issue(size_t channel, int64_t start_ns) {
+        auto request = new EchoRequest;
+        request->set_message(payload_.data(), next_payload_size());
+        auto call = new PendingCall{EchoResponse(), channel, start_ns, new RpcController};
+        auto done = google::protobuf::NewCallback(this, &PressWorker::on_response, call);
+        issued_.fetch_add(1, std::memory_order_relaxed);
+        channels_[channel]->CallMethod(
+            next_method(), call->controller, request, &call->response, done);
+    }
+
+    // runs on the executor thread
+    void on_response(PendingCall* call) {
+        int64_t now = util::now_ns();
+        if (call->start_ns >= measure_begin_ && call->start_ns < measure_end_) {
+            // failed calls are counted, their latency would flatter the result
+            if (call->controller->Failed()) {
+                failed_.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                histogram_.record(now - call->start_ns);
+            }
+        }
+        if (qps_ == 0 && now < measure_end_) {
+            issue(call->channel, now);
+        }
+        delete call;
+        completed_.fetch_add(1, std::memory_order_release);
+    }
 
-        auto response = new EchoResponse;
-        auto controller = new RpcController();
+    const PressOptions& options_;
+    int64_t qps_;
+    std::mt19937_64 rng_;
+    uint32_t total_weight_ = 0;
+    std::string payload_;
 
-        auto start_time = std::chrono::steady_clock::now();
-        auto done = google::protobuf::NewCallback(&handle_response, response, start_time);
+    int64_t measure_begin_ = 0;
+    int64_t measure_end_ = 0;
 
-        stub.Echo(controller, request, response, done);
+    // destroyed after the scheduler has joined its executor
+    std::vector<std::unique_ptr<ClientChannel>> channels_;
+    Scheduler scheduler_;
+    Executor* executor_;
+    std::thread thread_;
+
+    std::atomic<uint64_t> issued_{0};
+    std::atomic<uint64_t> completed_{0};
+    std::atomic<uint64_t> failed_{0};
+    util::Histogram histogram_;
+};
+
+static void write_output(const std::string& path, const std::string& content) {
+    if (path == "-") {
+        std::cout << content;
+        return;
+    }
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "failed to open " << path << "\n";
+        return;
     }
+    out << content;
 }
 
-int main() {
-    std::cout << "Starting benchmark: "
-              << kTotalRequests << " requests, "
-              << kConcurrency << " threads\n";
-    SchedulerOptions sched_options(1000, SchedPolicy::POLL_POLICY);
-    Scheduler scheduler(sched_options);
-    auto executor = scheduler.alloc_executor();
-
-    std::vector<std::thread> workers;
-    std::vector<std::shared_ptr<ClientChannel>> channels;
-    auto test_start = std::chrono::steady_clock::now();
-
-    ClientOptions client_options;
-    client_options.ip = kServerAddr;
-    client_options.port = kServerPort;
-    for (int i = 0; i < kConcurrency; ++i) {
-        auto ch = std::make_shared<ClientChannel>(client_options, executor);
-        channels.push_back(ch);
-        workers.emplace_back(worker_thread, ch, i);
-    }
-
-    constexpr int kMaxWaitSec = 60;
-    while (g_completed < kTotalRequests) {
-        auto elapsed = std::chrono::steady_clock::now() - test_start;
-        if (elapsed > std::chrono::seconds(kMaxWaitSec)) {
-            std::cerr << "Timeout! Only completed " << g_completed << " requests.\n";
-            break;
+// percentile distribution in the HdrHistogram .hgrm text format, values in us
+static std::string format_hgrm(const util::HistogramSnapshot& snapshot) {
+    std::string out = std::format("{:>12} {:>14} {:>10} {:>14}\n\n",
+                                  "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    uint64_t total = snapshot.count();
+    uint64_t seen = 0;
+    for (auto [upper, count] : snapshot.buckets()) {
+        seen += count;
+        double q = static_cast<double>(seen) / total;
+        if (seen < total) {
+            out += std::format("{:12.3f} {:14.12f} {:10} {:14.2f}\n",
+                               upper / 1000.0, q, seen, 1 / (1 - q));
+        } else {
+            out += std::format("{:12.3f} {:14.12f} {:10}\n", upper / 1000.0, q, seen);
         }
-        // std::cout << "Completed: " << g_completed << " / " << kTotalRequests << "\n";
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
+    out += std::format("#[Mean    = {:12.3f}, Max     = {:12.3f}]\n",
+                       snapshot.mean() / 1000.0, snapshot.max() / 1000.0);
+    out += std::format("#[Total count    = {:12}]\n", total);
+    return out;
+}
 
-    auto test_end = std::chrono::steady_clock::now();
+struct PressResult {
+    util::HistogramSnapshot snapshot;
+    uint64_t issued = 0;
+    uint64_t failed = 0;
+    uint64_t unfinished = 0;
+    double qps = 0;
 
-    std::cout << "--------------\n";
-    scheduler.stop();
+    double percentile_us(double q) const { return snapshot.percentile(q) / 1000.0; }
+};
 
-    for (auto& t : workers) {
-        if (t.joinable()) t.join();
+// one measured run against options.server
+static PressResult run_press(const PressOptions& options) {
+    std::vector<std::unique_ptr<PressWorker>> workers;
+    std::random_device seed;
+    for (int i = 0; i < options.threads; ++i) {
+        // spread connections and rate as evenly as possible
+        int connections = options.connections / options.threads
+                        + (i < options.connections % options.threads);
+        int64_t qps = options.qps / options.threads + (i < options.qps % options.threads);
+        if (options.qps > 0 && qps == 0) {
+            qps = 1;
+        }
+        workers.push_back(std::make_unique<PressWorker>(options, connections, qps, seed()));
     }
 
-    double total_sec = std::chrono::duration<double>(test_end - test_start).count();
-    double qps = static_cast<double>(g_completed) / total_sec;
+    std::cerr << std::format(
+        "press {}: {} connections, {} threads, {}, {}s warmup + {}s\n",
+        options.server, options.connections, options.threads,
+        options.qps ? std::format("open-loop {} qps", options.qps)
+                    : std::format("closed-loop {} inflight", options.inflight),
+        options.warmup_ns / 1e9, options.duration_ns / 1e9);
 
-    std::cout << "\n=== Benchmark Result ===\n";
-    std::cout << "Completed: " << g_completed << " / " << kTotalRequests << "\n";
-    std::cout << "Total time: " << total_sec << " s\n";
-    std::cout << "QPS: " << static_cast<long long>(qps) << "\n";
+    int64_t measure_begin = util::now_ns() + options.warmup_ns;
+    int64_t measure_end = measure_begin + options.duration_ns;
+    for (auto& worker : workers) {
+        worker->run(measure_begin, measure_end);
+    }
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+        std::chrono::nanoseconds(measure_end)));
+    for (auto& worker : workers) {
+        worker->join();
+    }
 
-    if (kRecordLatency && !g_latencies.empty()) {
-        std::sort(g_latencies.begin(), g_latencies.end());
-        auto size = g_latencies.size();
+    // let the calls issued inside the window finish
+    PressResult result;
+    int64_t drain_deadline = util::now_ns() + kDrainTimeoutNs;
+    while (true) {
+        result.unfinished = 0;
+        for (auto& worker : workers) {
+            result.unfinished += worker->inflight();
+        }
+        if (result.unfinished == 0 || util::now_ns() >= drain_deadline) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
 
-        auto p50 = g_latencies[size * 0.50];
-        auto p90 = g_latencies[size * 0.90];
-        auto p99 = g_latencies[size * 0.99];
-        auto p999 = g_latencies[size * 0.999];
+    for (auto& worker : workers) {
+        result.snapshot.merge(worker->histogram());
+        result.issued += worker->issued();
+        result.failed += worker->failed();
+    }
+    result.qps = result.snapshot.count() / (options.duration_ns / 1e9);
+    for (auto& worker : workers) {
+        worker->stop();
+    }
+    return result;
+}
 
-        std::cout << "Raw P50 (ns): " << g_latencies[size * 0.50].count() << "\n";
+static void print_result(const std::string& server, const PressResult& result, double duration_sec) {
+    auto& snapshot = result.snapshot;
+    std::cout << std::format(
+        "=== rpc_press result: {} ===\n"
+        "completed: {} in {:.2f}s, issued: {}, failed: {}, unfinished: {}\n"
+        "qps: {:.0f}\n"
+        "latency (us): mean {:.1f}, p50 {:.1f}, p90 {:.1f}, p99 {:.1f}, "
+        "p99.9 {:.1f}, p99.99 {:.1f}, max {:.1f}\n",
+        server, snapshot.count(), duration_sec, result.issued, result.failed, result.unfinished,
+        result.qps, snapshot.mean() / 1000.0, result.percentile_us(0.5), result.percentile_us(0.9),
+        result.percentile_us(0.99), result.percentile_us(0.999), result.percentile_us(0.9999),
+        snapshot.max() / 1000.0);
+}
 
-        auto to_us = [](auto ns) { return ns.count() / 1000.0; };
+// change from before to after in percent
+static double change(double before, double after) {
+    return before > 0 ? (after - before) / before * 100 : 0;
+}
+
+static std::string format_latency_json(const PressResult& result) {
+    return std::format(
+        "{{\"mean\": {:.3f}, \"p50\": {:.3f}, \"p90\": {:.3f}, "
+        "\"p99\": {:.3f}, \"p999\": {:.3f}, \"p9999\": {:.3f}, \"max\": {:.3f}}}",
+        result.snapshot.mean() / 1000.0, result.percentile_us(0.5), result.percentile_us(0.9),
+        result.percentile_us(0.99), result.percentile_us(0.999), result.percentile_us(0.9999),
+        result.snapshot.max() / 1000.0);
+}
+
+int main(int argc, char** argv) {
+    PressOptions options;
+    if (!parse_options(argc, argv, &options)) {
+        usage();
+        return 1;
+    }
+    double duration_sec = options.duration_ns / 1e9;
 
-        std::cout << "Latency (us):\n";
-        std::cout << "  P50:  " << to_us(p50) << "\n";
-        std::cout << "  P90:  " << to_us(p90) << "\n";
-        std::cout << "  P99:  " << to_us(p99) << "\n";
-        std::cout << "  P99.9:" << to_us(p999) << "\n";
+    PressResult baseline;
+    if (!options.baseline.empty()) {
+        PressOptions baseline_options = options;
+        baseline_options.server = options.baseline;
+        baseline = run_press(baseline_options);
+        print_result(options.baseline, baseline, duration_sec);
+    }
+    auto result = run_press(options);
+    print_result(options.server, result, duration_sec);
+    if (!options.baseline.empty()) {
+        std::cout << std::format(
+            "vs {}: qps {:+.1f}%, p50 {:+.1f}%, p99 {:+.1f}%, p99.9 {:+.1f}%\n",
+            options.baseline, change(baseline.qps, result.qps),
+            change(baseline.percentile_us(0.5), result.percentile_us(0.5)),
+            change(baseline.percentile_us(0.99), result.percentile_us(0.99)),
+            change(baseline.percentile_us(0.999), result.percentile_us(0.999)));
     }
 
+    if (!options.json_path.empty()) {
+        std::string methods;
+        for (auto& m : options.methods) {
+            methods += std::format("{}\"{}\": {}", methods.empty() ? "" : ", ",
+                                   m.method->name(), m.weight);
+        }
+        std::string baseline_json;
+        if (!options.baseline.empty()) {
+            baseline_json = std::format(
+                "  \"baseline\": {{\"server\": \"{}\", \"completed\": {}, \"failed\": {}, "
+                "\"qps\": {:.1f}, \"latency_us\": {}}},\n",
+                options.baseline, baseline.snapshot.count(), baseline.failed, baseline.qps,
+                format_latency_json(baseline));
+        }
+        write_output(options.json_path, std::format(
+            "{{\n"
+            "  \"server\": \"{}\",\n"
+            "  \"connections\": {},\n"
+            "  \"threads\": {},\n"
+            "  \"mode\": \"{}\",\n"
+            "  \"target_qps\": {},\n"
+            "  \"inflight\": {},\n"
+            "  \"payload\": {{\"min\": {}, \"max\": {}}},\n"
+            "  \"methods\": {{{}}},\n"
+            "  \"warmup_sec\": {},\n"
+            "  \"duration_sec\": {},\n"
+            "{}"
+            "  \"issued\": {},\n"
+            "  \"completed\": {},\n"
+            "  \"failed\": {},\n"
+            "  \"unfinished\": {},\n"
+            "  \"qps\": {:.1f},\n"
+            "  \"latency_us\": {}\n"
+            "}}\n",
+            options.server, options.connections, options.threads,
+            options.qps ? "open" : "closed", options.qps, options.inflight,
+            options.payload_min, options.payload_max, methods,
+            options.warmup_ns / 1e9, duration_sec, baseline_json, result.issued,
+            result.snapshot.count(), result.failed, result.unfinished, result.qps,
+            format_latency_json(result)));
+    }
+    if (!options.hgrm_path.empty()) {
+        write_output(options.hgrm_path, format_hgrm(result.snapshot));
+    }
     return 0;
 }
@@ -0,0 +1,472 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#ifdef XQ_HAVE_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef XQ_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "rpc/compress.h"
+#include "net/connection.h"
+#include "proto/message.pb.h"
+#include "util/common.h"
+
+namespace xuanqiong {
+
+// serialized bytes wait in a window of this size before they go through the
+// compressor, decompressed ones are handed to the parser in one
+constexpr static size_t kWindowSize = 64 * 1024;
+// compression is for bandwidth-bound links, a fast level keeps it off the
+// critical path
+constexpr static int kZstdLevel = 1;
+
+namespace {
+
+// codec state per thread, so every executor reuses its contexts and windows
+struct CodecContext {
+    std::unique_ptr<uint8_t[]> compress_window{new uint8_t[kWindowSize]};
+    std::unique_ptr<uint8_t[]> decompress_window{new uint8_t[kWindowSize]};
+#ifdef XQ_HAVE_ZSTD
+    ZSTD_CCtx* zstd_cctx = ZSTD_createCCtx();
+    ZSTD_DCtx* zstd_dctx = ZSTD_createDCtx();
+#endif
+#ifdef XQ_HAVE_LZ4
+    LZ4F_cctx* lz4_cctx = nullptr;
+    LZ4F_dctx* lz4_dctx = nullptr;
+    // lz4 wants room for a whole compressed block per call, so its output
+    // goes through here rather than into the output blocks directly
+    std::vector<uint8_t> lz4_staging;
+#endif
+
+    CodecContext() {
+#ifdef XQ_HAVE_LZ4
+        LZ4F_createCompressionContext(&lz4_cctx, LZ4F_VERSION);
+        LZ4F_createDecompressionContext(&lz4_dctx, LZ4F_VERSION);
+#endif
+    }
+
+    ~CodecContext() {
+#ifdef XQ_HAVE_ZSTD
+        ZSTD_freeCCtx(zstd_cctx);
+        ZSTD_freeDCtx(zstd_dctx);
+#endif
+#ifdef XQ_HAVE_LZ4
+        LZ4F_freeCompressionContext(lz4_cctx);
+        LZ4F_freeDecompressionContext(lz4_dctx);
+#endif
+    }
+
+    static CodecContext& get() {
+        thread_local CodecContext context;
+        return context;
+    }
+};
+
+// the serializer writes into the window, full windows are compressed into
+// the output
+class CompressOutputStream : public google::protobuf::io::ZeroCopyOutputStream {
+public:
+    CompressOutputStream(util::NetOutputStream* output, CompressType type, size_t size)
+        : output_(output), type_(type), context_(CodecContext::get()),
+          window_(context_.compress_window.get()) {
+        begin(size);
+    }
+
+    bool Next(void** data, int* size) override {
+        if (failed_ || (used_ == kWindowSize && !compress(false))) {
+            return false;
+        }
+        *data = window_ + used_;
+        *size = kWindowSize - used_;
+        used_ = kWindowSize;
+        return true;
+    }
+
+    void BackUp(int count) override {
+        used_ -= count;
+    }
+
+    int64_t ByteCount() const override {
+        return consumed_ + used_;
+    }
+
+    // compress what is left and end the frame, false if the compressor failed
+    bool finish() {
+        return !failed_ && compress(true);
+    }
+
+private:
+    void begin(size_t size) {
+        switch (type_) {
+#ifdef XQ_HAVE_ZSTD
+            case CompressType::ZSTD: {
+                auto cctx = context_.zstd_cctx;
+                ZSTD_CCtx_reset(cctx, ZSTD_reset_session_only);
+                ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, kZstdLevel);
+                ZSTD_CCtx_setPledgedSrcSize(cctx, size);
+                return;
+            }
+#endif
+#ifdef XQ_HAVE_LZ4
+            case CompressType::LZ4: {
+                LZ4F_preferences_t prefs{};
+                prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+                prefs.frameInfo.contentSize = size;
+                auto& staging = context_.lz4_staging;
+                staging.resize(std::max<size_t>(LZ4F_compressBound(kWindowSize, &prefs), LZ4F_HEADER_SIZE_MAX));
+                auto n = LZ4F_compressBegin(context_.lz4_cctx, staging.data(), staging.size(), &prefs);
+                lz4_flush(n);
+                return;
+            }
+#endif
+            default:
+                failed_ = true;
+                return;
+        }
+    }
+
+    bool compress(bool end) {
+        switch (type_) {
+#ifdef XQ_HAVE_ZSTD
+            case CompressType::ZSTD: {
+                ZSTD_inBuffer in{window_, used_, 0};
+                auto mode = end ? ZSTD_e_end : ZSTD_e_continue;
+                while (true) {
+                    void* data;
+                    int size;
+                    output_->Next(&data, &size);
+                    ZSTD_outBuffer out{data, size_t(size), 0};
+                    auto remaining = ZSTD_compressStream2(context_.zstd_cctx, &out, &in, mode);
+                    output_->BackUp(size - out.pos);
+                    if (ZSTD_isError(remaining)) {
+                        error("zstd compress failed: {}", ZSTD_getErrorName(remaining));
+                        failed_ = true;
+                        break;
+                    }
+                    if (end ? remaining == 0 : in.pos == in.size) {
+                        break;
+                    }
+                }
+                break;
+            }
+#endif
+#ifdef XQ_HAVE_LZ4
+            case CompressType::LZ4: {
+                auto& staging = context_.lz4_staging;
+                auto n = LZ4F_compressUpdate(context_.lz4_cctx, staging.data(), staging.size(),
+                                             window_, used_, nullptr);
+                if (lz4_flush(n) && end) {
+                    n = LZ4F_compressEnd(context_.lz4_cctx, staging.data(), staging.size(), nullptr);
+                    lz4_flush(n);
+                }
+                break;
+            }
+#endif
+            default:
+                failed_ = true;
+                break;
+        }
+        consumed_ += used_;
+        used_ = 0;
+        return !failed_;
+    }
+
+#ifdef XQ_HAVE_LZ4
+    bool lz4_flush(size_t n) {
+        if (LZ4F_isError(n)) {
+            error("lz4 compress failed: {}", LZ4F_getErrorName(n));
+            failed_ = true;
+            return false;
+        }
+        output_->append(context_.lz4_staging.data(), n);
+        return true;
+    }
+#endif
+
+    util::NetOutputStream* output_;
+    CompressType type_;
+    CodecContext& context_;
+    uint8_t* window_;
+    size_t used_ = 0;
+    int64_t consumed_ = 0;
+    bool failed_ = false;
+};
+
+// decompresses input into the window as the parser asks for more
+class DecompressInputStream : public google::protobuf::io::ZeroCopyInputStream {
+public:
+    DecompressInputStream(google::protobuf::io::ZeroCopyInputStream* input, CompressType type)
+        : input_(input), type_(type), context_(CodecContext::get()),
+          window_(context_.decompress_window.get()) {
+        switch (type_) {
+#ifdef XQ_HAVE_ZSTD
+            case CompressType::ZSTD:
+                ZSTD_DCtx_reset(context_.zstd_dctx, ZSTD_reset_session_only);
+                break;
+#endif
+#ifdef XQ_HAVE_LZ4
+            case CompressType::LZ4:
+                LZ4F_resetDecompressionContext(context_.lz4_dctx);
+                break;
+#endif
+            default:
+                failed_ = true;
+                break;
+        }
+    }
+
+    // hand back the compressed bytes we took but did not use
+    ~DecompressInputStream() override {
+        if (in_pos_ < in_size_) {
+            input_->BackUp(in_size_ - in_pos_);
+        }
+    }
+
+    bool Next(const void** data, int* size) override {
+        if (backed_up_ == 0 && !fill()) {
+            return false;
+        }
+        int offset = backed_up_ > 0 ? filled_ - backed_up_ : 0;
+        *data = window_ + offset;
+        *size = filled_ - offset;
+        backed_up_ = 0;
+        return true;
+    }
+
+    void BackUp(int count) override {
+        backed_up_ = count;
+    }
+
+    bool Skip(int count) override {
+        const void* data;
+        int size;
+        while (count > 0 && Next(&data, &size)) {
+            if (size > count) {
+                BackUp(size - count);
+                return true;
+            }
+            count -= size;
+        }
+        return count == 0;
+    }
+
+    int64_t ByteCount() const override {
+        return produced_ - backed_up_;
+    }
+
+    // the compressed frame ended cleanly
+    bool finished() const { return frame_done_ && !failed_; }
+
+private:
+    // decompress the next piece into the window, false at the end or on errors
+    bool fill() {
+        filled_ = 0;
+        while (filled_ == 0 && !frame_done_ && !failed_) {
+            // a full window may leave output buffered in the codec, drain it
+            // before asking for more input
+            if (in_pos_ == in_size_ && !window_was_full_) {
+                const void* data;
+                if (!input_->Next(&data, &in_size_)) {
+                    // truncated
+                    in_size_ = 0;
+                    failed_ = true;
+                    break;
+                }
+                in_ = static_cast<const uint8_t*>(data);
+                in_pos_ = 0;
+            }
+            decompress();
+            window_was_full_ = size_t(filled_) == kWindowSize;
+        }
+        produced_ += filled_;
+        return filled_ > 0;
+    }
+
+    void decompress() {
+        switch (type_) {
+#ifdef XQ_HAVE_ZSTD
+            case CompressType::ZSTD: {
+                ZSTD_inBuffer in{in_ + in_pos_, size_t(in_size_ - in_pos_), 0};
+                ZSTD_outBuffer out{window_, kWindowSize, 0};
+                auto ret = ZSTD_decompressStream(context_.zstd_dctx, &out, &in);
+                if (ZSTD_isError(ret)) {
+                    warn("zstd decompress failed: {}", ZSTD_getErrorName(ret));
+                    failed_ = true;
+                    return;
+                }
+                in_pos_ += in.pos;
+                filled_ = out.pos;
+                frame_done_ = ret == 0;
+                return;
+            }
+#endif
+#ifdef XQ_HAVE_LZ4
+            case CompressType::LZ4: {
+                size_t out_size = kWindowSize;
+                size_t in_size = in_size_ - in_pos_;
+                auto ret = LZ4F_decompress(context_.lz4_dctx, window_, &out_size,
+                                           in_ + in_pos_, &in_size, nullptr);
+                if (LZ4F_isError(ret)) {
+                    warn("lz4 decompress failed: {}", LZ4F_getErrorName(ret));
+                    failed_ = true;
+                    return;
+                }
+                in_pos_ += in_size;
+                filled_ = out_size;
+                frame_done_ = ret == 0;
+                return;
+            }
+#endif
+            default:
+                failed_ = true;
+                return;
+        }
+    }
+
+    google::protobuf::io::ZeroCopyInputStream* input_;
+    CompressType type_;
+    CodecContext& context_;
+    uint8_t* window_;
+
+    // compressed bytes from the last input_->Next()
+    const uint8_t* in_ = nullptr;
+    int in_size_ = 0;
+    int in_pos_ = 0;
+
+    int filled_ = 0;
+    int backed_up_ = 0;
+    int64_t produced_ = 0;
+    bool window_was_full_ = false;
+    bool frame_done_ = false;
+    bool failed_ = false;
+};
+
+} // namespace
+
+uint32_t supported_compress() {
+    uint32_t mask = 0;
+#ifdef XQ_HAVE_LZ4
+    mask |= 1u << static_cast<int>(CompressType::LZ4);
+#endif
+#ifdef XQ_HAVE_ZSTD
+    mask |= 1u << static_cast<int>(CompressType::ZSTD);
+#endif
+    return mask;
+}
+
+CompressType CompressOptions::for_method(const std::string& service_name,
+                                         const std::string& method_name) const {
+    if (!methods.empty()) {
+        auto iter = methods.find(service_name + "/" + method_name);
+        if (iter != methods.end()) {
+            return iter->second;
+        }
+    }
+    return type;
+}
+
+CompressType negotiate(CompressType type, size_t bytes, size_t min_bytes, uint32_t peer_compress) {
+    if (type == CompressType::NONE || bytes < min_bytes) {
+        return CompressType::NONE;
+    }
+    auto bit = 1u << static_cast<int>(type);
+    return (supported_compress() & peer_compress & bit) ? type : CompressType::NONE;
+}
+
+void advertise_compress(net::Connection* conn, proto::Header* header) {
+    if (conn->take_compress_advert()) {
+        header->set_accept_compress(supported_compress());
+    }
+}
+
+void learn_compress(net::Connection* conn, const proto::Header& header) {
+    if (header.accept_compress() != 0) {
+        conn->set_peer_compress(header.accept_compress());
+    }
+}
+
+// serialize message with the sizes cached by its last ByteSizeLong()
+static bool serialize_cached(const google::protobuf::Message& message,
+                             google::protobuf::io::ZeroCopyOutputStream* output) {
+    google::protobuf::io::CodedOutputStream coded(output);
+    message.SerializeWithCachedSizes(&coded);
+    coded.Trim();
+    return !coded.HadError();
+}
+
+void append_header(util::NetOutputStream* output, const proto::Header& header) {
+    uint32_t header_len = header.ByteSizeLong();
+    output->append(&header_len, sizeof(header_len));
+    append_message(output, header, header_len);
+}
+
+void append_message(util::NetOutputStream* output, const google::protobuf::Message& message,
+                    size_t size) {
+    if (auto region = output->append_region(size)) {
+        message.SerializeWithCachedSizesToArray(region);
+        return;
+    }
+    serialize_cached(message, output);
+}
+
+uint32_t append_body(util::NetOutputStream* output, const google::protobuf::Message& message,
+                     size_t size, CompressType type) {
+    if (type == CompressType::NONE) {
+        uint32_t body_len = size;
+        output->append(&body_len, sizeof(body_len));
+        append_message(output, message, size);
+        return body_len;
+    }
+    auto slot = output->reserve_uint32();
+    CompressOutputStream compressor(output, type, size);
+    // a failed compressor leaves a corrupt body, which fails this call only
+    if (!serialize_cached(message, &compressor) || !compressor.finish()) {
+        error("failed to compress a body of {} bytes", size);
+    }
+    return output->patch_length(slot);
+}
+
+uint32_t append_body(util::NetOutputStream* output, const void* data, size_t size, CompressType type) {
+    if (type == CompressType::NONE) {
+        uint32_t body_len = size;
+        output->append(&body_len, sizeof(body_len));
+        output->append(data, size);
+        return body_len;
+    }
+    auto slot = output->reserve_uint32();
+    CompressOutputStream compressor(output, type, size);
+    bool ok;
+    {
+        google::protobuf::io::CodedOutputStream coded(&compressor);
+        coded.WriteRaw(data, size);
+        ok = !coded.HadError();
+    }
+    if (!ok || !compressor.finish()) {
+        error("failed to compress a body of {} bytes", size);
+    }
+    return output->patch_length(slot);
+}
+
+bool parse_compressed(google::protobuf::Message* message,
+                      google::protobuf::io::ZeroCopyInputStream* input,
+                      uint32_t len, CompressType type) {
+    google::protobuf::io::LimitingInputStream limited(input, len);
+    bool ok;
+    {
+        DecompressInputStream decompressor(&limited, type);
+        ok = message->ParseFromZeroCopyStream(&decompressor) && decompressor.finished();
+    }
+    // bytes after the end of the compressed frame are garbage too
+    auto left = int64_t(len) - limited.ByteCount();
+    if (left > 0) {
+        limited.Skip(left);
+        ok = false;
+    }
+    return ok;
+}
+
+} // namespace xuanqiong
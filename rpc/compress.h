@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <google/protobuf/message.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+
+#include "util/output_stream.h"
+
+namespace xuanqiong {
+
+namespace net {
+class Connection;
+}
+namespace proto {
+class Header;
+}
+
+// body compression, same values as proto::CompressType
+enum class CompressType : int32_t {
+    NONE = 0,
+    LZ4 = 1,
+    ZSTD = 2,
+};
+
+// algorithms this build encodes and decodes, bit 1 << CompressType each.
+// lz4 and zstd are optional at build time
+uint32_t supported_compress();
+
+// which bodies one side compresses
+struct CompressOptions {
+    // for every method not listed in methods
+    CompressType type = CompressType::NONE;
+    // "service/method" -> algorithm, NONE turns it off for one method
+    std::unordered_map<std::string, CompressType> methods;
+    // smaller bodies are not worth the cpu
+    size_t min_bytes = 4096;
+
+    CompressType for_method(const std::string& service_name, const std::string& method_name) const;
+};
+
+// type if a body of bytes is worth compressing and both this build and the
+// peer, whose accept_compress mask is peer_compress, support it. NONE otherwise
+CompressType negotiate(CompressType type, size_t bytes, size_t min_bytes, uint32_t peer_compress);
+
+// advertise our algorithms on the first frame sent on conn
+void advertise_compress(net::Connection* conn, proto::Header* header);
+// remember the algorithms the peer advertised, if header carries them
+void learn_compress(net::Connection* conn, const proto::Header& header);
+
+// append header_len and header
+void append_header(util::NetOutputStream* output, const proto::Header& header);
+// append message, whose sizes were cached by a ByteSizeLong() of size, without
+// walking it for them again. in place in the current block when it fits
+void append_message(util::NetOutputStream* output, const google::protobuf::Message& message,
+                    size_t size);
+
+// append body_len and message, whose ByteSizeLong() is size, encoded with
+// type. compressed bodies stream from the serializer through the compressor
+// into the output blocks and body_len is patched afterwards.
+// returns the body length on the wire
+uint32_t append_body(util::NetOutputStream* output, const google::protobuf::Message& message,
+                     size_t size, CompressType type);
+// the same for a body serialized beforehand into size bytes at data
+uint32_t append_body(util::NetOutputStream* output, const void* data, size_t size, CompressType type);
+
+// parse a body of len bytes compressed with type, decompressing in windows
+// on the way to the parser. exactly len bytes of input are consumed, also on
+// failure, so the stream stays at the next frame boundary
+bool parse_compressed(google::protobuf::Message* message,
+                      google::protobuf::io::ZeroCopyInputStream* input,
+                      uint32_t len, CompressType type);
+
+} // namespace xuanqiong
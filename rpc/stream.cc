@@ -0,0 +1,203 @@
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include "rpc/stream.h"
+#include "net/connection.h"
+#include "proto/message.pb.h"
+#include "scheduler/scheduler.h"
+
+namespace xuanqiong {
+
+Stream::Stream(net::Connection* conn, int64_t id)
+    : conn_(conn), executor_(conn->executor()), id_(id) {}
+
+bool Stream::readable() const {
+    return !inbox_.empty() || remote_done_ || broken_;
+}
+
+bool Stream::writable() const {
+    return broken_ || local_done_ ||
+           (send_window_ > 0 && conn_->write_bytes() < kStreamHighWater);
+}
+
+bool Stream::pop(google::protobuf::Message* message) {
+    if (inbox_.empty()) {
+        return false;
+    }
+    auto [data, compress] = std::move(inbox_.front());
+    inbox_.pop_front();
+    // grant the bytes back once half of the window was consumed
+    unacked_ += data.size();
+    if (unacked_ >= kStreamWindow / 2 && !remote_done_ && !broken_) {
+        proto::Header header;
+        header.set_message_type(proto::MessageType::WINDOW_UPDATE);
+        header.set_window(unacked_);
+        append(header, nullptr);
+        unacked_ = 0;
+    }
+    if (compress == CompressType::NONE) {
+        return message->ParseFromString(data);
+    }
+    google::protobuf::io::ArrayInputStream input(data.data(), data.size());
+    return parse_compressed(message, &input, data.size(), compress);
+}
+
+bool Stream::push(const google::protobuf::Message& message) {
+    if (broken_ || local_done_) {
+        return false;
+    }
+    proto::Header header;
+    header.set_message_type(proto::MessageType::STREAM_DATA);
+    auto size = message.ByteSizeLong();
+    auto compress = negotiate(compress_, size, compress_min_bytes_, conn_->peer_compress());
+    header.set_compress(static_cast<proto::CompressType>(compress));
+    // the window counts bytes on the wire
+    send_window_ -= append(header, &message, size, compress);
+    return true;
+}
+
+void Stream::finish(int32_t status, const std::string& error_text) {
+    if (broken_ || local_done_) {
+        return;
+    }
+    local_done_ = true;
+    proto::Header header;
+    header.set_message_type(proto::MessageType::STREAM_END);
+    header.set_status(static_cast<proto::StatusCode>(status));
+    header.set_error_text(error_text);
+    append(header, nullptr);
+    if (status != proto::StatusCode::OK) {
+        // nothing the peer still sends is wanted
+        remote_done_ = true;
+        inbox_.clear();
+        wake(reader_);
+    }
+    wake(writer_);
+    check_done();
+}
+
+void Stream::on_data(util::NetInputStream* input_stream, uint32_t len, CompressType compress) {
+    std::string data;
+    {
+        google::protobuf::io::CodedInputStream coded(input_stream);
+        coded.ReadString(&data, len);
+    }
+    if (remote_done_ || broken_) {
+        return;
+    }
+    inbox_.emplace_back(std::move(data), compress);
+    wake(reader_);
+}
+
+void Stream::on_end(int32_t status, const std::string& error_text) {
+    if (remote_done_ || broken_) {
+        return;
+    }
+    remote_done_ = true;
+    status_ = status;
+    error_text_ = error_text;
+    if (status != proto::StatusCode::OK) {
+        // the peer aborted, our writes go nowhere
+        local_done_ = true;
+        wake(writer_);
+    }
+    wake(reader_);
+    check_done();
+}
+
+void Stream::on_window_update(uint32_t bytes) {
+    send_window_ += bytes;
+    on_output_drained();
+}
+
+void Stream::on_output_drained() {
+    if (writer_ && writable()) {
+        wake(writer_);
+    }
+}
+
+void Stream::reset(int32_t status, const std::string& error_text) {
+    if (broken_) {
+        return;
+    }
+    broken_ = true;
+    if (!remote_done_) {
+        status_ = status;
+        error_text_ = error_text;
+    }
+    local_done_ = true;
+    remote_done_ = true;
+    conn_ = nullptr;
+    wake(reader_);
+    wake(writer_);
+}
+
+uint32_t Stream::append(const proto::Header& header, const google::protobuf::Message* body,
+                        size_t body_size, CompressType compress) {
+    if (conn_->closed()) {
+        return 0;
+    }
+    auto output_stream = conn_->get_output_stream();
+    proto::Header frame_header = header;
+    frame_header.set_magic(MAGIC_NUM);
+    frame_header.set_version(VERSION);
+    frame_header.set_request_id(id_);
+    advertise_compress(conn_, &frame_header);
+    append_header(&output_stream, frame_header);
+    uint32_t body_len = 0;
+    if (body) {
+        body_len = append_body(&output_stream, *body, body_size, compress);
+    } else {
+        output_stream.append(&body_len, sizeof(body_len));
+    }
+    conn_->resume_write();
+    return body_len;
+}
+
+// resume from a task: frames arrive inside the receive loop, which must
+// not run the handler that may be waiting on them
+void Stream::wake(std::coroutine_handle<>& handle) {
+    if (!handle) {
+        return;
+    }
+    executor_->spawn([self = shared_from_this(), waiter = std::exchange(handle, {})]() {
+        Resumer::resume(waiter);
+    });
+}
+
+void Stream::check_done() {
+    if (!done() || !on_done) {
+        return;
+    }
+    // the owner may hold the last reference
+    auto self = shared_from_this();
+    auto callback = std::move(on_done);
+    on_done = nullptr;
+    callback(id_);
+}
+
+void dispatch_stream_frame(StreamMap& streams, const proto::Header& header,
+                           util::NetInputStream* input_stream, uint32_t len) {
+    auto iter = streams.find(header.request_id());
+    if (iter == streams.end()) {
+        input_stream->Skip(len);
+        return;
+    }
+    auto stream = iter->second;
+    switch (header.message_type()) {
+        case proto::MessageType::STREAM_DATA:
+            stream->on_data(input_stream, len, static_cast<CompressType>(header.compress()));
+            return;
+        case proto::MessageType::STREAM_END:
+            stream->on_end(header.status(), header.error_text());
+            break;
+        case proto::MessageType::WINDOW_UPDATE:
+            stream->on_window_update(header.window());
+            break;
+        default:
+            break;
+    }
+    input_stream->Skip(len);
+}
+
+} // namespace xuanqiong
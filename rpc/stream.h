@@ -0,0 +1,148 @@
+#pragma once
+
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <google/protobuf/message.h>
+
+#include "rpc/compress.h"
+#include "scheduler/awaitable.h"
+#include "util/common.h"
+#include "util/input_stream.h"
+
+namespace xuanqiong {
+
+class Executor;
+namespace net {
+class Connection;
+}
+namespace proto {
+class Header;
+}
+
+// bytes the peer may send on one stream before it has to be granted more
+constexpr static uint32_t kStreamWindow = 256 * 1024;
+// stream writers wait while this much output is queued on the connection,
+// so unary responses and other streams are not stuck behind a big one
+constexpr static size_t kStreamHighWater = 1024 * 1024;
+
+// one end of a streaming call, identified by the request id that opened it.
+// either end writes any number of messages and then finish()es its
+// direction, read() returns false once the peer finished.
+// only used on the executor of its connection, from a task or coroutine
+// running there
+class Stream : public std::enable_shared_from_this<Stream> {
+public:
+    Stream(net::Connection* conn, int64_t id);
+    ~Stream() = default;
+
+    int64_t id() const { return id_; }
+
+    struct ReadAwaiter {
+        Stream* stream;
+        google::protobuf::Message* message;
+
+        bool await_ready() const noexcept { return stream->readable(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept {
+            stream->reader_ = handle;
+            return Resumer::next();
+        }
+        bool await_resume() { return stream->pop(message); }
+    };
+
+    struct WriteAwaiter {
+        Stream* stream;
+        const google::protobuf::Message* message;
+
+        bool await_ready() const noexcept { return stream->writable(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept {
+            stream->writer_ = handle;
+            return Resumer::next();
+        }
+        bool await_resume() { return stream->push(*message); }
+    };
+
+    // co_await: the next message, false once the peer finished or the stream broke
+    ReadAwaiter read(google::protobuf::Message* message) { return {this, message}; }
+    // co_await: false if the stream broke. waits for window and output space
+    WriteAwaiter write(const google::protobuf::Message& message) { return {this, &message}; }
+    // end our direction. status is a proto::StatusCode, anything but OK
+    // aborts the stream for both ends
+    void finish(int32_t status = 0, const std::string& error_text = "");
+
+    // how the peer finished, valid once read() returned false
+    int32_t status() const { return status_; }
+    const std::string& error_text() const { return error_text_; }
+
+    // both directions finished
+    bool done() const { return local_done_ && remote_done_; }
+
+    // compress written messages of at least min_bytes with type, when the
+    // peer accepts it. set by the owner when the stream opens
+    void set_compress(CompressType type, size_t min_bytes) {
+        compress_ = type;
+        compress_min_bytes_ = min_bytes;
+    }
+
+    // frames from the connection's receive loop
+    void on_data(util::NetInputStream* input_stream, uint32_t len, CompressType compress);
+    void on_end(int32_t status, const std::string& error_text);
+    void on_window_update(uint32_t bytes);
+    // the connection's output fell, a blocked writer may go on
+    void on_output_drained();
+    // the connection is gone, pending and later calls fail
+    void reset(int32_t status, const std::string& error_text);
+
+    // runs once both directions finished, the owner drops the stream
+    std::function<void(int64_t)> on_done;
+
+private:
+    bool readable() const;
+    bool writable() const;
+    bool pop(google::protobuf::Message* message);
+    bool push(const google::protobuf::Message& message);
+
+    // returns the body length on the wire
+    uint32_t append(const proto::Header& header, const google::protobuf::Message* body,
+                    size_t body_size = 0, CompressType compress = CompressType::NONE);
+    void wake(std::coroutine_handle<>& handle);
+    void check_done();
+
+    net::Connection* conn_;
+    Executor* executor_;
+    int64_t id_;
+
+    // received bodies as they came off the wire
+    std::deque<std::pair<std::string, CompressType>> inbox_;
+    bool local_done_ = false;
+    bool remote_done_ = false;
+    bool broken_ = false;
+    int32_t status_ = 0;
+    std::string error_text_;
+
+    // bytes we may still send, and bytes read but not granted back yet
+    int64_t send_window_ = kStreamWindow;
+    uint32_t unacked_ = 0;
+
+    CompressType compress_ = CompressType::NONE;
+    size_t compress_min_bytes_ = 0;
+
+    std::coroutine_handle<> reader_;
+    std::coroutine_handle<> writer_;
+
+    DISALLOW_COPY_AND_ASSIGN(Stream);
+};
+
+// open streams of one connection by request id
+using StreamMap = std::unordered_map<int64_t, std::shared_ptr<Stream>>;
+
+// route a STREAM_DATA, STREAM_END or WINDOW_UPDATE frame whose len body bytes
+// are buffered. frames of unknown streams, e.g. one that was aborted, are dropped
+void dispatch_stream_frame(StreamMap& streams, const proto::Header& header,
+                           util::NetInputStream* input_stream, uint32_t len);
+
+} // namespace xuanqiong
@@ -10,27 +10,31 @@ bool RegisterReadAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept
     return false;
 }
 
-bool ReadAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
+std::coroutine_handle<> ReadAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
     if (conn->closed()) {
         // read EOF, connection close, destory coroutine
         auto executor = conn->executor();
         executor->add_event({EventType::DELETE, conn});
     }
-    return !conn->closed() && should_suspend;
+    if (conn->closed() || !should_suspend) {
+        return handle;
+    }
+    return Resumer::next();
 }
 
-void WriteAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
+std::coroutine_handle<> WriteAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
     conn->set_write_handle(handle.address());
-    auto executor = conn->executor();
-    executor->add_event({EventType::WRITE, conn});
+    conn->wait_writable();
+    return Resumer::next();
 }
 
 bool WaitWriteAwaiter::await_ready() const noexcept {
-    return conn->closed() || conn->write_bytes() > 0;
+    return conn->closed() || conn->write_due();
 }
 
-void WaitWriteAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
+std::coroutine_handle<> WaitWriteAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
     conn->set_write_handle(handle.address());
+    return Resumer::next();
 }
 
 } // namespace xuanqiong
@@ -3,6 +3,7 @@
 #include <coroutine>
 
 #include "scheduler/scheduler.h"
+#include "util/resumer.h"
 
 namespace xuanqiong {
 
@@ -10,6 +11,9 @@ namespace net {
 class Connection;
 }
 
+// lives in util so that net, which resumes coroutines, needs nothing of sched
+using util::Resumer;
+
 struct RegisterReadAwaiter {
     net::Connection* conn;
 
@@ -23,7 +27,7 @@ struct ReadAwaiter {
     bool should_suspend;
 
     bool await_ready() const noexcept { return false; }
-    bool await_suspend(std::coroutine_handle<> handle) noexcept;
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept;
     void await_resume() const noexcept {};
 };
 
@@ -33,7 +37,7 @@ struct WriteAwaiter {
     bool should_suspend;
 
     bool await_ready() const noexcept { return !should_suspend; }
-    void await_suspend(std::coroutine_handle<> handle) noexcept;
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept;
     void await_resume() const noexcept {}
 };
 
@@ -42,8 +46,15 @@ struct WaitWriteAwaiter {
     net::Connection* conn;
 
     bool await_ready() const noexcept;
-    void await_suspend(std::coroutine_handle<> handle) noexcept;
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept;
     void await_resume() const noexcept {};
 };
 
+// suspend until resumed by someone else, e.g. a paused reader
+struct YieldAwaiter {
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept { return Resumer::next(); }
+    void await_resume() const noexcept {}
+};
+
 } // namespace xuanqiong
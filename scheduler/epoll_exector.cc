@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "util/common.h"
+#include "util/histogram.h"
 #include "net/socket.h"
 #include "scheduler/scheduler.h"
 #include "net/poll_connection.h"
@@ -14,16 +15,16 @@
 
 namespace xuanqiong {
 
-EpollExecutor::EpollExecutor(int timeout) {
+EpollExecutor::EpollExecutor(const ExecutorOptions& options) : Executor(options) {
     epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
     if (epoll_fd_ == -1) {
-        error("epoll_create1 failed: %s", strerror(errno));
+        error("epoll_create1 failed: {}", strerror(errno));
     }
 
     int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
-    info("event_fd: {}", event_fd);
+    debug("event_fd: {}", event_fd);
     if (event_fd == -1) {
-        error("eventfd failed: %s", strerror(errno));
+        error("eventfd failed: {}", strerror(errno));
     }
     dummy_conn_ = std::make_unique<net::PollConnection>(event_fd, nullptr, true);
     // add event_fd to epoll
@@ -31,25 +32,60 @@ EpollExecutor::EpollExecutor(int timeout) {
     ev.data.ptr = dummy_conn_.get();
     ev.events = EPOLLIN | EPOLLET;
     if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd, &ev) == -1) {
-        error("epoll_ctl failed: %s", strerror(errno));
+        error("epoll_ctl failed: {}", strerror(errno));
     }
 
-    thread_ = std::make_unique<std::thread>([this, timeout]() {
+    thread_ = std::make_unique<std::thread>([this, timeout = options.timeout]() {
+        setup_thread();
+        struct epoll_event events[MAX_EVENTS];
+        int64_t mark = util::now_ns();
         while (!stop_) {
             Closure task;
             while (task_queue_.pop(task)) {
-                task();
+                Resumer::run(task);
             }
+            int64_t now = util::now_ns();
+            ExecutorLoad::add(load_.busy_ns, now - mark);
+            mark = now;
 
-            should_notify_.store(true, std::memory_order_release);
-            struct epoll_event events[MAX_EVENTS];
-            int nready = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout);
+            int nready = 0;
+            bool has_task = false;
+            if (spin_ns_ > 0) {
+                // poll without sleeping, spawn() skips the eventfd write
+                // while should_notify_ is false
+                int64_t deadline = mark + spin_ns_;
+                while ((nready = epoll_wait(epoll_fd_, events, MAX_EVENTS, 0)) == 0
+                        && !(has_task = task_queue_.pop(task)) && now < deadline) {
+                    now = util::now_ns();
+                }
+                now = util::now_ns();
+                ExecutorLoad::add(load_.spin_ns, now - mark);
+                mark = now;
+            }
+            if (nready == 0 && !has_task) {
+                should_notify_.store(true, std::memory_order_release);
+                // a spawn() which pushed before the store saw should_notify_
+                // false and did not write the eventfd, look once more
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                has_task = task_queue_.pop(task);
+                // the no-op of stop() may have been run by the drain above
+                if (!has_task && !stop_.load(std::memory_order_acquire)) {
+                    nready = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout);
+                    now = util::now_ns();
+                    ExecutorLoad::add(load_.idle_ns, now - mark);
+                    ExecutorLoad::add(load_.wakeups, 1);
+                    mark = now;
+                }
+            }
+            if (has_task) {
+                Resumer::run(task);
+            }
             if (nready == -1) {
-                error("epoll_wait failed: %s", strerror(errno));
+                error("epoll_wait failed: {}", strerror(errno));
                 continue;
             }
             for (int i = 0; i < nready; i++) {
-                auto conn = static_cast<net::PollConnection*>(events[i].data.ptr);
+                auto conn = static_cast<net::Connection*>(events[i].data.ptr);
                 if (!conn) {
                     error("conn is null");
                     continue;
@@ -63,10 +99,17 @@ EpollExecutor::EpollExecutor(int timeout) {
                 }
                 if (events[i].events & (EPOLLHUP | EPOLLRDHUP)) {
                     // handle error event
+                    if (conn->closed()) {
+                        continue;
+                    }
                     conn->close();
                     if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn->fd(), nullptr) == -1) {
                         error("epoll_ctl failed: {}", strerror(errno));
                     }
+                    // let both coroutines see the close and finish,
+                    // the read side may drop the last reference to conn
+                    conn->resume_write();
+                    conn->resume_read();
                     continue;
                 }
                 if (events[i].events & EPOLLOUT) {
@@ -82,7 +125,7 @@ EpollExecutor::EpollExecutor(int timeout) {
                 }
                 if (events[i].events & EPOLLIN) {
                     // handle read event
-                    conn->resume_read();
+                    conn->on_readable();
                 }
             }
         }
@@ -90,9 +133,7 @@ EpollExecutor::EpollExecutor(int timeout) {
 }
 
 EpollExecutor::~EpollExecutor() {
-    if (thread_ && thread_->joinable()) {
-        thread_->join();
-    }
+    join();
     if (epoll_fd_ != -1) {
         ::close(epoll_fd_);
         epoll_fd_ = -1;
@@ -100,7 +141,15 @@ EpollExecutor::~EpollExecutor() {
 }
 
 void EpollExecutor::stop() {
-    stop_ = true;
+    stop_.store(true, std::memory_order_release);
+    // a blocked wait returns for the no-op and the loop sees stop_
+    spawn([]() {});
+}
+
+void EpollExecutor::join() {
+    if (thread_ && thread_->joinable()) {
+        thread_->join();
+    }
 }
 
 bool EpollExecutor::spawn(Closure&& task) {
@@ -110,7 +159,7 @@ bool EpollExecutor::spawn(Closure&& task) {
     }
     // notify epoll to wake up to execute task
     bool expect = true;
-    if (should_notify_.compare_exchange_strong(expect, false, std::memory_order_release)) {
+    if (should_notify_.compare_exchange_strong(expect, false, std::memory_order_seq_cst)) {
         uint64_t val = 1;
         write(dummy_conn_->fd(), &val, sizeof(uint64_t));
     }
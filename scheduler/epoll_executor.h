@@ -15,14 +15,15 @@ class PollConnection;
 
 class EpollExecutor : public Executor {
 public:
-    // timeout: timeout in milliseconds
-    EpollExecutor(int timeout);
+    explicit EpollExecutor(const ExecutorOptions& options);
     ~EpollExecutor();
 
     bool add_event(const EventItem& event_item) override;
 
     void stop() override;
 
+    void join() override;
+
     bool spawn(Closure&& task) override;
 
 private:
@@ -36,7 +37,7 @@ private:
     // within a single thread, queue does not require lock
     std::unique_ptr<std::thread> thread_;
     int epoll_fd_;
-    bool stop_;
+    std::atomic<bool> stop_{false};
 
     DISALLOW_COPY_AND_ASSIGN(EpollExecutor);
 };
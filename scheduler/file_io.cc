@@ -0,0 +1,178 @@
+#include <condition_variable>
+#include <deque>
+#include <errno.h>
+#include <format>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "scheduler/file_io.h"
+#include "scheduler/scheduler.h"
+#include "scheduler/awaitable.h"
+#include "util/thread_util.h"
+
+namespace xuanqiong {
+
+// blocking file syscalls run here, a disk that stalls ties up at most
+// these threads instead of the executors
+constexpr static int kFileWorkers = 4;
+
+namespace {
+
+class FileWorkers {
+public:
+    static FileWorkers& instance() {
+        static FileWorkers workers;
+        return workers;
+    }
+
+    void push(FileOp* op) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ops_.push_back(op);
+        }
+        cond_.notify_one();
+    }
+
+private:
+    FileWorkers() {
+        for (int i = 0; i < kFileWorkers; ++i) {
+            threads_.emplace_back([this, i]() {
+                util::set_thread_name(std::format("xq-file-{}", i));
+                run();
+            });
+        }
+    }
+
+    ~FileWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void run() {
+        while (true) {
+            FileOp* op;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this]() { return stop_ || !ops_.empty(); });
+                if (ops_.empty()) {
+                    return;
+                }
+                op = ops_.front();
+                ops_.pop_front();
+            }
+            run_file_op(op);
+            // the coroutine is only resumed on its own executor. dropping
+            // the resume would leak it, so wait for room in the queue
+            while (!op->executor->spawn([op]() { Resumer::resume(op->handle); })) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<FileOp*> ops_;
+    std::vector<std::thread> threads_;
+    bool stop_ = false;
+};
+
+} // namespace
+
+void run_file_op(FileOp* op) {
+    int64_t ret = -1;
+    switch (op->kind) {
+        case FileOpKind::OPEN:
+            ret = ::open(op->path, op->flags, op->mode);
+            break;
+        case FileOpKind::READ:
+            ret = ::pread(op->fd, op->buf, op->len, op->offset);
+            break;
+        case FileOpKind::WRITE:
+            ret = ::pwrite(op->fd, op->buf, op->len, op->offset);
+            break;
+        case FileOpKind::FSYNC:
+            ret = ::fsync(op->fd);
+            break;
+        case FileOpKind::STATX:
+#ifdef __linux__
+            ret = ::statx(AT_FDCWD, op->path, AT_STATX_SYNC_AS_STAT, STATX_BASIC_STATS,
+                          static_cast<struct statx*>(op->statx_buf));
+#else
+            errno = ENOSYS;
+#endif
+            break;
+    }
+    op->result = ret < 0 ? -errno : ret;
+}
+
+void submit_to_file_workers(FileOp* op) {
+    FileWorkers::instance().push(op);
+}
+
+std::coroutine_handle<> FileAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
+    op.handle = handle;
+    op.executor = Executor::current();
+    if (!op.executor) {
+        // no executor to resume on, run it on the caller
+        run_file_op(&op);
+        return handle;
+    }
+    op.executor->submit_file_op(&op);
+    return Resumer::next();
+}
+
+FileAwaiter async_open(const char* path, int flags, mode_t mode) {
+    FileAwaiter awaiter{};
+    awaiter.op.kind = FileOpKind::OPEN;
+    awaiter.op.path = path;
+    awaiter.op.flags = flags | O_CLOEXEC;
+    awaiter.op.mode = mode;
+    return awaiter;
+}
+
+FileAwaiter async_pread(int fd, void* buf, size_t len, off_t offset) {
+    FileAwaiter awaiter{};
+    awaiter.op.kind = FileOpKind::READ;
+    awaiter.op.fd = fd;
+    awaiter.op.buf = buf;
+    awaiter.op.len = len;
+    awaiter.op.offset = offset;
+    return awaiter;
+}
+
+FileAwaiter async_pwrite(int fd, const void* buf, size_t len, off_t offset) {
+    FileAwaiter awaiter{};
+    awaiter.op.kind = FileOpKind::WRITE;
+    awaiter.op.fd = fd;
+    awaiter.op.buf = const_cast<void*>(buf);
+    awaiter.op.len = len;
+    awaiter.op.offset = offset;
+    return awaiter;
+}
+
+FileAwaiter async_fsync(int fd) {
+    FileAwaiter awaiter{};
+    awaiter.op.kind = FileOpKind::FSYNC;
+    awaiter.op.fd = fd;
+    return awaiter;
+}
+
+#ifdef __linux__
+FileAwaiter async_statx(const char* path, struct statx* buf) {
+    FileAwaiter awaiter{};
+    awaiter.op.kind = FileOpKind::STATX;
+    awaiter.op.path = path;
+    awaiter.op.statx_buf = buf;
+    return awaiter;
+}
+#endif
+
+} // namespace xuanqiong
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace xuanqiong {
+
+class Executor;
+
+enum struct FileOpKind : uint8_t {
+    OPEN,
+    READ,
+    WRITE,
+    FSYNC,
+    STATX,
+};
+
+// one file operation of a coroutine. the executor runs it on its io_uring,
+// or on the shared file workers, and resumes the coroutine on itself
+struct FileOp {
+    FileOpKind kind = FileOpKind::OPEN;
+    int fd = -1;
+    const char* path = nullptr;
+    int flags = 0;
+    mode_t mode = 0;
+    void* buf = nullptr;
+    size_t len = 0;
+    off_t offset = 0;
+    void* statx_buf = nullptr;      // struct statx*, linux only
+
+    Executor* executor = nullptr;
+    std::coroutine_handle<> handle;
+    // the syscall result, -errno on failure
+    int64_t result = 0;
+};
+
+// co_await returns FileOp::result. the operation lives in the awaiter,
+// the coroutine frame, so buf and path must outlive the co_await only
+struct FileAwaiter {
+    FileOp op;
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept;
+    int64_t await_resume() const noexcept { return op.result; }
+};
+
+// file operations for coroutines running on an executor. they never block
+// the executor thread: the fd, byte count or 0 is returned, -errno on error.
+// O_DIRECT works with buffers from util::DirectBuffer
+FileAwaiter async_open(const char* path, int flags, mode_t mode = 0);
+FileAwaiter async_pread(int fd, void* buf, size_t len, off_t offset);
+FileAwaiter async_pwrite(int fd, const void* buf, size_t len, off_t offset);
+FileAwaiter async_fsync(int fd);
+#ifdef __linux__
+// STATX_BASIC_STATS of path, relative paths are resolved against the cwd
+FileAwaiter async_statx(const char* path, struct statx* buf);
+#endif
+
+// run op blocking on the calling thread, fills in op->result
+void run_file_op(FileOp* op);
+
+// blocking file operations are handed to a few shared worker threads,
+// which spawn the resume back on the executor of the coroutine
+void submit_to_file_workers(FileOp* op);
+
+} // namespace xuanqiong
@@ -15,10 +15,11 @@ namespace xuanqiong {
 
 static constexpr int MAX_EVENTS = 1024;
 
-KqueueExecutor::KqueueExecutor(int timeout) : stop_(false) {
+KqueueExecutor::KqueueExecutor(const ExecutorOptions& options)
+    : Executor(options) {
     kq_fd_ = kqueue();
     if (kq_fd_ == -1) {
-        error("kqueue() failed: %s", strerror(errno));
+        error("kqueue() failed: {}", strerror(errno));
         return;
     }
 
@@ -26,16 +27,17 @@ KqueueExecutor::KqueueExecutor(int timeout) : stop_(false) {
     struct kevent user_event;
     EV_SET(&user_event, 1, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
     if (kevent(kq_fd_, &user_event, 1, nullptr, 0, nullptr) == -1) {
-        error("failed to add EVFILT_USER: %s", strerror(errno));
+        error("failed to add EVFILT_USER: {}", strerror(errno));
     }
 
-    thread_ = std::make_unique<std::thread>([this, timeout]() {
+    thread_ = std::make_unique<std::thread>([this, timeout = options.timeout]() {
+        setup_thread();
         std::vector<struct kevent> events(MAX_EVENTS);
         while (!stop_) {
             // Process pending tasks first
             Closure task;
             while (task_queue_.pop(task)) {
-                task();
+                Resumer::run(task);
             }
 
             struct timespec* timeout_ptr = nullptr;
@@ -51,7 +53,7 @@ KqueueExecutor::KqueueExecutor(int timeout) : stop_(false) {
             int nready = kevent(kq_fd_, nullptr, 0, events.data(), MAX_EVENTS, timeout_ptr);
             if (nready == -1) {
                 if (errno == EINTR) continue;
-                error("kevent wait failed: %s", strerror(errno));
+                error("kevent wait failed: {}", strerror(errno));
                 continue;
             }
 
@@ -72,7 +74,7 @@ KqueueExecutor::KqueueExecutor(int timeout) : stop_(false) {
                 }
 
                 if (ev.flags & EV_EOF) {
-                    info("conn fd=%d closed (EV_EOF)", conn->fd());
+                    debug("conn fd={} closed (EV_EOF)", conn->fd());
                     conn->close();
                     // Clean up filters
                     struct kevent del_ev[2];
@@ -98,9 +100,7 @@ KqueueExecutor::KqueueExecutor(int timeout) : stop_(false) {
 
 KqueueExecutor::~KqueueExecutor() {
     stop();
-    if (thread_ && thread_->joinable()) {
-        thread_->join();
-    }
+    join();
     if (kq_fd_ != -1) {
         ::close(kq_fd_);
         kq_fd_ = -1;
@@ -108,7 +108,7 @@ KqueueExecutor::~KqueueExecutor() {
 }
 
 void KqueueExecutor::stop() {
-    stop_ = true;
+    stop_.store(true, std::memory_order_release);
     if (kq_fd_ != -1) {
         // Trigger user event to wake up the loop
         struct kevent trigger;
@@ -117,6 +117,12 @@ void KqueueExecutor::stop() {
     }
 }
 
+void KqueueExecutor::join() {
+    if (thread_ && thread_->joinable()) {
+        thread_->join();
+    }
+}
+
 bool KqueueExecutor::spawn(Closure&& task) {
     if (!task_queue_.push(std::move(task))) {
         error("failed to push task to queue");
@@ -129,7 +135,7 @@ bool KqueueExecutor::spawn(Closure&& task) {
         struct kevent trigger;
         EV_SET(&trigger, 1, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
         if (kevent(kq_fd_, &trigger, 1, nullptr, 0, nullptr) == -1) {
-            error("failed to trigger EVFILT_USER: %s", strerror(errno));
+            error("failed to trigger EVFILT_USER: {}", strerror(errno));
             // Re-arm notify flag on failure so next spawn can try again
             should_notify_.store(true, std::memory_order_release);
             return false;
@@ -147,7 +153,7 @@ bool KqueueExecutor::add_event(const EventItem& event_item) {
             struct kevent ev;
             EV_SET(&ev, static_cast<uintptr_t>(fd), EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, udata);
             if (kevent(kq_fd_, &ev, 1, nullptr, 0, nullptr) == -1) {
-                error("kqueue add READ failed for fd=%d: %s", fd, strerror(errno));
+                error("kqueue add READ failed for fd={}: {}", fd, strerror(errno));
                 return false;
             }
             break;
@@ -156,13 +162,13 @@ bool KqueueExecutor::add_event(const EventItem& event_item) {
             struct kevent ev;
             EV_SET(&ev, static_cast<uintptr_t>(fd), EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, udata);
             if (kevent(kq_fd_, &ev, 1, nullptr, 0, nullptr) == -1) {
-                error("kqueue add WRITE failed for fd=%d: %s", fd, strerror(errno));
+                error("kqueue add WRITE failed for fd={}: {}", fd, strerror(errno));
                 return false;
             }
             break;
         }
         case EventType::DELETE: {
-            info("delete event for fd=%d", fd);
+            debug("delete event for fd={}", fd);
             struct kevent del_ev[2];
             EV_SET(&del_ev[0], static_cast<uintptr_t>(fd), EVFILT_READ,  EV_DELETE, 0, 0, nullptr);
             EV_SET(&del_ev[1], static_cast<uintptr_t>(fd), EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
@@ -170,7 +176,7 @@ bool KqueueExecutor::add_event(const EventItem& event_item) {
             break;
         }
         default:
-            error("Unsupported or invalid event type: %d", static_cast<int>(event_item.type));
+            error("Unsupported or invalid event type: {}", static_cast<int>(event_item.type));
             return false;
     }
     return true;
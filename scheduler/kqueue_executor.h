@@ -10,14 +10,15 @@ namespace xuanqiong {
 
 class KqueueExecutor : public Executor {
 public:
-    // timeout: timeout in milliseconds
-    KqueueExecutor(int timeout);
+    explicit KqueueExecutor(const ExecutorOptions& options);
     ~KqueueExecutor();
 
     bool add_event(const EventItem& event_item) override;
 
     void stop() override;
 
+    void join() override;
+
     bool spawn(Closure&& task) override;
 
 private:
@@ -26,7 +27,7 @@ private:
     std::unique_ptr<std::thread> thread_;
 
     int kq_fd_{-1};
-    bool stop_{false};
+    std::atomic<bool> stop_{false};
 
     DISALLOW_COPY_AND_ASSIGN(KqueueExecutor);
 };
@@ -1,4 +1,10 @@
+#include <algorithm>
+#include <format>
+
 #include "scheduler/scheduler.h"
+#include "scheduler/file_io.h"
+#include "scheduler/timer.h"
+#include "util/thread_util.h"
 #ifdef __APPLE__
 #include "scheduler/kqueue_executor.h"
 #else
@@ -8,21 +14,77 @@
 
 namespace xuanqiong {
 
+static thread_local Executor* current_executor = nullptr;
+
+Executor::Executor(const ExecutorOptions& options)
+    : spin_ns_(options.spin_us * 1000LL), id_(options.id), cpus_(options.cpus),
+      numa_node_(util::cpus_numa_node(options.cpus)) {}
+
+void Executor::setup_thread() {
+    current_executor = this;
+    util::set_thread_name(std::format("xq-exec-{}", id_));
+    if (!cpus_.empty()) {
+        util::set_thread_affinity(cpus_);
+    }
+}
+
+void Executor::submit_file_op(FileOp* op) {
+    submit_to_file_workers(op);
+}
+
+Executor* Executor::current() {
+    return current_executor;
+}
+
 Scheduler::Scheduler(const SchedulerOptions& options) {
-    switch (options.policy) {
-        case SchedPolicy::POLL_POLICY:
+    auto num_executors = std::max<size_t>(
+        std::max(options.num_executors, 1), options.executor_cpus.size());
+    for (size_t i = 0; i < num_executors; ++i) {
+        ExecutorOptions executor_options;
+        executor_options.id = static_cast<int>(i);
+        executor_options.timeout = options.timeout;
+        executor_options.spin_us = options.spin_us;
+        if (!options.executor_cpus.empty()) {
+            executor_options.cpus = options.executor_cpus[i % options.executor_cpus.size()];
+        }
+
+        std::unique_ptr<Executor> executor;
+        switch (options.policy) {
+            case SchedPolicy::POLL_POLICY:
 #ifdef __APPLE__
-        case SchedPolicy::URING_POLICY:
-            executor_ = std::make_unique<KqueueExecutor>(options.timeout);
-            break;
+            case SchedPolicy::URING_POLICY:
+                executor = std::make_unique<KqueueExecutor>(executor_options);
+                break;
 #else
-            executor_ = std::make_unique<EpollExecutor>(options.timeout);
-            break;
-        case SchedPolicy::URING_POLICY:
-            executor_ = std::make_unique<UringExecutor>(options.timeout);
-            break;
+                executor = std::make_unique<EpollExecutor>(executor_options);
+                break;
+            case SchedPolicy::URING_POLICY:
+                executor = std::make_unique<UringExecutor>(executor_options);
+                break;
 #endif
+        }
+        executors_.push_back(std::move(executor));
+    }
+}
+
+void Scheduler::stop() {
+    for (auto& executor : executors_) {
+        cancel_timers(executor.get());
+        executor->stop();
+    }
+}
+
+Executor* Scheduler::alloc_executor(int numa_node) {
+    auto start = next_executor_.fetch_add(1, std::memory_order_relaxed);
+    if (numa_node >= 0) {
+        for (size_t i = 0; i < executors_.size(); ++i) {
+            auto& executor = executors_[(start + i) % executors_.size()];
+            if (executor->numa_node() == numa_node) {
+                return executor.get();
+            }
+        }
     }
+    return executors_[start % executors_.size()].get();
 }
 
 } // namespace xuanqiong
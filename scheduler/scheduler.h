@@ -1,23 +1,29 @@
 #pragma once
 
+#include <atomic>
 #include <coroutine>
 #include <memory>
-#include <functional>
+#include <vector>
 
 #include "util/common.h"
+#include "util/closure.h"
 
 namespace xuanqiong {
 
 namespace net {
 class Connection;
 }
+struct FileOp;
 
-using Closure = std::function<void()>;
+// unit of work of an Executor, captures are stored inline in the task queue
+using Closure = util::Closure;
 
 enum struct EventType : uint8_t {
     READ,
     WRITE,
     DELETE,     // remove fd from scheduler
+    FILE,       // completion of a FileOp
+    SPLICE,     // a file region splice of a connection
     UNKNOWN,
 };
 
@@ -26,17 +32,71 @@ struct EventItem {
     net::Connection* conn;
 };
 
+struct ExecutorOptions {
+    int id = 0;
+    // timeout in milliseconds of one poll, -1 to block
+    int timeout = -1;
+    // cpus the executor thread is pinned to, empty to leave it unpinned
+    std::vector<int> cpus;
+    // poll for tasks and events this long before blocking, 0 to block at once
+    int spin_us = 0;
+};
+
+// where the time of an executor thread goes, only the executor writes
+struct ExecutorLoad {
+    std::atomic<uint64_t> busy_ns{0};   // running tasks and handling events
+    std::atomic<uint64_t> spin_ns{0};   // polling for work without blocking
+    std::atomic<uint64_t> idle_ns{0};   // blocked in the kernel
+    std::atomic<uint64_t> wakeups{0};   // blocking waits that returned
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
 // one Executor corresponds to one Thread, a group of Coroutines
 class Executor {
 public:
-    Executor() = default;
+    explicit Executor(const ExecutorOptions& options);
     virtual ~Executor() = default;
 
     virtual bool add_event(const EventItem& item) = 0;
 
+    // wakes the executor thread, which exits once it sees the flag
     virtual void stop() = 0;
 
+    // wait for the executor thread to exit, after stop()
+    virtual void join() = 0;
+
     virtual bool spawn(Closure&& task) = 0;
+
+    // start op and resume op->handle on this executor once it completes,
+    // by default blocking on the shared file workers. executor thread only
+    virtual void submit_file_op(FileOp* op);
+
+    // executor whose thread is calling, nullptr on other threads
+    static Executor* current();
+
+    // index of this executor in its scheduler
+    int id() const { return id_; }
+
+    // numa node of the pinned cpus, -1 if unpinned or unknown
+    int numa_node() const { return numa_node_; }
+
+    const ExecutorLoad& load() const { return load_; }
+
+protected:
+    // called first on the executor thread: names it xq-exec-<id> and pins
+    // it, so that memory it touches first is allocated on the local node
+    void setup_thread();
+
+    int64_t spin_ns_;
+    ExecutorLoad load_;
+
+private:
+    int id_;
+    std::vector<int> cpus_;
+    int numa_node_;
 };
 
 enum class SchedPolicy : uint8_t {
@@ -47,6 +107,12 @@ enum class SchedPolicy : uint8_t {
 struct SchedulerOptions {
     int timeout;
     SchedPolicy policy;
+    int num_executors = 1;
+    // see ExecutorOptions::spin_us
+    int spin_us = 0;
+    // cpus of executor i are executor_cpus[i % size()], empty to not pin.
+    // more cpu sets than num_executors start one executor per set
+    std::vector<std::vector<int>> executor_cpus;
     SchedulerOptions(int timeout = -1, SchedPolicy policy = SchedPolicy::POLL_POLICY)
         : timeout(timeout), policy(policy) {}
 };
@@ -57,14 +123,25 @@ public:
     Scheduler(const SchedulerOptions& options);
     ~Scheduler() = default;
 
-    void stop() {
-        executor_->stop();
+    // also drops the timers of the executors, see cancel_timers()
+    void stop();
+
+    void join() {
+        for (auto& executor : executors_) {
+            executor->join();
+        }
     }
 
-    Executor* alloc_executor() { return executor_.get(); }
+    // round robin, restricted to executors on numa_node if there are any
+    Executor* alloc_executor(int numa_node = -1);
+
+    size_t size() const { return executors_.size(); }
+
+    Executor* get_executor(size_t index) const { return executors_[index].get(); }
 
 private:
-    std::unique_ptr<Executor> executor_;
+    std::vector<std::unique_ptr<Executor>> executors_;
+    std::atomic<size_t> next_executor_{0};
 
     DISALLOW_COPY_AND_ASSIGN(Scheduler);
 };
@@ -1,25 +1,82 @@
 #pragma once
 
 #include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "util/frame_pool.h"
+#include "scheduler/awaitable.h"
 
 namespace xuanqiong {
 
+// coroutine which starts running when called. dropping the Task detaches
+// it, the frame is freed when the coroutine finishes. co_await on a Task
+// waits for it to finish, on the same executor, and then continues by
+// symmetric transfer instead of a nested resume.
+// frames come from the util::FramePool of the calling thread
 struct Task {
     struct promise_type {
         Task get_return_object() {
             return Task(std::coroutine_handle<promise_type>::from_promise(*this));
         }
         std::suspend_never initial_suspend() { return {}; }
-        std::suspend_never final_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                auto& promise = handle.promise();
+                if (promise.continuation) {
+                    return promise.continuation;
+                }
+                // nobody holds the Task any more
+                if (promise.detached) {
+                    handle.destroy();
+                }
+                return Resumer::next();
+            }
+            void await_resume() const noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
         void unhandled_exception() {
             std::terminate();
         }
         void return_void() {}
+
+        static void* operator new(size_t size) {
+            return util::FramePool::allocate(size);
+        }
+        static void operator delete(void* ptr, size_t size) noexcept {
+            util::FramePool::deallocate(ptr, size);
+        }
+
+        std::coroutine_handle<> continuation;   // the coroutine awaiting this one
+        bool detached = false;                  // the Task was dropped before it finished
     };
 
     using HandleType = std::coroutine_handle<promise_type>;
 
     Task(HandleType handle) : handle_(handle) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    ~Task() {
+        if (!handle_) {
+            return;
+        }
+        if (handle_.done()) {
+            handle_.destroy();
+        } else {
+            handle_.promise().detached = true;
+        }
+    }
+
+    bool done() const { return !handle_ || handle_.done(); }
+
+    bool await_ready() const noexcept { return done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept {
+        handle_.promise().continuation = handle;
+        return Resumer::next();
+    }
+    void await_resume() const noexcept {}
 
 private:
     HandleType handle_;
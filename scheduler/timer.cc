@@ -0,0 +1,118 @@
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "scheduler/timer.h"
+#include "util/histogram.h"
+#include "util/thread_util.h"
+
+namespace xuanqiong {
+
+// delay of a timer whose executor did not take it
+constexpr static int64_t kRetryNs = 1000000;
+
+namespace {
+
+class TimerThread {
+public:
+    static TimerThread& instance() {
+        static TimerThread timers;
+        return timers;
+    }
+
+    void push(int64_t due_ns, Executor* executor, Closure&& fn) {
+        bool earliest;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto iter = timers_.emplace(due_ns, Timer{executor, std::move(fn)});
+            earliest = iter == timers_.begin();
+        }
+        // a later timer does not move the wakeup
+        if (earliest) {
+            cond_.notify_one();
+        }
+    }
+
+    void cancel(Executor* executor) {
+        std::vector<Closure> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto iter = timers_.begin(); iter != timers_.end();) {
+                if (iter->second.executor == executor) {
+                    dropped.push_back(std::move(iter->second.fn));
+                    iter = timers_.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+        }
+        // destroyed unlocked, a capture may start another timer
+    }
+
+private:
+    struct Timer {
+        Executor* executor;
+        Closure fn;
+    };
+
+    TimerThread() {
+        thread_ = std::thread([this]() {
+            util::set_thread_name("xq-timer");
+            run();
+        });
+    }
+
+    ~TimerThread() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_) {
+            if (timers_.empty()) {
+                cond_.wait(lock);
+                continue;
+            }
+            auto wait_ns = timers_.begin()->first - util::now_ns();
+            if (wait_ns > 0) {
+                cond_.wait_for(lock, std::chrono::nanoseconds(wait_ns));
+                continue;
+            }
+            // handed over under the lock, cancel() returning means the
+            // executor is not touched any more
+            auto timer = timers_.extract(timers_.begin());
+            if (!timer.mapped().executor->spawn(std::move(timer.mapped().fn))) {
+                // fn is left in place by a failed spawn, try again shortly
+                timer.key() = util::now_ns() + kRetryNs;
+                timers_.insert(std::move(timer));
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    // by due time in util::now_ns() nanoseconds
+    std::multimap<int64_t, Timer> timers_;
+    std::thread thread_;
+    bool stop_ = false;
+};
+
+} // namespace
+
+void run_after(Executor* executor, int64_t delay_ns, Closure&& fn) {
+    TimerThread::instance().push(util::now_ns() + delay_ns, executor, std::move(fn));
+}
+
+void cancel_timers(Executor* executor) {
+    TimerThread::instance().cancel(executor);
+}
+
+} // namespace xuanqiong
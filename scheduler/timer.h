@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+#include "scheduler/scheduler.h"
+
+namespace xuanqiong {
+
+// spawn fn on executor once delay_ns passed. timers share one thread, which
+// only hands fn over, so fn runs like any other task of executor. a single
+// timer has no cancel: fn checks whether it still has work to do
+void run_after(Executor* executor, int64_t delay_ns, Closure&& fn);
+
+// drop the timers of executor which did not fire yet, without running
+// them. Scheduler::stop() calls it, so no timer reaches a freed executor
+void cancel_timers(Executor* executor);
+
+} // namespace xuanqiong
@@ -5,8 +5,10 @@
 #include <string.h>
 
 #include "util/common.h"
+#include "util/histogram.h"
 #include "net/socket.h"
 #include "scheduler/scheduler.h"
+#include "scheduler/file_io.h"
 #include "net/uring_connection.h"
 #include "scheduler/uring_executor.h"
 
@@ -14,31 +16,65 @@
 
 namespace xuanqiong {
 
-UringExecutor::UringExecutor(int timeout) {
-    io_uring_queue_init(MAX_RING_LEN, &uring_, 0);
-
+UringExecutor::UringExecutor(const ExecutorOptions& options) : Executor(options) {
     int event_fd = eventfd(0, EFD_CLOEXEC);
-    info("event_fd: {}", event_fd);
+    debug("event_fd: {}", event_fd);
     if (event_fd == -1) {
-        error("eventfd failed: %s", strerror(errno));
+        error("eventfd failed: {}", strerror(errno));
     }
 
     dummy_conn_ = std::make_unique<net::UringConnection>(event_fd, nullptr, true);
 
-    thread_ = std::make_unique<std::thread>([this, timeout]() {
+    thread_ = std::make_unique<std::thread>([this, timeout = options.timeout]() {
+        setup_thread();
+        // the rings are allocated on the numa node of the (pinned) caller.
+        // spawn() does not touch the ring before should_notify_ is first set
+        io_uring_queue_init(MAX_RING_LEN, &uring_, 0);
+        int64_t mark = util::now_ns();
         while (!stop_) {
             Closure task;
             while (task_queue_.pop(task)) {
-                task();
+                Resumer::run(task);
             }
 
             // info("submit num: {}", io_uring_sq_ready(&uring_));
             io_uring_submit(&uring_);
+            int64_t now = util::now_ns();
+            ExecutorLoad::add(load_.busy_ns, now - mark);
+            mark = now;
+
+            bool has_task = false;
+            if (spin_ns_ > 0) {
+                // poll the cq and the task queue without entering the kernel,
+                // spawn() skips the eventfd write while should_notify_ is false
+                int64_t deadline = mark + spin_ns_;
+                while (io_uring_cq_ready(&uring_) == 0
+                        && !(has_task = task_queue_.pop(task)) && now < deadline) {
+                    now = util::now_ns();
+                }
+                now = util::now_ns();
+                ExecutorLoad::add(load_.spin_ns, now - mark);
+                mark = now;
+            }
 
-            should_notify_.store(true, std::memory_order_release);
             io_uring_cqe* cqe;
-            if (io_uring_cq_ready(&uring_) == 0) {
-                io_uring_wait_cqe(&uring_, &cqe);
+            if (io_uring_cq_ready(&uring_) == 0 && !has_task) {
+                should_notify_.store(true, std::memory_order_release);
+                // a spawn() which pushed before the store saw should_notify_
+                // false and did not write the eventfd, look once more
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                has_task = task_queue_.pop(task);
+                // the no-op of stop() may have been run by the drain above
+                if (!has_task && !stop_.load(std::memory_order_acquire)) {
+                    io_uring_wait_cqe(&uring_, &cqe);
+                    now = util::now_ns();
+                    ExecutorLoad::add(load_.idle_ns, now - mark);
+                    ExecutorLoad::add(load_.wakeups, 1);
+                    mark = now;
+                }
+            }
+            if (has_task) {
+                Resumer::run(task);
             }
 
             // info("cq ready: {}", io_uring_cq_ready(&uring_));
@@ -46,6 +82,12 @@ UringExecutor::UringExecutor(int timeout) {
                 io_uring_cqe_seen(&uring_, cqe);
                 auto event_type = static_cast<EventType>(cqe->user_data >> 56);
                 auto conn_part = cqe->user_data & ((1ULL << 56) - 1);
+                if (event_type == EventType::FILE) {
+                    auto op = reinterpret_cast<FileOp*>(conn_part);
+                    op->result = cqe->res;
+                    Resumer::resume(op->handle);
+                    continue;
+                }
                 auto conn = reinterpret_cast<net::UringConnection*>(conn_part);
                 if (!conn) {
                     error("conn is null");
@@ -63,7 +105,7 @@ UringExecutor::UringExecutor(int timeout) {
                 if (event_type == EventType::READ) {
                     if (cqe->res == 0) {
                         conn->close();
-                        if (conn->back_left() == 0) {
+                        if (!conn->write_in_flight()) {
                             conn->resume_write();
                         }
                     } else {
@@ -73,6 +115,8 @@ UringExecutor::UringExecutor(int timeout) {
                 } else if (event_type == EventType::WRITE) {
                     conn->send_add(cqe->res);
                     conn->resume_write();
+                } else if (event_type == EventType::SPLICE) {
+                    conn->splice_done(cqe->res);
                 }
             }
         }
@@ -81,9 +125,7 @@ UringExecutor::UringExecutor(int timeout) {
 }
 
 UringExecutor::~UringExecutor() {
-    if (thread_ && thread_->joinable()) {
-        thread_->join();
-    }
+    join();
     io_uring_queue_exit(&uring_);
     if (epoll_fd_ != -1) {
         ::close(epoll_fd_);
@@ -92,7 +134,15 @@ UringExecutor::~UringExecutor() {
 }
 
 void UringExecutor::stop() {
-    stop_ = true;
+    stop_.store(true, std::memory_order_release);
+    // a blocked wait returns for the no-op and the loop sees stop_
+    spawn([]() {});
+}
+
+void UringExecutor::join() {
+    if (thread_ && thread_->joinable()) {
+        thread_->join();
+    }
 }
 
 bool UringExecutor::spawn(Closure&& task) {
@@ -102,7 +152,7 @@ bool UringExecutor::spawn(Closure&& task) {
     }
     // notify epoll to wake up to execute task
     bool expect = true;
-    if (should_notify_.compare_exchange_strong(expect, false, std::memory_order_release)) {
+    if (should_notify_.compare_exchange_strong(expect, false, std::memory_order_seq_cst)) {
         auto sqe = io_uring_get_sqe(&uring_);
         if (!sqe) {
             io_uring_submit(&uring_);
@@ -117,6 +167,39 @@ bool UringExecutor::spawn(Closure&& task) {
     return true;
 }
 
+void UringExecutor::submit_file_op(FileOp* op) {
+    auto sqe = io_uring_get_sqe(&uring_);
+    if (!sqe) {
+        io_uring_submit(&uring_);
+        sqe = io_uring_get_sqe(&uring_);
+    }
+    if (!sqe) {
+        // the ring is still full, block a worker thread instead
+        submit_to_file_workers(op);
+        return;
+    }
+    switch (op->kind) {
+        case FileOpKind::OPEN:
+            io_uring_prep_openat(sqe, AT_FDCWD, op->path, op->flags, op->mode);
+            break;
+        case FileOpKind::READ:
+            io_uring_prep_read(sqe, op->fd, op->buf, op->len, op->offset);
+            break;
+        case FileOpKind::WRITE:
+            io_uring_prep_write(sqe, op->fd, op->buf, op->len, op->offset);
+            break;
+        case FileOpKind::FSYNC:
+            io_uring_prep_fsync(sqe, op->fd, 0);
+            break;
+        case FileOpKind::STATX:
+            io_uring_prep_statx(sqe, AT_FDCWD, op->path, AT_STATX_SYNC_AS_STAT,
+                                STATX_BASIC_STATS, static_cast<struct statx*>(op->statx_buf));
+            break;
+    }
+    sqe->user_data =
+        (static_cast<uint64_t>(EventType::FILE) << 56) | reinterpret_cast<uint64_t>(op);
+}
+
 } // namespace xuanqiong
 
 #endif
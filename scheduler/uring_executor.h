@@ -16,8 +16,7 @@ class UringConnection;
 
 class UringExecutor : public Executor {
 public:
-    // timeout: timeout in milliseconds
-    UringExecutor(int timeout);
+    explicit UringExecutor(const ExecutorOptions& options);
     ~UringExecutor();
 
     bool add_event(const EventItem& event_item) override {
@@ -26,8 +25,13 @@ public:
 
     void stop() override;
 
+    void join() override;
+
     bool spawn(Closure&& task) override;
 
+    // prepares an sqe, submitted with the others of this loop iteration
+    void submit_file_op(FileOp* op) override;
+
     io_uring* uring() { return &uring_; }
 
 private:
@@ -43,7 +47,7 @@ private:
     // within a single thread, queue does not require lock
     std::unique_ptr<std::thread> thread_;
     int epoll_fd_;
-    bool stop_;
+    std::atomic<bool> stop_{false};
 
     DISALLOW_COPY_AND_ASSIGN(UringExecutor);
 };
@@ -1,60 +1,481 @@
 #include <string.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <deque>
+#include <thread>
 #include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 
 #include "util/common.h"
+#include "util/service.h"
 #include "proto/message.pb.h"
+#include "proto/stats.pb.h"
 #include "server/rpc_server.h"
+#include "server/stats_service.h"
 #include "net/socket_utils.h"
 #include "net/poll_connection.h"
 #ifdef __linux__
 #include "net/uring_connection.h"
+#include "net/shm_connection.h"
 #endif
 #include "scheduler/scheduler.h"
 #include "example/echo.pb.h"
 
 namespace xuanqiong {
 
+// far above any real header, a larger length means the stream is garbage
+constexpr static uint32_t kMaxHeaderLen = 64 * 1024;
+
+// the attachment after a request body. dropped when it goes out of scope,
+// unless a handler got it first
+struct PendingAttachment {
+    util::NetInputStream* input;
+    size_t size;
+
+    void take(util::Attachment* out) {
+        input->cut(std::exchange(size, 0), out);
+    }
+    ~PendingAttachment() {
+        if (size > 0) {
+            input->cut(size, nullptr);
+        }
+    }
+};
+
+// admission state of one connection, shared by its recv and send coroutines
+// and only touched on its executor
+struct RpcServer::ConnState {
+    util::ConcurrencyLimiter* limiter;
+    // admitted requests whose response is not written yet, oldest first:
+    // end offset of the response in the output stream, arrival time
+    std::deque<std::pair<uint64_t, int64_t>> unflushed;
+    // recv_fn is parked until the output drains
+    bool read_paused = false;
+    // open streams by request id
+    StreamMap streams;
+
+    explicit ConnState(util::ConcurrencyLimiter* limiter) : limiter(limiter) {}
+    ~ConnState() {
+        for (size_t i = 0; i < unflushed.size(); ++i) {
+            limiter->release(-1);
+        }
+    }
+};
+
+static std::vector<net::Endpoint> listen_endpoints(const RpcServerOptions& options) {
+    if (options.endpoints.empty()) {
+        return {net::Endpoint::any(options.port)};
+    }
+    std::vector<net::Endpoint> endpoints(options.endpoints.size());
+    for (size_t i = 0; i < endpoints.size(); ++i) {
+        if (!net::Endpoint::parse(options.endpoints[i], &endpoints[i])) {
+            error("invalid endpoint: {}", options.endpoints[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return endpoints;
+}
+
 RpcServer::RpcServer(const RpcServerOptions& options)
-    : options_(options), accepter_(options.port, options.backlog, options.nodelay) {
+    : options_(options) {
+    for (const auto& endpoint : listen_endpoints(options)) {
+        if (endpoint.is_shm() && options.sched_policy != SchedPolicy::POLL_POLICY) {
+            error("shm endpoint {} needs the poll policy", endpoint.to_string());
+            exit(EXIT_FAILURE);
+        }
+        accepters_.push_back(std::make_unique<net::Accepter>(
+            endpoint, options.backlog, options.nodelay, options.busy_poll_us, options.ipv6_only));
+    }
     auto sched_options = SchedulerOptions(options.poll_timeout, options.sched_policy);
+    sched_options.num_executors = options.num_executors;
+    sched_options.spin_us = options.spin_us;
+    sched_options.executor_cpus = options.executor_cpus;
     scheduler_ = std::make_unique<Scheduler>(sched_options);
+    stats_ = std::make_unique<ServerStats>(scheduler_->size());
+    if (!options.cache.methods.empty()) {
+        for (size_t i = 0; i < scheduler_->size(); ++i) {
+            caches_.push_back(std::make_unique<util::ResponseCache>(options.cache.max_bytes));
+        }
+    }
+    util::ConcurrencyLimiterOptions limiter_options;
+    limiter_options.max_limit = options.max_inflight;
+    limiter_options.adaptive = options.adaptive_concurrency;
+    limiter_ = std::make_unique<util::ConcurrencyLimiter>(limiter_options);
+    // a peer that resets the connection must not kill the process on write
+    signal(SIGPIPE, SIG_IGN);
+    if (options.enable_stats) {
+        stats_service_ = std::make_unique<StatsServiceImpl>(this);
+        register_service(Stats::descriptor()->full_name(), stats_service_.get());
+    }
+}
+
+RpcServer::~RpcServer() = default;
+
+void RpcServer::register_service(const std::string& service_name,
+                                 google::protobuf::Service* service) {
+    name2service_[service_name] = service;
+    auto descriptor = service->GetDescriptor();
+    for (int i = 0; i < descriptor->method_count(); ++i) {
+        auto method = descriptor->method(i);
+        stats_->add_method(method);
+        auto ttl = options_.cache.methods.find(service_name + "/" + method->name());
+        if (ttl != options_.cache.methods.end()) {
+            cache_ttl_ns_[method] = ttl->second * 1000000;
+        }
+    }
+}
+
+void RpcServer::register_stream(const std::string& service_name, const std::string& method_name,
+                                StreamHandler handler) {
+    name2stream_[service_name + "/" + method_name] = std::move(handler);
+}
+
+void RpcServer::collect_stats(bool include_connections, StatsResponse* response) {
+    stats_->collect(response);
+    for (size_t i = 0; i < scheduler_->size(); ++i) {
+        auto executor = scheduler_->get_executor(i);
+        const auto& load = executor->load();
+        auto entry = response->add_executors();
+        entry->set_id(executor->id());
+        entry->set_numa_node(executor->numa_node());
+        entry->set_busy_ns(load.busy_ns.load(std::memory_order_relaxed));
+        entry->set_spin_ns(load.spin_ns.load(std::memory_order_relaxed));
+        entry->set_idle_ns(load.idle_ns.load(std::memory_order_relaxed));
+        entry->set_wakeups(load.wakeups.load(std::memory_order_relaxed));
+    }
+    auto concurrency = response->mutable_concurrency();
+    concurrency->set_limit(limiter_->enabled() ? limiter_->limit() : 0);
+    concurrency->set_inflight(limiter_->inflight());
+    concurrency->set_rejected(limiter_->rejected());
+    concurrency->set_read_pauses(read_pauses_.load(std::memory_order_relaxed));
+    if (!caches_.empty()) {
+        auto cache = response->mutable_cache();
+        for (const auto& shard : caches_) {
+            const auto& stats = shard->stats();
+            cache->set_hits(cache->hits() + stats.hits.load(std::memory_order_relaxed));
+            cache->set_misses(cache->misses() + stats.misses.load(std::memory_order_relaxed));
+            cache->set_evictions(cache->evictions() + stats.evictions.load(std::memory_order_relaxed));
+            cache->set_expirations(cache->expirations() + stats.expirations.load(std::memory_order_relaxed));
+            cache->set_entries(cache->entries() + stats.entries.load(std::memory_order_relaxed));
+            cache->set_bytes(cache->bytes() + stats.bytes.load(std::memory_order_relaxed));
+        }
+    }
+    if (!include_connections) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(conns_mutex_);
+    for (const auto& [_, conn_entry] : conns_) {
+        auto conn = conn_entry.conn.lock();
+        if (!conn) {
+            continue;
+        }
+        const auto& conn_stats = conn->stats();
+        auto entry = response->add_connections();
+        entry->set_fd(conn->fd());
+        entry->set_peer(conn->socket()->peer().to_string());
+        entry->set_bytes_in(conn_stats.bytes_in.load(std::memory_order_relaxed));
+        entry->set_bytes_out(conn_stats.bytes_out.load(std::memory_order_relaxed));
+        entry->set_frames_in(conn_stats.frames_in.load(std::memory_order_relaxed));
+        entry->set_frames_out(conn_stats.frames_out.load(std::memory_order_relaxed));
+        entry->set_errors(conn_stats.errors.load(std::memory_order_relaxed));
+    }
 }
 
 void RpcServer::start() {
-    while (true) {
-        int connfd = accepter_.accept();
-        if (connfd == -1) {
-            // accept was interrupted by a signal — retry
+    std::vector<struct pollfd> pollfds;
+    for (const auto& accepter : accepters_) {
+        pollfds.push_back({accepter->fd(), POLLIN, 0});
+    }
+    while (!stopping_.load(std::memory_order_acquire)) {
+        // a single listener blocks in accept, several wait here first
+        if (pollfds.size() > 1 && ::poll(pollfds.data(), pollfds.size(), -1) == -1) {
             if (errno != EINTR) {
-                error("error occurred in accept: %s", strerror(errno));;
+                error("error occurred in poll: {}", strerror(errno));
             }
             continue;
         }
+        for (size_t i = 0; i < accepters_.size(); ++i) {
+            // shutdown wakes every listener at once
+            if (stopping_.load(std::memory_order_acquire)) {
+                break;
+            }
+            if (pollfds.size() > 1 && pollfds[i].revents == 0) {
+                continue;
+            }
+            accept(accepters_[i].get());
+        }
+    }
+}
+
+void RpcServer::accept(net::Accepter* accepter) {
+    net::Endpoint peer;
+    int connfd = accepter->accept(&peer);
+    if (connfd == -1) {
+        // interrupted by a signal, or the listener was closed by shutdown
+        if (errno != EINTR && errno != EAGAIN && !stopping_.load(std::memory_order_acquire)) {
+            error("error occurred in accept: {}", strerror(errno));
+        }
+        return;
+    }
+    // the listener address is the local one unless it is a wildcard
+    net::Endpoint local = accepter->endpoint();
+    if (local.is_wildcard()) {
+        struct sockaddr_storage addr;
+        socklen_t addr_len = sizeof(addr);
+        if (::getsockname(connfd, (struct sockaddr*)&addr, &addr_len) == 0) {
+            local = net::Endpoint((struct sockaddr*)&addr, addr_len);
+        }
+    }
 
-        // launch a coroutine
-        auto executor = scheduler_->alloc_executor();
+    // launch a coroutine, preferably on the numa node of the NIC
+    auto executor = scheduler_->alloc_executor(net::SocketUtils::numa_node(local));
 #ifdef __APPLE__
-        auto conn = std::make_shared<net::PollConnection>(connfd, executor);
+    auto conn = std::make_shared<net::PollConnection>(connfd, executor);
 #else
-        std::shared_ptr<net::Connection> conn;
-        if (options_.sched_policy == SchedPolicy::POLL_POLICY) {
-            conn = std::make_shared<net::PollConnection>(connfd, executor);
-        } else {
-            conn = std::make_shared<net::UringConnection>(connfd, executor);
-        }
+    std::shared_ptr<net::Connection> conn;
+    if (accepter->endpoint().is_shm()) {
+        conn = std::make_shared<net::ShmConnection>(connfd, executor);
+    } else if (options_.sched_policy == SchedPolicy::POLL_POLICY) {
+        conn = std::make_shared<net::PollConnection>(connfd, executor);
+    } else {
+        conn = std::make_shared<net::UringConnection>(connfd, executor);
+    }
 #endif
-        executor->spawn([this, conn]() { send_fn(conn); });
-        executor->spawn([this, conn]() { recv_fn(conn); });
+    // before the coroutines share the socket
+    conn->socket()->set_endpoints(local, peer);
+    auto state = std::make_shared<ConnState>(limiter_.get());
+    {
+        std::lock_guard<std::mutex> lock(conns_mutex_);
+        conns_[conn.get()] = {conn, state};
+    }
+    executor->spawn([this, conn, state]() { send_fn(conn, state); });
+    executor->spawn([this, conn, state]() { recv_fn(conn, state); });
+}
+
+// header-only frame, tells the client to send new calls elsewhere
+static void append_goaway(net::Connection* conn) {
+    auto output_stream = conn->get_output_stream();
+    proto::Header header;
+    header.set_magic(MAGIC_NUM);
+    header.set_version(VERSION);
+    header.set_message_type(proto::MessageType::GOAWAY);
+    append_header(&output_stream, header);
+    uint32_t body_len = 0;
+    output_stream.append(&body_len, sizeof(body_len));
+}
+
+// parse exactly len bytes into message. on failure the rest of them is
+// skipped, so the stream stays at the next frame boundary
+static bool parse_limited(google::protobuf::Message* message,
+                          util::NetInputStream* input_stream, uint32_t len) {
+    auto start = input_stream->ByteCount();
+    input_stream->push_limit(len);
+    bool ok = message->ParseFromZeroCopyStream(input_stream);
+    input_stream->pop_limit();
+    if (!ok) {
+        input_stream->Skip(len - (input_stream->ByteCount() - start));
+    }
+    return ok;
+}
+
+// header-only response carrying an error status
+static void append_status(net::Connection* conn, int64_t request_id,
+                          proto::StatusCode status, const std::string& error_text) {
+    auto output_stream = conn->get_output_stream();
+    proto::Header header;
+    header.set_magic(MAGIC_NUM);
+    header.set_version(VERSION);
+    header.set_message_type(proto::MessageType::RESPONSE);
+    header.set_request_id(request_id);
+    header.set_status(status);
+    header.set_error_text(error_text);
+    advertise_compress(conn, &header);
+    append_header(&output_stream, header);
+    uint32_t body_len = 0;
+    output_stream.append(&body_len, sizeof(body_len));
+}
+
+// header of a successful response, attachment_size bytes follow its body
+static void append_response_header(net::Connection* conn, util::NetOutputStream* output_stream,
+                                   int64_t request_id, CompressType compress, size_t attachment_size) {
+    proto::Header header;
+    header.set_magic(MAGIC_NUM);
+    header.set_version(VERSION);
+    header.set_message_type(proto::MessageType::RESPONSE);
+    header.set_request_id(request_id);
+    header.set_compress(static_cast<proto::CompressType>(compress));
+    advertise_compress(conn, &header);
+    header.set_attachment_size(attachment_size);
+    append_header(output_stream, header);
+}
+
+// method and body encoding ahead of the body, so equal keys mean equal calls
+constexpr static size_t kCacheKeyPrefix = sizeof(void*) + 1;
+
+// consume a request body of len bytes into the key of its cached response
+static std::string read_cache_key(const google::protobuf::MethodDescriptor* method,
+                                  CompressType compress, util::NetInputStream* input_stream,
+                                  uint32_t len) {
+    std::string key(kCacheKeyPrefix + len, '\0');
+    memcpy(key.data(), &method, sizeof(method));
+    key[sizeof(method)] = static_cast<char>(compress);
+    size_t pos = kCacheKeyPrefix;
+    const void* data;
+    int size;
+    input_stream->push_limit(len);
+    while (pos < key.size() && input_stream->Next(&data, &size)) {
+        memcpy(key.data() + pos, data, size);
+        pos += size;
+    }
+    input_stream->pop_limit();
+    return key;
+}
+
+ShutdownReport RpcServer::shutdown(std::chrono::milliseconds timeout) {
+    using Clock = std::chrono::steady_clock;
+    auto deadline = Clock::now() + timeout;
+    stopping_.store(true, std::memory_order_release);
+    for (auto& accepter : accepters_) {
+        accepter->close();
+    }
+
+    std::vector<std::shared_ptr<net::Connection>> conns;
+    std::vector<std::shared_ptr<ConnState>> states;
+    {
+        std::lock_guard<std::mutex> lock(conns_mutex_);
+        for (const auto& [_, entry] : conns_) {
+            auto conn = entry.conn.lock();
+            auto state = entry.state.lock();
+            if (conn && state) {
+                conns.push_back(std::move(conn));
+                states.push_back(std::move(state));
+            }
+        }
+    }
+
+    for (auto& conn : conns) {
+        conn->executor()->spawn([conn]() {
+            if (!conn->closed()) {
+                append_goaway(conn.get());
+                conn->resume_write();
+            }
+        });
+    }
+
+    // connection state is only touched on its executor, so every check runs
+    // there, one at a time per connection. a connection is idle when no
+    // request is partially received, no stream is open and every response
+    // reached the socket.
+    // closing it is a SHUT_RD, which the recv coroutine sees as EOF and
+    // exits through its usual path. past the deadline it is a SHUT_RDWR:
+    // the executor closes the connection and resumes both coroutines, so a
+    // send_fn waiting on a peer that does not read gives up too
+    struct DrainCounters {
+        std::atomic<size_t> drained{0};
+        std::atomic<size_t> dropped{0};
+        std::atomic<size_t> dropped_requests{0};
+        std::atomic<size_t> unflushed_bytes{0};
+    };
+    struct DrainState {
+        std::atomic<bool> closed{false};
+        // a check is queued on the executor and has not run yet
+        std::atomic<bool> checking{false};
+    };
+    DrainCounters counters;
+    std::vector<DrainState> drains(conns.size());
+    while (true) {
+        size_t pending = 0;
+        for (size_t i = 0; i < conns.size(); ++i) {
+            auto& drain = drains[i];
+            if (drain.closed.load(std::memory_order_acquire)) {
+                continue;
+            }
+            ++pending;
+            if (drain.checking.exchange(true, std::memory_order_acq_rel)) {
+                continue;
+            }
+            auto& conn = conns[i];
+            auto check = [conn, state = states[i], deadline, drain = &drain, c = &counters]() {
+                if (conn->closed()) {
+                    c->drained.fetch_add(1, std::memory_order_relaxed);
+                } else if (conn->read_bytes() == 0 && conn->write_bytes() == 0 &&
+                           state->streams.empty()) {
+                    c->drained.fetch_add(1, std::memory_order_relaxed);
+                    ::shutdown(conn->fd(), SHUT_RD);
+                } else if (Clock::now() >= deadline) {
+                    c->dropped.fetch_add(1, std::memory_order_relaxed);
+                    c->dropped_requests.fetch_add(conn->read_bytes() > 0, std::memory_order_relaxed);
+                    c->unflushed_bytes.fetch_add(conn->write_bytes(), std::memory_order_relaxed);
+                    ::shutdown(conn->fd(), SHUT_RDWR);
+                } else {
+                    drain->checking.store(false, std::memory_order_release);
+                    return;
+                }
+                drain->closed.store(true, std::memory_order_release);
+            };
+            if (!conn->executor()->spawn(std::move(check))) {
+                drain.checking.store(false, std::memory_order_release);
+            }
+        }
+        if (pending == 0) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // let the recv coroutines run to their end before the executors stop
+    auto grace = Clock::now() + std::chrono::milliseconds(100);
+    while (Clock::now() < grace) {
+        {
+            std::lock_guard<std::mutex> lock(conns_mutex_);
+            if (conns_.empty()) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
+    scheduler_->stop();
+    scheduler_->join();
+
+    ShutdownReport report;
+    report.connections = conns.size();
+    report.drained = counters.drained.load();
+    report.dropped = counters.dropped.load();
+    report.dropped_requests = counters.dropped_requests.load();
+    report.unflushed_bytes = counters.unflushed_bytes.load();
+    if (report.dropped > 0) {
+        warn("shutdown dropped {} of {} connections: {} partial requests, {} unflushed bytes",
+             report.dropped, report.connections, report.dropped_requests, report.unflushed_bytes);
+    }
+    info("shutdown done, {} connections drained", report.drained);
+    return report;
 }
 
 // coroutine function, one for each channel
-Task RpcServer::recv_fn(std::shared_ptr<net::Connection> conn) {
+Task RpcServer::recv_fn(std::shared_ptr<net::Connection> conn, std::shared_ptr<ConnState> state) {
     // register read event
     co_await RegisterReadAwaiter{conn.get()};
 
+    auto executor_id = conn->executor()->id();
+    auto& conn_stats = conn->stats();
+
+    auto max_pending = options_.max_pending_output_bytes;
+    RpcController controller;
     while (true) {
+        // the peer does not read its responses, stop reading its requests.
+        // send_fn resumes us once the output drained
+        if (max_pending > 0 && conn->write_bytes() > max_pending) {
+            read_pauses_.fetch_add(1, std::memory_order_relaxed);
+            while (conn->write_bytes() > max_pending && !conn->closed()) {
+                state->read_paused = true;
+                co_await YieldAwaiter{};
+                state->read_paused = false;
+            }
+        }
+
         // deserialize message
         auto input_stream = conn->get_input_stream();
 
@@ -72,6 +493,12 @@ Task RpcServer::recv_fn(std::shared_ptr<net::Connection> conn) {
             error("failed to read header len");
             break;
         }
+        // the stream is not ours or lost its framing, nothing to answer
+        if (header_len > kMaxHeaderLen) {
+            error("header len {} exceeds {}, closing", header_len, kMaxHeaderLen);
+            net::ConnStats::add(conn_stats.errors, 1);
+            break;
+        }
 
         // read header
         while (conn->read_bytes() < header_len && !conn->closed()) {
@@ -81,25 +508,15 @@ Task RpcServer::recv_fn(std::shared_ptr<net::Connection> conn) {
         if (conn->closed() && conn->read_bytes() < header_len) {
             break;
         }
+        // the frame is waiting since the read which completed its header
+        auto dispatch_ns = util::now_ns();
+        auto queue_wait_ns = dispatch_ns - conn->last_recv_ns();
         proto::Header header;
-        input_stream.push_limit(header_len);
-        if (!header.ParseFromZeroCopyStream(&input_stream)) {
-            error("failed to parse header");
-            break;
-        }
-        input_stream.pop_limit();
+        bool header_ok = parse_limited(&header, &input_stream, header_len);
+        auto header_parse_ns = util::now_ns() - dispatch_ns;
+        net::ConnStats::add(conn_stats.frames_in, 1);
         // info("header: {}", header.DebugString());
 
-        // check magic number && version
-        if (header.magic() != MAGIC_NUM) {
-            error("invalid magic number: 0x{:08x}", header.magic());
-            break;
-        }
-        if (header.version() != VERSION) {
-            error("invalid version: {}", header.version());
-            break;
-        }
-
          // deserialize request
          // fetch request len
         while (conn->read_bytes() < sizeof(uint32_t) && !conn->closed()) {
@@ -114,78 +531,291 @@ Task RpcServer::recv_fn(std::shared_ptr<net::Connection> conn) {
             break;
         }
 
+        // read request and its attachment
+        size_t attachment_size = header_ok ? header.attachment_size() : 0;
+        if (attachment_size > options_.max_attachment_bytes) {
+            error("attachment of {} bytes exceeds {}, closing",
+                  attachment_size, options_.max_attachment_bytes);
+            net::ConnStats::add(conn_stats.errors, 1);
+            break;
+        }
+        while (conn->read_bytes() < request_len + attachment_size && !conn->closed()) {
+            co_await conn->async_read();
+        }
+        if (conn->closed() && conn->read_bytes() < request_len + attachment_size) {
+            break;
+        }
+        // consumed after the body on every path below
+        PendingAttachment attachment{&input_stream, attachment_size};
+
+        // the frame is complete, from here on errors fail this request only
+        if (!header_ok) {
+            // no request id to answer to
+            warn("failed to parse header");
+            net::ConnStats::add(conn_stats.errors, 1);
+            input_stream.Skip(request_len);
+            continue;
+        }
+        learn_compress(conn.get(), header);
+        auto fail = [&](proto::StatusCode status, const std::string& error_text) {
+            warn("request {} failed: {}", header.request_id(), error_text);
+            net::ConnStats::add(conn_stats.errors, 1);
+            net::ConnStats::add(conn_stats.frames_out, 1);
+            append_status(conn.get(), header.request_id(), status, error_text);
+            conn->resume_write();
+        };
+
+        // check magic number && version
+        if (header.magic() != MAGIC_NUM || header.version() != VERSION) {
+            input_stream.Skip(request_len);
+            fail(proto::StatusCode::BAD_HEADER,
+                 std::format("invalid magic number 0x{:08x} or version {}", header.magic(), header.version()));
+            continue;
+        }
+
         const auto& service_name = header.service_name();
         const auto& method_name = header.method_name();
 
+        // frames of an open stream
+        auto message_type = header.message_type();
+        if (message_type == proto::MessageType::STREAM_DATA ||
+            message_type == proto::MessageType::STREAM_END ||
+            message_type == proto::MessageType::WINDOW_UPDATE) {
+            dispatch_stream_frame(state->streams, header, &input_stream, request_len);
+            continue;
+        }
+        if (header.stream()) {
+            input_stream.Skip(request_len);
+            auto handler = name2stream_.find(service_name + "/" + method_name);
+            if (handler == name2stream_.end()) {
+                fail(proto::StatusCode::UNKNOWN_METHOD,
+                     std::format("stream not found: {}/{}", service_name, method_name));
+                continue;
+            }
+            auto stream = std::make_shared<Stream>(conn.get(), header.request_id());
+            stream->set_compress(options_.compress.for_method(service_name, method_name),
+                                 options_.compress.min_bytes);
+            auto streams = &state->streams;
+            stream->on_done = [streams](int64_t id) { streams->erase(id); };
+            state->streams[header.request_id()] = stream;
+            // started from a task, the handler must not run inside recv_fn
+            conn->executor()->spawn([handler = &handler->second, stream]() { (*handler)(stream); });
+            continue;
+        }
+
         auto iter = name2service_.find(service_name);
         if (iter == name2service_.end()) {
-            error("service not found: {}", service_name);
-            break;
+            input_stream.Skip(request_len);
+            fail(proto::StatusCode::UNKNOWN_SERVICE, std::format("service not found: {}", service_name));
+            continue;
         }
         auto service = iter->second;
         auto method = service->GetDescriptor()->FindMethodByName(method_name);
         if (method == nullptr) {
-            error("method not found: {}", method_name);
-            break;
+            input_stream.Skip(request_len);
+            fail(proto::StatusCode::UNKNOWN_METHOD, std::format("method not found: {}", method_name));
+            continue;
+        }
+        auto method_stats = stats_->get(executor_id, method);
+        auto request_compress = static_cast<CompressType>(header.compress());
+        auto response_compress = [&](size_t response_len) {
+            auto compress = options_.compress.for_method(service_name, method_name);
+            if (compress == CompressType::NONE) {
+                // the client compresses, so it likely wants compressed answers
+                compress = request_compress;
+            }
+            return negotiate(compress, response_len, options_.compress.min_bytes,
+                             conn->peer_compress());
+        };
+
+        // the body of a cacheable request is its cache key, read up front
+        util::ResponseCache* cache = nullptr;
+        int64_t cache_ttl_ns = 0;
+        std::string cache_key;
+        int64_t key_ns = 0;
+        if (!caches_.empty() && attachment.size == 0) {
+            auto ttl = cache_ttl_ns_.find(method);
+            if (ttl != cache_ttl_ns_.end()) {
+                cache = caches_[executor_id].get();
+                cache_ttl_ns = ttl->second;
+                auto key_start_ns = util::now_ns();
+                cache_key = read_cache_key(method, request_compress, &input_stream, request_len);
+                key_ns = util::now_ns() - key_start_ns;
+            }
+        }
+        if (cache) {
+            auto lookup_ns = util::now_ns();
+            if (auto cached = cache->find(cache_key, lookup_ns)) {
+                // served without admission, a hit costs less than a rejection
+                auto output_stream = conn->get_output_stream();
+                auto compress = response_compress(cached->size());
+                append_response_header(conn.get(), &output_stream, header.request_id(), compress, 0);
+                append_body(&output_stream, cached->data(), cached->size(), compress);
+                auto done_ns = util::now_ns();
+                net::ConnStats::add(conn_stats.frames_out, 1);
+                MethodStats::add(method_stats->requests);
+                MethodStats::add(method_stats->cache_hits);
+                method_stats->queue_wait.record(queue_wait_ns);
+                method_stats->parse.record(header_parse_ns + key_ns);
+                method_stats->serialize.record(done_ns - lookup_ns);
+                conn->resume_write();
+                continue;
+            }
+        }
+
+        // admission control, reject before paying for the parse
+        if (!limiter_->try_acquire()) {
+            if (!cache) {
+                input_stream.Skip(request_len);
+            }
+            append_status(conn.get(), header.request_id(),
+                          proto::StatusCode::OVERLOADED, "server overloaded");
+            net::ConnStats::add(conn_stats.frames_out, 1);
+            MethodStats::add(method_stats->rejected);
+            conn->resume_write();
+            continue;
         }
 
         std::unique_ptr<google::protobuf::Message> request(service->GetRequestPrototype(method).New());
         std::unique_ptr<google::protobuf::Message> response(service->GetResponsePrototype(method).New());
 
-        // read request
-        while (conn->read_bytes() < request_len) {
-            co_await conn->async_read();
-        }
-        if (conn->closed() && conn->read_bytes() < request_len) {
-            break;
+        auto parse_start_ns = util::now_ns();
+        bool parsed;
+        if (cache) {
+            google::protobuf::io::ArrayInputStream body(cache_key.data() + kCacheKeyPrefix, request_len);
+            parsed = request_compress == CompressType::NONE
+                ? request->ParseFromZeroCopyStream(&body)
+                : parse_compressed(request.get(), &body, request_len, request_compress);
+        } else {
+            parsed = request_compress == CompressType::NONE
+                ? parse_limited(request.get(), &input_stream, request_len)
+                : parse_compressed(request.get(), &input_stream, request_len, request_compress);
         }
-        input_stream.push_limit(request_len);
-        if (!request->ParseFromZeroCopyStream(&input_stream)) {
-            error("failed to parse request");
-            break;
+        if (!parsed) {
+            MethodStats::add(method_stats->errors);
+            limiter_->release(-1);
+            fail(proto::StatusCode::BAD_REQUEST, "failed to parse request");
+            continue;
         }
-        input_stream.pop_limit();
         // info("request: {}", request->DebugString());
 
         // call method
-        service->CallMethod(method, nullptr, request.get(), response.get(), nullptr);
+        controller.Reset();
+        attachment.take(&controller.request_attachment());
+        auto handler_start_ns = util::now_ns();
+        service->CallMethod(method, &controller, request.get(), response.get(), nullptr);
+        auto serialize_start_ns = util::now_ns();
+        auto file = controller.take_response_file();
 
         // send response
-        auto output_stream = conn->get_output_stream();
-        // serialize header
-        proto::Header resp_header;
-        resp_header.set_magic(MAGIC_NUM);
-        resp_header.set_version(VERSION);
-        resp_header.set_message_type(proto::MessageType::RESPONSE);
-        resp_header.set_request_id(header.request_id());
-        uint32_t resp_header_len = resp_header.ByteSizeLong();
-        output_stream.append(&resp_header_len, sizeof(resp_header_len));
-        resp_header.SerializeToZeroCopyStream(&output_stream);
-
-        // serialize response
-        uint32_t response_len = response->ByteSizeLong();
-        output_stream.append(&response_len, sizeof(response_len));
-        response->SerializeToZeroCopyStream(&output_stream);
+        if (controller.Failed()) {
+            auto status = controller.ErrorCode() > 0
+                ? static_cast<proto::StatusCode>(controller.ErrorCode())
+                : proto::StatusCode::HANDLER_FAILED;
+            append_status(conn.get(), header.request_id(), status, controller.ErrorText());
+            MethodStats::add(method_stats->errors);
+        } else {
+            auto output_stream = conn->get_output_stream();
+            auto& resp_attachment = controller.response_attachment();
+            // a response to keep is serialized once, for the cache and the wire
+            bool keep = cache && resp_attachment.empty() && file.fd < 0;
+            std::string serialized;
+            if (keep) {
+                response->SerializeToString(&serialized);
+            }
+            size_t response_len = keep ? serialized.size() : response->ByteSizeLong();
+            auto compress = response_compress(response_len);
+
+            append_response_header(conn.get(), &output_stream, header.request_id(), compress,
+                                   resp_attachment.size() + (file.fd >= 0 ? file.len : 0));
+            // serialize response
+            if (keep) {
+                append_body(&output_stream, serialized.data(), serialized.size(), compress);
+                cache->insert(std::move(cache_key), std::move(serialized), util::now_ns(), cache_ttl_ns);
+            } else {
+                append_body(&output_stream, *response, response_len, compress);
+            }
+            output_stream.append(std::move(resp_attachment));
+            if (file.fd >= 0) {
+                // sent by the connection after the body, it closes the fd
+                conn->append_file(std::exchange(file, {}));
+            }
+        }
+        if (file.fd >= 0) {
+            ::close(file.fd);
+        }
+        auto done_ns = util::now_ns();
 
+        net::ConnStats::add(conn_stats.frames_out, 1);
+        MethodStats::add(method_stats->requests);
+        method_stats->queue_wait.record(queue_wait_ns);
+        method_stats->parse.record(header_parse_ns + key_ns + handler_start_ns - parse_start_ns);
+        method_stats->handler.record(serialize_start_ns - handler_start_ns);
+        method_stats->serialize.record(done_ns - serialize_start_ns);
+
+        if (limiter_->enabled()) {
+            // released by send_fn once the response is written
+            auto end_offset = conn_stats.bytes_out.load(std::memory_order_relaxed) + conn->write_bytes();
+            state->unflushed.emplace_back(end_offset, dispatch_ns - queue_wait_ns);
+        }
         conn->resume_write();
     }
 
     if (!conn->closed()) {
         conn->close();
     }
-    info(
-        "connection[{}] closed by peer: {}:{}",
-        conn->fd(), conn->socket()->peer_addr(), conn->socket()->peer_port()
+    for (auto& [_, stream] : state->streams) {
+        stream->reset(proto::StatusCode::UNAVAILABLE, "connection closed");
+    }
+    state->streams.clear();
+    {
+        std::lock_guard<std::mutex> lock(conns_mutex_);
+        conns_.erase(conn.get());
+    }
+    debug(
+        "connection[{}] closed by peer: {}",
+        conn->fd(), conn->socket()->peer().to_string()
     );
-    info("connection[{}] recv_fn done", conn->fd());
+    debug("connection[{}] recv_fn done", conn->fd());
 }
 
-Task RpcServer::send_fn(std::shared_ptr<net::Connection> conn) {
+Task RpcServer::send_fn(std::shared_ptr<net::Connection> conn, std::shared_ptr<ConnState> state) {
     while (!conn->closed()) {
         co_await WaitWriteAwaiter{conn.get()};
-        co_await conn->async_write();
+        auto awaiter = conn->async_write();
+        on_output_flushed(conn, state);
+        co_await awaiter;
+        on_output_flushed(conn, state);
+    }
+    // a paused recv_fn has to see the close to finish
+    on_output_flushed(conn, state);
+    debug("connection[{}] send_fn done", conn->fd());
+}
+
+void RpcServer::on_output_flushed(const std::shared_ptr<net::Connection>& conn,
+                                  const std::shared_ptr<ConnState>& state) {
+    if (!state->unflushed.empty()) {
+        auto written = conn->stats().bytes_out.load(std::memory_order_relaxed);
+        auto now = util::now_ns();
+        while (!state->unflushed.empty() && state->unflushed.front().first <= written) {
+            limiter_->release(now - state->unflushed.front().second);
+            state->unflushed.pop_front();
+        }
+    }
+    if (!state->streams.empty() && conn->write_bytes() < kStreamHighWater) {
+        for (auto& [_, stream] : state->streams) {
+            stream->on_output_drained();
+        }
+    }
+    // resume from a task, recv_fn may be the one running send_fn right now
+    if (state->read_paused &&
+        (conn->closed() || conn->write_bytes() <= options_.max_pending_output_bytes / 2)) {
+        conn->executor()->spawn([conn, state]() {
+            if (state->read_paused) {
+                conn->resume_read();
+            }
+        });
     }
-    info("connection[{}] send_fn done", conn->fd());
 }
 
 } // namespace xuanqiong
@@ -1,13 +1,23 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <vector>
 #include <exception>
+#include <functional>
 #include <google/protobuf/service.h>
 
 #include "net/accepter.h"
+#include "rpc/compress.h"
+#include "rpc/stream.h"
 #include "scheduler/task.h"
 #include "scheduler/awaitable.h"
+#include "server/server_stats.h"
+#include "util/concurrency_limiter.h"
+#include "util/response_cache.h"
 
 namespace xuanqiong {
 
@@ -15,12 +25,46 @@ namespace net {
 class Connection;
 }
 
+class StatsServiceImpl;
+
 struct RpcServerOptions {
     int port;
+    // addresses to listen on instead of port on every ipv4 interface, see
+    // net::Endpoint. "[::]:port" alone covers ipv4 and ipv6
+    std::vector<std::string> endpoints;
+    // ipv6 listeners refuse ipv4-mapped connections
+    bool ipv6_only = false;
     int backlog;
     int nodelay;
     int poll_timeout;
     SchedPolicy sched_policy;
+    // register the built-in xuanqiong.Stats service
+    bool enable_stats = true;
+    int num_executors = 1;
+    // see SchedulerOptions::spin_us
+    int spin_us = 0;
+    // SO_BUSY_POLL on accepted sockets in microseconds, 0 to leave it off
+    int busy_poll_us = 0;
+    // cpus to pin executor i to, see SchedulerOptions::executor_cpus
+    std::vector<std::vector<int>> executor_cpus;
+    // stop reading a connection while this many response bytes wait to be
+    // written, and resume once half of them are. 0 for no cap
+    size_t max_pending_output_bytes = 64 << 20;
+    // requests admitted but not yet answered, across all connections. the
+    // excess is rejected with OVERLOADED. 0 for no limit
+    int max_inflight = 0;
+    // adapt the in-flight limit to latency, up to max_inflight
+    bool adaptive_concurrency = false;
+    // larger request attachments close the connection, they are buffered
+    // whole before the handler runs
+    size_t max_attachment_bytes = 64 << 20;
+    // response and stream compression. without an algorithm for its method,
+    // a response to a compressed request is compressed like the request
+    CompressOptions compress;
+    // methods answered from a per-executor cache of serialized responses,
+    // keyed by the request body. hits skip admission control and the handler.
+    // requests with an attachment and responses with one are never cached
+    util::ResponseCacheOptions cache;
 
     RpcServerOptions(int port,
                      int backlog = 256,
@@ -30,29 +74,78 @@ struct RpcServerOptions {
         : port(port), backlog(backlog), nodelay(nodelay), poll_timeout(poll_timeout), sched_policy(policy) {}
 };
 
+// outcome of RpcServer::shutdown()
+struct ShutdownReport {
+    size_t connections = 0;         // open when the shutdown began
+    size_t drained = 0;             // closed with every response flushed
+    size_t dropped = 0;             // closed at the deadline with work left
+    size_t dropped_requests = 0;    // partially received requests on those
+    size_t unflushed_bytes = 0;     // response bytes never written
+};
+
+// serves one streaming call, runs on the executor of its connection
+using StreamHandler = std::function<Task(std::shared_ptr<Stream>)>;
+
 class RpcServer {
 public:
     RpcServer(const RpcServerOptions& options);
-    ~RpcServer() = default;
+    ~RpcServer();
 
-    void register_service(const std::string& service_name, google::protobuf::Service* service) {
-        name2service_[service_name] = service;
-    }
+    void register_service(const std::string& service_name, google::protobuf::Service* service);
+    // calls to service_name.method_name opened as streams go to handler
+    void register_stream(const std::string& service_name, const std::string& method_name,
+                         StreamHandler handler);
 
+    // accept loop, returns once shutdown() is called
     void start();
 
+    // stop accepting, send GOAWAY to every connection and close each one once
+    // its requests are answered and flushed. connections still busy after
+    // timeout are closed anyway. the executors are stopped and joined last
+    ShutdownReport shutdown(std::chrono::milliseconds timeout);
+
+    // merge per-executor method stats, optionally with per-connection counters
+    void collect_stats(bool include_connections, StatsResponse* response);
+
 private:
-    Task recv_fn(std::shared_ptr<net::Connection> conn);
-    Task send_fn(std::shared_ptr<net::Connection> conn);
+    struct ConnState;
+
+    // takes one connection from accepter and starts serving it
+    void accept(net::Accepter* accepter);
+    Task recv_fn(std::shared_ptr<net::Connection> conn, std::shared_ptr<ConnState> state);
+    Task send_fn(std::shared_ptr<net::Connection> conn, std::shared_ptr<ConnState> state);
+
+    void on_output_flushed(const std::shared_ptr<net::Connection>& conn,
+                           const std::shared_ptr<ConnState>& state);
 
     RpcServerOptions options_;
+    std::atomic<bool> stopping_{false};
 
     std::queue<std::shared_ptr<net::Connection>> send_queue_;
 
-    net::Accepter accepter_;
+    std::vector<std::unique_ptr<net::Accepter>> accepters_;
     std::unique_ptr<Scheduler> scheduler_;
 
     std::unordered_map<std::string, google::protobuf::Service*> name2service_;
+    // "service/method" -> handler
+    std::unordered_map<std::string, StreamHandler> name2stream_;
+
+    std::unique_ptr<ServerStats> stats_;
+    std::unique_ptr<util::ConcurrencyLimiter> limiter_;
+    // per executor, empty if no method is cached
+    std::vector<std::unique_ptr<util::ResponseCache>> caches_;
+    // cached methods -> time to live in nanoseconds
+    std::unordered_map<const google::protobuf::MethodDescriptor*, int64_t> cache_ttl_ns_;
+    std::atomic<uint64_t> read_pauses_{0};
+    std::unique_ptr<StatsServiceImpl> stats_service_;
+
+    // live connections, for the stats service and shutdown
+    struct ConnEntry {
+        std::weak_ptr<net::Connection> conn;
+        std::weak_ptr<ConnState> state;
+    };
+    std::mutex conns_mutex_;
+    std::unordered_map<net::Connection*, ConnEntry> conns_;
 
     RpcServer(const RpcServer&) = delete;
     RpcServer& operator=(const RpcServer&) = delete;
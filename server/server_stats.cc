@@ -0,0 +1,57 @@
+#include "proto/stats.pb.h"
+#include "server/server_stats.h"
+
+namespace xuanqiong {
+
+static void fill_latency(const util::HistogramSnapshot& snapshot, LatencyStats* latency) {
+    latency->set_count(snapshot.count());
+    latency->set_mean_ns(snapshot.mean());
+    latency->set_p50_ns(snapshot.percentile(0.5));
+    latency->set_p90_ns(snapshot.percentile(0.9));
+    latency->set_p99_ns(snapshot.percentile(0.99));
+    latency->set_p999_ns(snapshot.percentile(0.999));
+    latency->set_max_ns(snapshot.max());
+}
+
+void ServerStats::add_method(const google::protobuf::MethodDescriptor* method) {
+    if (method_index_.contains(method)) {
+        return;
+    }
+    method_index_[method] = methods_.size();
+    methods_.push_back(method);
+    for (auto& shard : shards_) {
+        shard.push_back(std::make_unique<MethodStats>());
+    }
+}
+
+void ServerStats::collect(StatsResponse* response) const {
+    for (size_t i = 0; i < methods_.size(); ++i) {
+        util::HistogramSnapshot queue_wait, parse, handler, serialize;
+        uint64_t requests = 0, errors = 0, rejected = 0, cache_hits = 0;
+        for (const auto& shard : shards_) {
+            const auto& stats = *shard[i];
+            queue_wait.merge(stats.queue_wait);
+            parse.merge(stats.parse);
+            handler.merge(stats.handler);
+            serialize.merge(stats.serialize);
+            requests += stats.requests.load(std::memory_order_relaxed);
+            errors += stats.errors.load(std::memory_order_relaxed);
+            rejected += stats.rejected.load(std::memory_order_relaxed);
+            cache_hits += stats.cache_hits.load(std::memory_order_relaxed);
+        }
+
+        auto entry = response->add_methods();
+        entry->set_service(methods_[i]->service()->full_name());
+        entry->set_method(methods_[i]->name());
+        entry->set_requests(requests);
+        entry->set_errors(errors);
+        entry->set_rejected(rejected);
+        entry->set_cache_hits(cache_hits);
+        fill_latency(queue_wait, entry->mutable_queue_wait());
+        fill_latency(parse, entry->mutable_parse());
+        fill_latency(handler, entry->mutable_handler());
+        fill_latency(serialize, entry->mutable_serialize());
+    }
+}
+
+} // namespace xuanqiong
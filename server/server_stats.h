@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <google/protobuf/descriptor.h>
+
+#include "util/common.h"
+#include "util/histogram.h"
+
+namespace xuanqiong {
+
+class StatsResponse;
+class LatencyStats;
+
+// latency and counters of one method on one executor,
+// only the owning executor thread writes
+struct MethodStats {
+    util::Histogram queue_wait;    // frame received -> dispatch
+    util::Histogram parse;         // header + request decode
+    util::Histogram handler;       // CallMethod
+    util::Histogram serialize;     // response encode
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> rejected{0};    // OVERLOADED, handler not run
+    std::atomic<uint64_t> cache_hits{0};  // answered from the response cache
+
+    static void add(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+// method stats sharded by executor, merged when collected
+class ServerStats {
+public:
+    ServerStats(size_t num_executors) : shards_(num_executors) {}
+    ~ServerStats() = default;
+
+    // must be called before the server starts
+    void add_method(const google::protobuf::MethodDescriptor* method);
+
+    MethodStats* get(int executor_id, const google::protobuf::MethodDescriptor* method) {
+        auto iter = method_index_.find(method);
+        if (iter == method_index_.end()) {
+            return nullptr;
+        }
+        return shards_[executor_id][iter->second].get();
+    }
+
+    void collect(StatsResponse* response) const;
+
+private:
+    std::unordered_map<const google::protobuf::MethodDescriptor*, size_t> method_index_;
+    std::vector<const google::protobuf::MethodDescriptor*> methods_;
+    // shards_[executor_id][method_index]
+    std::vector<std::vector<std::unique_ptr<MethodStats>>> shards_;
+
+    DISALLOW_COPY_AND_ASSIGN(ServerStats);
+};
+
+} // namespace xuanqiong
@@ -0,0 +1,16 @@
+#include "server/rpc_server.h"
+#include "server/stats_service.h"
+
+namespace xuanqiong {
+
+void StatsServiceImpl::GetStats(google::protobuf::RpcController* controller,
+                                const StatsRequest* request,
+                                StatsResponse* response,
+                                google::protobuf::Closure* done) {
+    server_->collect_stats(request->include_connections(), response);
+    if (done) {
+        done->Run();
+    }
+}
+
+} // namespace xuanqiong
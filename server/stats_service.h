@@ -0,0 +1,24 @@
+#pragma once
+
+#include "proto/stats.pb.h"
+
+namespace xuanqiong {
+
+class RpcServer;
+
+// built-in xuanqiong.Stats service, registered by RpcServer
+class StatsServiceImpl : public Stats {
+public:
+    StatsServiceImpl(RpcServer* server) : server_(server) {}
+    ~StatsServiceImpl() override = default;
+
+    void GetStats(google::protobuf::RpcController* controller,
+                  const StatsRequest* request,
+                  StatsResponse* response,
+                  google::protobuf::Closure* done) override;
+
+private:
+    RpcServer* server_;
+};
+
+} // namespace xuanqiong
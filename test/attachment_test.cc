@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+
+#include "util/attachment.h"
+#include "util/input_stream.h"
+#include "util/output_stream.h"
+
+using namespace xuanqiong::util;
+
+static std::string pattern(size_t size) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = 'a' + i % 26;
+    }
+    return data;
+}
+
+// as a connection receives, at most a block per read
+static void receive(InputBuffer* input, const std::string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        auto [buffer, max_size] = input->get_buffer();
+        size_t n = std::min<size_t>(max_size, data.size() - offset);
+        memcpy(buffer, data.data() + offset, n);
+        input->recv_add(n);
+        offset += n;
+    }
+}
+
+// the bytes a connection would write, consumed as it would
+static std::string send_all(OutputBuffer* output) {
+    std::string data;
+    while (output->bytes() > 0) {
+        auto iovs = output->get_iovecs(1000);
+        size_t n = 0;
+        for (const auto& iov : iovs) {
+            data.append(static_cast<const char*>(iov.iov_base), iov.iov_len);
+            n += iov.iov_len;
+        }
+        output->send_add(n);
+    }
+    return data;
+}
+
+TEST(AttachmentTest, AppendAcrossBlocks) {
+    Attachment attachment;
+    auto data = pattern(kBlockSize * 2 + 100);
+    attachment.append(data.data(), 10);
+    attachment.append(data.data() + 10, data.size() - 10);
+    EXPECT_EQ(attachment.size(), data.size());
+    EXPECT_EQ(attachment.to_string(), data);
+    size_t blocks = 0;
+    for (auto block = attachment.first_block(); block; block = block->next) {
+        ++blocks;
+    }
+    EXPECT_EQ(blocks, 3u);
+
+    Attachment moved(std::move(attachment));
+    EXPECT_TRUE(attachment.empty());
+    EXPECT_EQ(moved.size(), data.size());
+    moved.clear();
+    EXPECT_EQ(moved.to_string(), "");
+}
+
+TEST(AttachmentTest, CutMovesWholeBlocks) {
+    InputBuffer input;
+    auto data = pattern(kBlockSize * 4);
+    receive(&input, data);
+    NetInputStream stream(&input);
+
+    uint32_t prefix;
+    ASSERT_TRUE(stream.fetch_uint32(&prefix));
+    Attachment attachment;
+    size_t size = kBlockSize * 3;
+    stream.cut(size, &attachment);
+    EXPECT_EQ(attachment.size(), size);
+    EXPECT_EQ(attachment.to_string(), data.substr(4, size));
+    EXPECT_EQ(input.bytes(), data.size() - 4 - size);
+
+    // the rest still parses from where the attachment ended
+    stream.cut(input.bytes(), nullptr);
+    EXPECT_EQ(input.bytes(), 0u);
+}
+
+TEST(AttachmentTest, OutputLinksBlocksInOrder) {
+    OutputBuffer output;
+    output.append("head", 4);
+    Attachment attachment;
+    auto data = pattern(kBlockSize + 10);
+    attachment.append(data.data(), data.size());
+    output.append(std::move(attachment));
+    EXPECT_TRUE(attachment.empty());
+    output.append("tail", 4);
+    EXPECT_EQ(output.bytes(), data.size() + 8);
+    EXPECT_EQ(send_all(&output), "head" + data + "tail");
+
+    // the buffer is usable after stepping over the partial blocks
+    output.append("more", 4);
+    EXPECT_EQ(send_all(&output), "more");
+}
+
+TEST(AttachmentTest, ReceivedBlocksSendAgain) {
+    InputBuffer input;
+    auto data = pattern(kBlockSize * 3 + 500);
+    receive(&input, data);
+    NetInputStream stream(&input);
+    Attachment attachment;
+    stream.cut(100, nullptr);
+    stream.cut(data.size() - 200, &attachment);
+
+    OutputBuffer output;
+    output.append(std::move(attachment));
+    EXPECT_EQ(send_all(&output), data.substr(100, data.size() - 200));
+}
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "proto/message.pb.h"
+#include "test/test_server.h"
+
+using namespace xuanqiong;
+
+constexpr static int kCalls = 200;
+
+class CountingEchoService : public EchoService {
+public:
+    void Echo(google::protobuf::RpcController*, const EchoRequest* request,
+              EchoResponse* response, google::protobuf::Closure*) override {
+        calls.fetch_add(1);
+        response->set_message(request->message());
+    }
+
+    std::atomic<int> calls{0};
+};
+
+// per call results of one batch, written on the client executor
+struct Batch {
+    std::vector<EchoResponse> responses;
+    std::vector<RpcController*> controllers;
+    std::vector<bool> failed;
+    std::vector<int32_t> codes;
+    std::atomic<int> finished{0};
+    // finished calls seen by the group completion
+    int finished_at_group = -1;
+    std::promise<void> group;
+
+    explicit Batch(int n) : responses(n), controllers(n), failed(n), codes(n) {}
+
+    void finish(int i) {
+        failed[i] = controllers[i]->Failed();
+        codes[i] = controllers[i]->ErrorCode();
+        finished.fetch_add(1);
+    }
+
+    void finish_group() {
+        finished_at_group = finished.load();
+        group.set_value();
+    }
+
+    std::vector<BatchCall> calls(int n, bool with_done) {
+        auto method = EchoService::descriptor()->FindMethodByName("Echo");
+        std::vector<BatchCall> calls;
+        for (int i = 0; i < n; ++i) {
+            auto request = new EchoRequest;
+            request->set_message("batch " + std::to_string(i));
+            controllers[i] = new RpcController;
+            if (with_done) {
+                auto done = google::protobuf::NewCallback(this, &Batch::finish, i);
+                calls.push_back({method, controllers[i], request, &responses[i], done});
+            } else {
+                // without a done the channel deletes the response
+                calls.push_back({method, controllers[i], request, new EchoResponse, nullptr});
+            }
+        }
+        return calls;
+    }
+};
+
+class BatchCallTest : public RpcTest {
+protected:
+    static void SetUpTestSuite() {
+        start_server([](RpcServer* server) { server->register_service("EchoService", &service_); });
+    }
+
+    void SetUp() override {
+        service_.calls = 0;
+        RpcTest::SetUp();
+    }
+
+    static inline CountingEchoService service_;
+};
+
+TEST_F(BatchCallTest, CompletesEveryCallThenGroup) {
+    Batch batch(kCalls);
+    auto future = batch.group.get_future();
+    channel_->call_batch(batch.calls(kCalls, true),
+                         google::protobuf::NewCallback(&batch, &Batch::finish_group));
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(batch.finished_at_group, kCalls);
+    for (int i = 0; i < kCalls; ++i) {
+        EXPECT_FALSE(batch.failed[i]);
+        EXPECT_EQ(batch.responses[i].message(), "batch " + std::to_string(i));
+    }
+    EXPECT_EQ(service_.calls.load(), kCalls);
+}
+
+TEST_F(BatchCallTest, GroupCompletionAlone) {
+    Batch batch(kCalls);
+    auto future = batch.group.get_future();
+    channel_->call_batch(batch.calls(kCalls, false),
+                         google::protobuf::NewCallback(&batch, &Batch::finish_group));
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(service_.calls.load(), kCalls);
+}
+
+TEST_F(BatchCallTest, EmptyBatchCompletesAtOnce) {
+    Batch batch(0);
+    auto future = batch.group.get_future();
+    channel_->call_batch({}, google::protobuf::NewCallback(&batch, &Batch::finish_group));
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(batch.finished_at_group, 0);
+}
+
+TEST_F(BatchCallTest, CanceledCallsFailAlone) {
+    Batch batch(4);
+    auto future = batch.group.get_future();
+    auto calls = batch.calls(4, true);
+    calls[1].controller->StartCancel();
+    calls[3].controller->StartCancel();
+    channel_->call_batch(std::move(calls),
+                         google::protobuf::NewCallback(&batch, &Batch::finish_group));
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(batch.finished_at_group, 4);
+    EXPECT_FALSE(batch.failed[0]);
+    EXPECT_TRUE(batch.failed[1]);
+    EXPECT_EQ(batch.codes[1], proto::StatusCode::CANCELED);
+    EXPECT_FALSE(batch.failed[2]);
+    EXPECT_TRUE(batch.failed[3]);
+    EXPECT_EQ(service_.calls.load(), 2);
+}
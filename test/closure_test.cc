@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+#include "util/closure.h"
+#include "util/mpmc_queue.h"
+
+using xuanqiong::util::Closure;
+
+TEST(ClosureTest, EmptyAndInvoke) {
+    Closure empty;
+    EXPECT_FALSE(empty);
+
+    int called = 0;
+    Closure task([&called]() { ++called; });
+    ASSERT_TRUE(task);
+    task();
+    task();
+    EXPECT_EQ(called, 2);
+}
+
+// captures which are not copyable are accepted
+TEST(ClosureTest, MoveOnlyCapture) {
+    auto value = std::make_unique<int>(42);
+    int result = 0;
+    Closure task([value = std::move(value), &result]() { result = *value; });
+
+    Closure moved(std::move(task));
+    EXPECT_FALSE(task);
+    ASSERT_TRUE(moved);
+    moved();
+    EXPECT_EQ(result, 42);
+}
+
+TEST(ClosureTest, CapturesDestroyedExactlyOnce) {
+    auto counter = std::make_shared<int>(0);
+    {
+        Closure a([counter]() {});
+        EXPECT_EQ(counter.use_count(), 2);
+        Closure b;
+        b = std::move(a);
+        EXPECT_EQ(counter.use_count(), 2);
+        b = Closure([]() {});
+        EXPECT_EQ(counter.use_count(), 1);
+
+        Closure c([counter]() {});
+        c.reset();
+        EXPECT_EQ(counter.use_count(), 1);
+    }
+    EXPECT_EQ(counter.use_count(), 1);
+}
+
+// the captures of RpcServer::start and ClientChannel::CallMethod fit inline
+TEST(ClosureTest, HotPathCapturesFitInline) {
+    struct Server {} server;
+    auto conn = std::make_shared<std::string>("conn");
+    void* ptrs[5] = {};
+    Closure server_task([s = &server, conn]() { (void)s; (void)conn; });
+    Closure client_task([=, s = &server]() { (void)s; (void)ptrs; });
+    EXPECT_LE(sizeof(Closure), size_t(2 * 64));
+}
+
+TEST(ClosureTest, RoundTripThroughQueue) {
+    xuanqiong::util::MPMCQueue<Closure> queue;
+    int sum = 0;
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_TRUE(queue.push(Closure([&sum, i]() { sum += i; })));
+    }
+    Closure task;
+    int popped = 0;
+    while (queue.pop(task)) {
+        task();
+        ++popped;
+    }
+    EXPECT_EQ(popped, 10000);
+    EXPECT_EQ(sum, 10000 * 9999 / 2);
+}
@@ -0,0 +1,245 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+
+#include "rpc/compress.h"
+#include "proto/message.pb.h"
+#include "util/input_stream.h"
+#include "util/output_stream.h"
+
+using namespace xuanqiong;
+
+// what was appended to output, as it would arrive at the peer
+static void transfer(util::OutputBuffer& output, util::InputBuffer& input) {
+    for (auto& iov : output.get_iovecs()) {
+        auto data = static_cast<const uint8_t*>(iov.iov_base);
+        size_t left = iov.iov_len;
+        while (left > 0) {
+            auto [buffer, size] = input.get_buffer();
+            size_t n = std::min(left, static_cast<size_t>(size));
+            memcpy(buffer, data, n);
+            input.recv_add(n);
+            data += n;
+            left -= n;
+        }
+    }
+}
+
+// large and repetitive, like the payloads compression is meant for
+static proto::Header make_message() {
+    proto::Header message;
+    message.set_service_name("xuanqiong.Echo");
+    std::string text;
+    for (int i = 0; text.size() < 300 * 1024; ++i) {
+        text += "row " + std::to_string(i % 97) + " of a repetitive payload\n";
+    }
+    message.set_error_text(text);
+    return message;
+}
+
+static bool supported(CompressType type) {
+    return supported_compress() & (1u << static_cast<int>(type));
+}
+
+class CompressTest : public ::testing::TestWithParam<CompressType> {};
+
+TEST_P(CompressTest, RoundTripSpansBlocks) {
+    if (!supported(GetParam())) {
+        GTEST_SKIP() << "codec not built in";
+    }
+    util::OutputBuffer output;
+    util::NetOutputStream output_stream(&output);
+    auto message = make_message();
+    size_t size = message.ByteSizeLong();
+    uint32_t wire_len = append_body(&output_stream, message, size, GetParam());
+    uint32_t marker = 0xfeedbeef;
+    output_stream.append(&marker, sizeof(marker));
+    EXPECT_LT(wire_len, size / 4);
+
+    util::InputBuffer input;
+    transfer(output, input);
+    util::NetInputStream input_stream(&input);
+    uint32_t body_len;
+    ASSERT_TRUE(input_stream.fetch_uint32(&body_len));
+    EXPECT_EQ(body_len, wire_len);
+    proto::Header parsed;
+    ASSERT_TRUE(parse_compressed(&parsed, &input_stream, body_len, GetParam()));
+    EXPECT_EQ(parsed.service_name(), message.service_name());
+    EXPECT_EQ(parsed.error_text(), message.error_text());
+    // the next frame starts right after the body
+    uint32_t next;
+    ASSERT_TRUE(input_stream.fetch_uint32(&next));
+    EXPECT_EQ(next, marker);
+}
+
+TEST_P(CompressTest, SerializedBodyRoundTrips) {
+    if (!supported(GetParam())) {
+        GTEST_SKIP() << "codec not built in";
+    }
+    util::OutputBuffer output;
+    util::NetOutputStream output_stream(&output);
+    auto message = make_message();
+    auto serialized = message.SerializeAsString();
+    uint32_t wire_len = append_body(&output_stream, serialized.data(), serialized.size(), GetParam());
+
+    util::InputBuffer input;
+    transfer(output, input);
+    util::NetInputStream input_stream(&input);
+    uint32_t body_len;
+    ASSERT_TRUE(input_stream.fetch_uint32(&body_len));
+    EXPECT_EQ(body_len, wire_len);
+    proto::Header parsed;
+    ASSERT_TRUE(parse_compressed(&parsed, &input_stream, body_len, GetParam()));
+    EXPECT_EQ(parsed.error_text(), message.error_text());
+}
+
+TEST_P(CompressTest, CorruptBodyFailsAndKeepsFraming) {
+    if (!supported(GetParam())) {
+        GTEST_SKIP() << "codec not built in";
+    }
+    util::OutputBuffer output;
+    util::NetOutputStream output_stream(&output);
+    auto message = make_message();
+    uint32_t wire_len = append_body(&output_stream, message, message.ByteSizeLong(), GetParam());
+    uint32_t marker = 0xfeedbeef;
+    output_stream.append(&marker, sizeof(marker));
+
+    util::InputBuffer input;
+    transfer(output, input);
+    util::NetInputStream input_stream(&input);
+    uint32_t body_len;
+    ASSERT_TRUE(input_stream.fetch_uint32(&body_len));
+    // drop the tail of the body, the frame ends early
+    uint32_t truncated = wire_len / 2;
+    proto::Header parsed;
+    EXPECT_FALSE(parse_compressed(&parsed, &input_stream, truncated, GetParam()));
+    ASSERT_TRUE(input_stream.Skip(body_len - truncated));
+    uint32_t next;
+    ASSERT_TRUE(input_stream.fetch_uint32(&next));
+    EXPECT_EQ(next, marker);
+}
+
+INSTANTIATE_TEST_SUITE_P(Codecs, CompressTest,
+                         ::testing::Values(CompressType::LZ4, CompressType::ZSTD));
+
+TEST(CompressOptionsTest, NegotiateNeedsPeerAndSize) {
+    auto zstd = CompressType::ZSTD;
+    uint32_t peer = 1u << static_cast<int>(zstd);
+    auto expected = supported(zstd) ? zstd : CompressType::NONE;
+    EXPECT_EQ(negotiate(zstd, 8192, 4096, peer), expected);
+    EXPECT_EQ(negotiate(zstd, 1024, 4096, peer), CompressType::NONE);
+    EXPECT_EQ(negotiate(zstd, 8192, 4096, 0), CompressType::NONE);
+    EXPECT_EQ(negotiate(CompressType::NONE, 8192, 4096, peer), CompressType::NONE);
+}
+
+TEST(CompressOptionsTest, MethodOverridesDefault) {
+    CompressOptions options;
+    options.type = CompressType::LZ4;
+    options.methods["xuanqiong.Echo/Echo"] = CompressType::ZSTD;
+    options.methods["xuanqiong.Echo/Ping"] = CompressType::NONE;
+    EXPECT_EQ(options.for_method("xuanqiong.Echo", "Echo"), CompressType::ZSTD);
+    EXPECT_EQ(options.for_method("xuanqiong.Echo", "Ping"), CompressType::NONE);
+    EXPECT_EQ(options.for_method("xuanqiong.Echo", "Other"), CompressType::LZ4);
+}
+
+TEST(ParseCompressedTest, UnknownTypeSkipsBody) {
+    util::InputBuffer input;
+    auto [buffer, size] = input.get_buffer();
+    memset(buffer, 0x5a, 64);
+    input.recv_add(64);
+    util::NetInputStream input_stream(&input);
+    proto::Header parsed;
+    EXPECT_FALSE(parse_compressed(&parsed, &input_stream, 60, static_cast<CompressType>(7)));
+    EXPECT_EQ(input_stream.ByteCount(), 60);
+}
+
+TEST(OutputSlotTest, PatchSpansBlocks) {
+    util::OutputBuffer output;
+    util::NetOutputStream output_stream(&output);
+    std::string filler(util::kBlockSize - 2, 'a');
+    output_stream.append(filler.data(), filler.size());
+    auto slot = output_stream.reserve_uint32();
+    output_stream.append("tail", 4);
+    output_stream.patch_uint32(slot, 0x11223344);
+
+    util::InputBuffer input;
+    transfer(output, input);
+    util::NetInputStream input_stream(&input);
+    ASSERT_TRUE(input_stream.Skip(filler.size()));
+    uint32_t value;
+    ASSERT_TRUE(input_stream.fetch_uint32(&value));
+    EXPECT_EQ(value, 0x11223344u);
+}
+
+// a header that fits is written in place, one behind it that does not is
+// streamed into the next block
+TEST(AppendHeaderTest, InPlaceAndAcrossBlocks) {
+    util::OutputBuffer output;
+    util::NetOutputStream output_stream(&output);
+    proto::Header first;
+    first.set_request_id(1);
+    first.set_service_name("xuanqiong.Echo");
+    proto::Header second;
+    second.set_request_id(2);
+    second.set_method_name(std::string(200, 'm'));
+    append_header(&output_stream, first);
+    std::string filler(util::kBlockSize - output.bytes() - 100, 'a');
+    output_stream.append(filler.data(), filler.size());
+    append_header(&output_stream, second);
+
+    util::InputBuffer input;
+    transfer(output, input);
+    util::NetInputStream input_stream(&input);
+    for (auto expected : {&first, &second}) {
+        uint32_t header_len;
+        ASSERT_TRUE(input_stream.fetch_uint32(&header_len));
+        EXPECT_EQ(header_len, expected->ByteSizeLong());
+        input_stream.push_limit(header_len);
+        proto::Header parsed;
+        ASSERT_TRUE(parsed.ParseFromZeroCopyStream(&input_stream));
+        input_stream.pop_limit();
+        EXPECT_EQ(parsed.SerializeAsString(), expected->SerializeAsString());
+        if (expected == &first) {
+            ASSERT_TRUE(input_stream.Skip(filler.size()));
+        }
+    }
+}
+
+// bytes before an open slot go out, the slot and what follows wait for it
+TEST(OutputSlotTest, HoldsSendUntilPatched) {
+    util::OutputBuffer output;
+    util::NetOutputStream output_stream(&output);
+    std::string head(100, 'h');
+    output_stream.append(head.data(), head.size());
+    auto slot = output_stream.reserve_uint32();
+    std::string body(util::kBlockSize, 'b');
+    output_stream.append(body.data(), body.size());
+    EXPECT_EQ(output.sendable(), head.size());
+    output.send_add(head.size());
+    EXPECT_EQ(output.sendable(), 0u);
+
+    // more of the body after a flush, it spans three blocks now
+    output_stream.append(body.data(), body.size());
+    EXPECT_EQ(output_stream.patch_length(slot), 2 * body.size());
+    EXPECT_EQ(output.sendable(), output.bytes());
+
+    util::InputBuffer input;
+    transfer(output, input);
+    util::NetInputStream input_stream(&input);
+    uint32_t body_len;
+    ASSERT_TRUE(input_stream.fetch_uint32(&body_len));
+    EXPECT_EQ(body_len, 2 * body.size());
+}
+
+TEST(OutputSlotTest, NestedSlotsReleaseInOrder) {
+    util::OutputBuffer output;
+    util::NetOutputStream output_stream(&output);
+    auto outer = output_stream.reserve_uint32();
+    output_stream.append("ab", 2);
+    auto inner = output_stream.reserve_uint32();
+    output_stream.append("cdef", 4);
+    EXPECT_EQ(output_stream.patch_length(inner), 4u);
+    EXPECT_EQ(output.sendable(), 0u);
+    EXPECT_EQ(output_stream.patch_length(outer), 10u);
+    EXPECT_EQ(output.sendable(), 14u);
+}
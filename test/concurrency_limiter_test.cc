@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "util/concurrency_limiter.h"
+
+using namespace xuanqiong::util;
+
+// keep the limiter saturated and complete every request with latency_ns
+static void run_windows(ConcurrencyLimiter& limiter, int windows, int64_t latency_ns) {
+    for (int w = 0; w < windows; ++w) {
+        int admitted = 0;
+        while (limiter.try_acquire()) {
+            ++admitted;
+        }
+        for (int i = 0; i < admitted; ++i) {
+            limiter.release(latency_ns);
+        }
+    }
+}
+
+TEST(ConcurrencyLimiterTest, DisabledAdmitsEverything) {
+    ConcurrencyLimiter limiter(ConcurrencyLimiterOptions{});
+    EXPECT_FALSE(limiter.enabled());
+    for (int i = 0; i < 10000; ++i) {
+        EXPECT_TRUE(limiter.try_acquire());
+    }
+    EXPECT_EQ(limiter.rejected(), 0u);
+}
+
+TEST(ConcurrencyLimiterTest, FixedLimit) {
+    ConcurrencyLimiterOptions options;
+    options.max_limit = 8;
+    ConcurrencyLimiter limiter(options);
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_TRUE(limiter.try_acquire());
+    }
+    EXPECT_FALSE(limiter.try_acquire());
+    EXPECT_EQ(limiter.rejected(), 1u);
+    EXPECT_EQ(limiter.inflight(), 8);
+
+    limiter.release(1000);
+    EXPECT_TRUE(limiter.try_acquire());
+    // a fixed limit ignores latency
+    run_windows(limiter, 100, 1000000000);
+    EXPECT_EQ(limiter.limit(), 8);
+}
+
+TEST(ConcurrencyLimiterTest, AdaptsToLatency) {
+    ConcurrencyLimiterOptions options;
+    options.max_limit = 1024;
+    options.adaptive = true;
+    options.initial_limit = 16;
+    options.window = 16;
+    ConcurrencyLimiter limiter(options);
+
+    // flat latency while saturated: the limit grows
+    run_windows(limiter, 200, 100000);
+    int grown = limiter.limit();
+    EXPECT_GT(grown, 16);
+
+    // queueing delay shows up: the limit backs off within a few windows
+    int admitted = 0;
+    while (limiter.try_acquire()) {
+        ++admitted;
+    }
+    for (int i = 0; i < admitted; ++i) {
+        limiter.release(i < options.window * 4 ? 1000000 : -1);
+    }
+    int shrunk = limiter.limit();
+    EXPECT_LT(shrunk, grown * 3 / 4);
+    EXPECT_GE(shrunk, options.min_limit);
+    EXPECT_EQ(limiter.inflight(), 0);
+}
+
+TEST(ConcurrencyLimiterTest, NoGrowthWhenNotSaturated) {
+    ConcurrencyLimiterOptions options;
+    options.max_limit = 1024;
+    options.adaptive = true;
+    options.initial_limit = 64;
+    options.window = 16;
+    ConcurrencyLimiter limiter(options);
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_TRUE(limiter.try_acquire());
+        limiter.release(100000);
+    }
+    EXPECT_LE(limiter.limit(), 64);
+}
+
+TEST(ConcurrencyLimiterTest, MaxLimitBelowMinLimit) {
+    ConcurrencyLimiterOptions options;
+    options.max_limit = 2;
+    options.adaptive = true;
+    options.window = 4;
+    ASSERT_GT(options.min_limit, options.max_limit);
+    ConcurrencyLimiter limiter(options);
+    EXPECT_EQ(limiter.limit(), 2);
+    // neither growth nor backoff moves the limit past the hard cap
+    run_windows(limiter, 50, 100000);
+    EXPECT_EQ(limiter.limit(), 2);
+    run_windows(limiter, 50, 100000000);
+    EXPECT_EQ(limiter.limit(), 2);
+    EXPECT_TRUE(limiter.try_acquire());
+    EXPECT_TRUE(limiter.try_acquire());
+    EXPECT_FALSE(limiter.try_acquire());
+}
+
+TEST(ConcurrencyLimiterTest, ConcurrentNeverExceedsLimit) {
+    ConcurrencyLimiterOptions options;
+    options.max_limit = 16;
+    ConcurrencyLimiter limiter(options);
+    std::atomic<int> current{0};
+    std::atomic<int> peak{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 100000; ++i) {
+                if (!limiter.try_acquire()) {
+                    continue;
+                }
+                int now = current.fetch_add(1) + 1;
+                int prev = peak.load();
+                while (now > prev && !peak.compare_exchange_weak(prev, now)) {}
+                current.fetch_sub(1);
+                limiter.release(1000);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_LE(peak.load(), 16);
+    EXPECT_EQ(limiter.inflight(), 0);
+}
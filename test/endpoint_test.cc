@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "net/endpoint.h"
+
+using namespace xuanqiong::net;
+
+TEST(EndpointTest, ParsesTcp) {
+    Endpoint endpoint;
+    ASSERT_TRUE(Endpoint::parse("127.0.0.1:8888", &endpoint));
+    EXPECT_EQ(endpoint.family(), AF_INET);
+    EXPECT_FALSE(endpoint.is_unix());
+    EXPECT_EQ(endpoint.host(), "127.0.0.1");
+    EXPECT_EQ(endpoint.port(), 8888);
+    EXPECT_EQ(endpoint.to_string(), "127.0.0.1:8888");
+}
+
+TEST(EndpointTest, ParsesUnixPath) {
+    Endpoint endpoint;
+    ASSERT_TRUE(Endpoint::parse("unix:/tmp/echo.sock", &endpoint));
+    EXPECT_TRUE(endpoint.is_unix());
+    EXPECT_EQ(endpoint.path(), "/tmp/echo.sock");
+    EXPECT_EQ(endpoint.port(), 0);
+    EXPECT_EQ(endpoint.to_string(), "unix:/tmp/echo.sock");
+}
+
+#ifdef __linux__
+TEST(EndpointTest, ParsesShm) {
+    Endpoint endpoint;
+    ASSERT_TRUE(Endpoint::parse("shm:/tmp/echo.sock", &endpoint));
+    EXPECT_TRUE(endpoint.is_unix());
+    EXPECT_TRUE(endpoint.is_shm());
+    EXPECT_EQ(endpoint.path(), "/tmp/echo.sock");
+    EXPECT_EQ(endpoint.to_string(), "shm:/tmp/echo.sock");
+    ASSERT_TRUE(Endpoint::parse("unix:/tmp/echo.sock", &endpoint));
+    EXPECT_FALSE(endpoint.is_shm());
+}
+
+TEST(EndpointTest, ParsesAbstractName) {
+    Endpoint endpoint;
+    ASSERT_TRUE(Endpoint::parse("unix-abstract:echo", &endpoint));
+    EXPECT_TRUE(endpoint.is_unix());
+    // no file behind it
+    EXPECT_EQ(endpoint.path(), "");
+    EXPECT_EQ(endpoint.to_string(), "unix-abstract:echo");
+    EXPECT_EQ(endpoint.addr_len(), offsetof(struct sockaddr_un, sun_path) + 1 + 4);
+}
+#endif
+
+TEST(EndpointTest, ParsesIpv6) {
+    Endpoint endpoint;
+    ASSERT_TRUE(Endpoint::parse("[::1]:8888", &endpoint));
+    EXPECT_EQ(endpoint.family(), AF_INET6);
+    EXPECT_TRUE(endpoint.is_tcp());
+    EXPECT_FALSE(endpoint.is_wildcard());
+    EXPECT_EQ(endpoint.host(), "::1");
+    EXPECT_EQ(endpoint.port(), 8888);
+    EXPECT_EQ(endpoint.to_string(), "[::1]:8888");
+}
+
+TEST(EndpointTest, Wildcards) {
+    Endpoint endpoint;
+    ASSERT_TRUE(Endpoint::parse("[::]:8888", &endpoint));
+    EXPECT_TRUE(endpoint.is_wildcard());
+    ASSERT_TRUE(Endpoint::parse("0.0.0.0:8888", &endpoint));
+    EXPECT_TRUE(endpoint.is_wildcard());
+    EXPECT_TRUE(Endpoint::any(8888).is_wildcard());
+    ASSERT_TRUE(Endpoint::parse("unix:/tmp/echo.sock", &endpoint));
+    EXPECT_FALSE(endpoint.is_wildcard());
+}
+
+TEST(EndpointTest, ParsesInterface) {
+    Endpoint endpoint;
+    ASSERT_TRUE(Endpoint::parse("0.0.0.0%lo:8888", &endpoint));
+    EXPECT_EQ(endpoint.interface(), "lo");
+    EXPECT_EQ(endpoint.to_string(), "0.0.0.0%lo:8888");
+    ASSERT_TRUE(Endpoint::parse("[fe80::1%lo]:8888", &endpoint));
+    EXPECT_EQ(endpoint.interface(), "lo");
+    EXPECT_EQ(endpoint.to_string(), "[fe80::1%lo]:8888");
+    // the scope of an ipv6 address must exist
+    EXPECT_FALSE(Endpoint::parse("[fe80::1%no-such-if0]:8888", &endpoint));
+}
+
+TEST(EndpointTest, FromSockaddr) {
+    struct sockaddr_in6 in6{};
+    in6.sin6_family = AF_INET6;
+    in6.sin6_port = htons(9000);
+    in6.sin6_addr = in6addr_loopback;
+    Endpoint endpoint(reinterpret_cast<struct sockaddr*>(&in6), sizeof(in6));
+    EXPECT_EQ(endpoint.to_string(), "[::1]:9000");
+}
+
+TEST(EndpointTest, RejectsMalformed) {
+    Endpoint endpoint;
+    EXPECT_FALSE(Endpoint::parse("127.0.0.1", &endpoint));
+    EXPECT_FALSE(Endpoint::parse("127.0.0.1:http", &endpoint));
+    EXPECT_FALSE(Endpoint::parse("127.0.0.1:70000", &endpoint));
+    EXPECT_FALSE(Endpoint::parse("localhost:8888", &endpoint));
+    EXPECT_FALSE(Endpoint::parse("::1:8888", &endpoint));
+    EXPECT_FALSE(Endpoint::parse("[127.0.0.1]:8888", &endpoint));
+    EXPECT_FALSE(Endpoint::parse("127.0.0.1%:8888", &endpoint));
+    EXPECT_FALSE(Endpoint::parse("unix:", &endpoint));
+    EXPECT_FALSE(Endpoint::parse("unix:/" + std::string(200, 'a'), &endpoint));
+}
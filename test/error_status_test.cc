@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <string>
+
+#include "proto/message.pb.h"
+#include "test/test_server.h"
+
+using namespace xuanqiong;
+
+// Echo fails on "fail" with the plain SetFailed, Echo1 always fails with a
+// code of its own
+class FailingEchoService : public EchoService {
+public:
+    void Echo(google::protobuf::RpcController* controller, const EchoRequest* request,
+              EchoResponse* response, google::protobuf::Closure*) override {
+        if (request->message() == "fail") {
+            controller->SetFailed("asked to fail");
+            return;
+        }
+        response->set_message(request->message());
+    }
+
+    void Echo1(google::protobuf::RpcController* controller, const EchoRequest*,
+               EchoResponse*, google::protobuf::Closure*) override {
+        static_cast<RpcController*>(controller)->SetFailed(proto::StatusCode::OVERLOADED,
+                                                           "echo1 is closed");
+    }
+};
+
+class ErrorStatusTest : public RpcTest {
+protected:
+    static void SetUpTestSuite() {
+        start_server([](RpcServer* server) { server->register_service("EchoService", &service_); });
+
+        // echo.proto once more, with a method and a service the server lacks
+        google::protobuf::FileDescriptorProto file;
+        EchoService::descriptor()->file()->CopyTo(&file);
+        file.set_name("missing.proto");
+        auto method = file.mutable_service(0)->add_method();
+        method->CopyFrom(file.service(0).method(0));
+        method->set_name("Echo2");
+        auto service = file.add_service();
+        service->CopyFrom(file.service(0));
+        service->set_name("MissingService");
+        missing_file_ = pool_.BuildFile(file);
+    }
+
+    void SetUp() override {
+        ASSERT_NE(missing_file_, nullptr);
+        RpcTest::SetUp();
+    }
+
+    // a good call after a bad one: the connection is still in use
+    void expect_usable() {
+        auto result = call(channel_, "Echo", "still here");
+        EXPECT_EQ(result.code, 0);
+        EXPECT_EQ(result.error_text, "");
+        EXPECT_EQ(result.message, "still here");
+    }
+
+    static inline FailingEchoService service_;
+    static inline google::protobuf::DescriptorPool pool_;
+    static inline const google::protobuf::FileDescriptor* missing_file_ = nullptr;
+};
+
+TEST_F(ErrorStatusTest, UnknownService) {
+    auto result = call(channel_, missing_file_->FindServiceByName("MissingService")->method(0), "hello");
+    EXPECT_EQ(result.code, proto::StatusCode::UNKNOWN_SERVICE);
+    EXPECT_EQ(result.error_text, "service not found: MissingService");
+    EXPECT_EQ(result.message, "");
+    expect_usable();
+}
+
+TEST_F(ErrorStatusTest, UnknownMethod) {
+    auto method = missing_file_->FindServiceByName("EchoService")->FindMethodByName("Echo2");
+    auto result = call(channel_, method, "hello");
+    EXPECT_EQ(result.code, proto::StatusCode::UNKNOWN_METHOD);
+    EXPECT_EQ(result.error_text, "method not found: Echo2");
+    expect_usable();
+}
+
+TEST_F(ErrorStatusTest, UnparsableBody) {
+    // a proto3 string has to be valid UTF-8 to parse
+    auto result = call(channel_, "Echo", "\xff\xfe");
+    EXPECT_EQ(result.code, proto::StatusCode::BAD_REQUEST);
+    EXPECT_EQ(result.error_text, "failed to parse request");
+    expect_usable();
+}
+
+TEST_F(ErrorStatusTest, HandlerFailed) {
+    auto result = call(channel_, "Echo", "fail");
+    EXPECT_EQ(result.code, proto::StatusCode::HANDLER_FAILED);
+    EXPECT_EQ(result.error_text, "asked to fail");
+    expect_usable();
+}
+
+TEST_F(ErrorStatusTest, HandlerFailedWithCode) {
+    auto result = call(channel_, "Echo1", "hello");
+    EXPECT_EQ(result.code, proto::StatusCode::OVERLOADED);
+    EXPECT_EQ(result.error_text, "echo1 is closed");
+    expect_usable();
+}
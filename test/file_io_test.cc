@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <future>
+#include <liburing.h>
+#include <string>
+#include <unistd.h>
+
+#include "scheduler/file_io.h"
+#include "scheduler/scheduler.h"
+#include "scheduler/task.h"
+#include "util/direct_buffer.h"
+
+using namespace xuanqiong;
+
+struct FileResult {
+    int64_t open = 0;
+    int64_t write = 0;
+    int64_t fsync = 0;
+    int64_t size = -1;
+    int64_t read = 0;
+    std::string data;
+};
+
+static Task write_then_read(std::string path, std::string data, std::promise<FileResult>* done) {
+    FileResult result;
+    result.open = co_await async_open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    int fd = result.open;
+    if (fd >= 0) {
+        result.write = co_await async_pwrite(fd, data.data(), data.size(), 0);
+        result.fsync = co_await async_fsync(fd);
+        struct statx stx;
+        if (co_await async_statx(path.c_str(), &stx) == 0) {
+            result.size = stx.stx_size;
+        }
+        result.data.resize(data.size());
+        result.read = co_await async_pread(fd, result.data.data(), result.data.size(), 0);
+        ::close(fd);
+    }
+    done->set_value(result);
+}
+
+static Task read_missing(std::promise<int64_t>* done) {
+    done->set_value(co_await async_open("/nonexistent/xuanqiong", O_RDONLY));
+}
+
+static bool uring_supported() {
+    io_uring ring;
+    if (io_uring_queue_init(2, &ring, 0) != 0) {
+        return false;
+    }
+    io_uring_queue_exit(&ring);
+    return true;
+}
+
+class FileIoTest : public ::testing::TestWithParam<SchedPolicy> {
+protected:
+    void SetUp() override {
+        if (GetParam() == SchedPolicy::URING_POLICY && !uring_supported()) {
+            GTEST_SKIP() << "io_uring is not available";
+        }
+        scheduler_ = std::make_unique<Scheduler>(SchedulerOptions(-1, GetParam()));
+        executor_ = scheduler_->get_executor(0);
+        char path[] = "/tmp/xq_file_io_XXXXXX";
+        int fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        ::close(fd);
+        path_ = path;
+    }
+
+    void TearDown() override {
+        if (scheduler_) {
+            scheduler_->stop();
+            scheduler_->join();
+        }
+        if (!path_.empty()) {
+            ::unlink(path_.c_str());
+        }
+    }
+
+    std::unique_ptr<Scheduler> scheduler_;
+    Executor* executor_ = nullptr;
+    std::string path_;
+};
+
+TEST_P(FileIoTest, WriteFsyncStatRead) {
+    std::string data(10000, 'x');
+    std::promise<FileResult> done;
+    auto future = done.get_future();
+    executor_->spawn([path = path_, data, done = &done]() { write_then_read(path, data, done); });
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    auto result = future.get();
+    ASSERT_GE(result.open, 0);
+    EXPECT_EQ(result.write, 10000);
+    EXPECT_EQ(result.fsync, 0);
+    EXPECT_EQ(result.size, 10000);
+    EXPECT_EQ(result.read, 10000);
+    EXPECT_EQ(result.data, data);
+}
+
+TEST_P(FileIoTest, ErrorIsNegativeErrno) {
+    std::promise<int64_t> done;
+    auto future = done.get_future();
+    executor_->spawn([done = &done]() { read_missing(done); });
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(future.get(), -ENOENT);
+}
+
+INSTANTIATE_TEST_SUITE_P(Policies, FileIoTest,
+                         ::testing::Values(SchedPolicy::POLL_POLICY, SchedPolicy::URING_POLICY));
+
+TEST(DirectBufferTest, AlignedAndRounded) {
+    util::DirectBuffer buffer(100);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.data()) % util::kDirectAlign, 0u);
+    EXPECT_EQ(buffer.size(), static_cast<size_t>(util::kBlockSize));
+    util::DirectBuffer moved(std::move(buffer));
+    EXPECT_EQ(buffer.data(), nullptr);
+    EXPECT_EQ(moved.size(), static_cast<size_t>(util::kBlockSize));
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net/poll_connection.h"
+#include "net/shm_connection.h"
+
+using namespace xuanqiong;
+using namespace xuanqiong::net;
+
+class FileRegionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char path[] = "/tmp/xq_file_region_XXXXXX";
+        file_fd_ = mkstemp(path);
+        ASSERT_GE(file_fd_, 0);
+        ::unlink(path);
+        content_.resize(100000);
+        for (size_t i = 0; i < content_.size(); ++i) {
+            content_[i] = 'a' + i % 26;
+        }
+        ASSERT_EQ(::pwrite(file_fd_, content_.data(), content_.size(), 0), (ssize_t)content_.size());
+    }
+
+    void TearDown() override {
+        ::close(file_fd_);
+    }
+
+    // a region the connection may close, over its own fd
+    util::FileRegion region(off_t offset, size_t len) {
+        return {::dup(file_fd_), offset, len};
+    }
+
+    static void append(Connection* conn, const std::string& data) {
+        conn->get_output_stream().append(data.data(), data.size());
+    }
+
+    static std::string drain(int fd, size_t size) {
+        std::string data;
+        char buffer[65536];
+        while (data.size() < size) {
+            ssize_t n = ::read(fd, buffer, sizeof(buffer));
+            if (n <= 0) {
+                break;
+            }
+            data.append(buffer, n);
+        }
+        return data;
+    }
+
+    int file_fd_ = -1;
+    std::string content_;
+};
+
+TEST_F(FileRegionTest, PollSendsRegionBetweenBufferedBytes) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    // the writer side must not block, the test reads after each write
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    PollConnection conn(fds[0], nullptr);
+
+    append(&conn, "head");
+    conn.append_file(region(10, 1000));
+    append(&conn, "tail");
+    EXPECT_EQ(conn.write_bytes(), 1008u);
+
+    EXPECT_FALSE(conn.async_write().should_suspend);
+    EXPECT_EQ(conn.write_bytes(), 0u);
+    EXPECT_EQ(conn.stats().bytes_out.load(), 1008u);
+    EXPECT_EQ(drain(fds[1], 1008), "head" + content_.substr(10, 1000) + "tail");
+    ::close(fds[1]);
+}
+
+TEST_F(FileRegionTest, PollResumesRegionAfterFullSocket) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    int sndbuf = 4096;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    PollConnection conn(fds[0], nullptr);
+
+    conn.append_file(region(0, content_.size()));
+    append(&conn, "end");
+    std::string received;
+    size_t total = content_.size() + 3;
+    while (received.size() < total) {
+        conn.async_write();
+        received += drain(fds[1], std::min<size_t>(total - received.size(), 1));
+    }
+    EXPECT_EQ(received, content_ + "end");
+    EXPECT_EQ(conn.write_bytes(), 0u);
+    ::close(fds[1]);
+}
+
+TEST_F(FileRegionTest, PollClosesOnShortFile) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    PollConnection conn(fds[0], nullptr);
+    // past the end of the file
+    conn.append_file(region(content_.size() - 10, 100));
+    conn.set_write_handle(std::noop_coroutine().address());
+    EXPECT_FALSE(conn.async_write().should_suspend);
+    EXPECT_TRUE(conn.closed());
+    ::close(fds[1]);
+}
+
+TEST_F(FileRegionTest, ShmCopiesRegionIntoOutput) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    ShmConnection conn(fds[0], nullptr);
+    append(&conn, "head");
+    conn.append_file(region(5, 20000));
+    EXPECT_EQ(conn.write_bytes(), 20004u);
+    ::close(fds[1]);
+}
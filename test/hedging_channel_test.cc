@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "client/hedging_channel.h"
+#include "proto/message.pb.h"
+#include "scheduler/timer.h"
+#include "test/test_server.h"
+
+using namespace xuanqiong;
+
+// Echo fails with OVERLOADED while failures are left, Echo1 stalls its
+// executor once when asked to
+class FlakyEchoService : public EchoService {
+public:
+    void Echo(google::protobuf::RpcController* controller, const EchoRequest* request,
+              EchoResponse* response, google::protobuf::Closure*) override {
+        if (failures.fetch_sub(1) > 0) {
+            static_cast<RpcController*>(controller)->SetFailed(proto::StatusCode::OVERLOADED, "busy");
+            return;
+        }
+        response->set_message(request->message());
+    }
+
+    void Echo1(google::protobuf::RpcController*, const EchoRequest* request,
+               EchoResponse* response, google::protobuf::Closure*) override {
+        if (stall.exchange(false)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        }
+        response->set_message(request->message());
+    }
+
+    std::atomic<int> failures{0};
+    std::atomic<bool> stall{false};
+};
+
+class HedgingChannelTest : public RpcTest {
+protected:
+    static void SetUpTestSuite() {
+        // the connections of the two channels land on different executors
+        start_server([](RpcServer* server) { server->register_service("EchoService", &service_); }, 2);
+    }
+
+    void SetUp() override {
+        service_.failures = 0;
+        service_.stall = false;
+        RpcTest::SetUp();
+        connect();
+    }
+
+    std::unique_ptr<HedgingChannel> make_channel(const HedgingOptions& options) {
+        return std::make_unique<HedgingChannel>(
+            std::vector<ClientChannel*>{channels_[0].get(), channels_[1].get()}, options);
+    }
+
+    static inline FlakyEchoService service_;
+};
+
+TEST_F(HedgingChannelTest, RetriesOverloadedIdempotentCall) {
+    HedgingOptions options;
+    options.policy.idempotent = true;
+    options.policy.max_attempts = 3;
+    auto channel = make_channel(options);
+    service_.failures = 2;
+    auto result = call(channel.get(), "Echo", "hello");
+    EXPECT_FALSE(result.failed);
+    EXPECT_EQ(result.message, "hello");
+    EXPECT_EQ(channel->stats().retries.load(), 2u);
+}
+
+TEST_F(HedgingChannelTest, GivesUpAfterMaxAttempts) {
+    HedgingOptions options;
+    options.policy.idempotent = true;
+    options.policy.max_attempts = 2;
+    auto channel = make_channel(options);
+    service_.failures = 5;
+    auto result = call(channel.get(), "Echo", "hello");
+    EXPECT_TRUE(result.failed);
+    EXPECT_EQ(result.code, proto::StatusCode::OVERLOADED);
+    EXPECT_EQ(channel->stats().retries.load(), 1u);
+}
+
+TEST_F(HedgingChannelTest, NonIdempotentIsSentOnce) {
+    auto channel = make_channel(HedgingOptions{});
+    service_.failures = 1;
+    auto result = call(channel.get(), "Echo", "hello");
+    EXPECT_TRUE(result.failed);
+    EXPECT_EQ(result.code, proto::StatusCode::OVERLOADED);
+    EXPECT_EQ(channel->stats().retries.load(), 0u);
+}
+
+TEST_F(HedgingChannelTest, BudgetStopsRetries) {
+    HedgingOptions options;
+    options.policy.idempotent = true;
+    options.policy.max_attempts = 3;
+    options.budget_ratio = 0;
+    options.budget_max = 1;
+    auto channel = make_channel(options);
+    service_.failures = 2;
+    auto result = call(channel.get(), "Echo", "hello");
+    EXPECT_TRUE(result.failed);
+    EXPECT_EQ(channel->stats().retries.load(), 1u);
+    EXPECT_EQ(channel->stats().throttled.load(), 1u);
+}
+
+TEST_F(HedgingChannelTest, HedgeAnswersStalledCall) {
+    HedgingOptions options;
+    HedgingPolicy policy;
+    policy.idempotent = true;
+    policy.hedge_delay_ms = 20;
+    options.methods["EchoService/Echo1"] = policy;
+    auto channel = make_channel(options);
+    service_.stall = true;
+    auto start = std::chrono::steady_clock::now();
+    auto result = call(channel.get(), "Echo1", "hello");
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_FALSE(result.failed);
+    EXPECT_EQ(result.message, "hello");
+    EXPECT_LT(elapsed, std::chrono::milliseconds(400));
+    EXPECT_EQ(channel->stats().hedges.load(), 1u);
+    EXPECT_EQ(channel->stats().hedge_wins.load(), 1u);
+}
+
+TEST(RetryBudgetTest, SpendsSavingsThenEarnsByRatio) {
+    RetryBudget budget(0.5, 2);
+    EXPECT_TRUE(budget.withdraw());
+    EXPECT_TRUE(budget.withdraw());
+    EXPECT_FALSE(budget.withdraw());
+    budget.deposit();
+    EXPECT_FALSE(budget.withdraw());
+    budget.deposit();
+    EXPECT_TRUE(budget.withdraw());
+    // savings are capped
+    for (int i = 0; i < 100; ++i) {
+        budget.deposit();
+    }
+    EXPECT_TRUE(budget.withdraw());
+    EXPECT_TRUE(budget.withdraw());
+    EXPECT_FALSE(budget.withdraw());
+}
+
+TEST(TimerTest, RunsOnExecutorByDueTime) {
+    Scheduler scheduler(SchedulerOptions(-1, SchedPolicy::POLL_POLICY));
+    auto executor = scheduler.get_executor(0);
+    std::vector<int> order;
+    std::atomic<bool> on_executor{true};
+    std::promise<void> done;
+    for (int i : {3, 1, 2}) {
+        run_after(executor, i * 10000000, [&, i, executor]() {
+            on_executor = on_executor && Executor::current() == executor;
+            order.push_back(i);
+            if (order.size() == 3) {
+                done.set_value();
+            }
+        });
+    }
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(order, (std::vector<int>{1, 2, 3}));
+    EXPECT_TRUE(on_executor.load());
+    scheduler.stop();
+    scheduler.join();
+}
+
+TEST(TimerTest, StopDropsPendingTimers) {
+    auto scheduler = std::make_unique<Scheduler>(SchedulerOptions(-1, SchedPolicy::POLL_POLICY));
+    auto executor = scheduler->get_executor(0);
+    auto token = std::make_shared<int>(0);
+    std::atomic<bool> ran{false};
+    run_after(executor, 50000000, [&ran, token]() { ran = true; });
+    EXPECT_EQ(token.use_count(), 2);
+    scheduler->stop();
+    // dropped with its captures, before the executor goes away
+    EXPECT_EQ(token.use_count(), 1);
+    scheduler->join();
+    scheduler.reset();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(ran.load());
+}
@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "util/histogram.h"
+
+using namespace xuanqiong::util;
+
+TEST(HistogramTest, BucketBoundaries) {
+    for (uint64_t v = 0; v < (1ULL << 20); v = v * 3 / 2 + 1) {
+        int index = hist_bucket_index(v);
+        ASSERT_LT(index, kHistBuckets);
+        EXPECT_LE(hist_bucket_lower(index), v);
+        EXPECT_GE(hist_bucket_upper(index), v);
+    }
+    EXPECT_EQ(hist_bucket_index(kHistMaxValue), kHistBuckets - 1);
+    EXPECT_EQ(hist_bucket_index(UINT64_MAX), kHistBuckets - 1);
+}
+
+TEST(HistogramTest, Percentiles) {
+    Histogram histogram;
+    for (uint64_t v = 1; v <= 10000; ++v) {
+        histogram.record(v * 1000);
+    }
+    HistogramSnapshot snapshot;
+    snapshot.merge(histogram);
+
+    EXPECT_EQ(snapshot.count(), 10000u);
+    EXPECT_EQ(snapshot.max(), 10000u * 1000);
+    EXPECT_NEAR(snapshot.mean(), 5000.5 * 1000, 1);
+    // relative error of a bucket is bounded by 1 / kHistHalfBuckets
+    EXPECT_NEAR(snapshot.percentile(0.5), 5000.0 * 1000, 5000.0 * 1000 / kHistHalfBuckets);
+    EXPECT_NEAR(snapshot.percentile(0.99), 9900.0 * 1000, 9900.0 * 1000 / kHistHalfBuckets);
+    EXPECT_EQ(snapshot.percentile(1.0), 10000u * 1000);
+}
+
+TEST(HistogramTest, MergeWhileRecording) {
+    Histogram histograms[2];
+    std::vector<std::thread> writers;
+    for (auto& histogram : histograms) {
+        writers.emplace_back([&histogram]() {
+            for (int i = 0; i < 100000; ++i) {
+                histogram.record(i % 1000);
+            }
+        });
+    }
+    // readers may merge at any time
+    for (int i = 0; i < 100; ++i) {
+        HistogramSnapshot snapshot;
+        snapshot.merge(histograms[0]);
+        snapshot.merge(histograms[1]);
+        EXPECT_LE(snapshot.count(), 200000u);
+    }
+    for (auto& t : writers) t.join();
+
+    HistogramSnapshot total;
+    total.merge(histograms[0]);
+    total.merge(histograms[1]);
+    EXPECT_EQ(total.count(), 200000u);
+    EXPECT_EQ(total.max(), 999u);
+}
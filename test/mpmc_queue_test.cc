@@ -2,7 +2,7 @@
 #include <atomic>
 #include <thread>
 #include <vector>
-#include <chrono>
+#include <memory>
 
 #include "util/mpmc_queue.h"
 
@@ -276,7 +276,7 @@ TEST(MPMCQueueTest, MultiProducerMultiConsumer) {
     std::vector<std::thread> consumers;
     for (int i = 0; i < num_consumers; ++i) {
         consumers.emplace_back([&queue, &sum, &producers_done, &consumers_should_stop, num_producers]() {
-            int local_sum = 0;
+            uint64_t local_sum = 0;
             while (true) {
                 int value;
                 if (queue.pop(value)) {
@@ -321,3 +321,65 @@ TEST(MPMCQueueTest, MultiProducerMultiConsumer) {
 
     EXPECT_EQ(sum.load(std::memory_order_relaxed), expected_sum);
 }
+
+// many chunks are retired and recycled, FIFO order must be kept
+TEST(MPMCQueueTest, ChunkReuseKeepsOrder) {
+    constexpr int kRounds = 20;
+    constexpr int kBatch = 3 * xuanqiong::util::CHUNK_SIZE + 17;
+
+    xuanqiong::util::MPMCQueue<int> queue;
+    int next_pop = 0;
+    int next_push = 0;
+    for (int round = 0; round < kRounds; ++round) {
+        for (int i = 0; i < kBatch; ++i) {
+            ASSERT_TRUE(queue.push(next_push++));
+        }
+        int val;
+        for (int i = 0; i < kBatch; ++i) {
+            ASSERT_TRUE(queue.pop(val));
+            ASSERT_EQ(val, next_pop++);
+        }
+        ASSERT_FALSE(queue.pop(val));
+    }
+}
+
+// every value is received exactly once while chunks are reclaimed under
+// contention, run with -DXQ_ENABLE_TSAN=ON to check for data races
+TEST(MPMCQueueTest, StressNoLossNoDuplicate) {
+    constexpr int kNumProducers = 8;
+    constexpr int kNumConsumers = 8;
+    constexpr int kItemsPerProducer = 40000;
+    constexpr int kTotal = kNumProducers * kItemsPerProducer;
+
+    xuanqiong::util::MPMCQueue<std::unique_ptr<int>> queue;
+    std::vector<std::atomic<int>> seen(kTotal);
+    std::atomic<int> total_popped{0};
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kNumProducers; ++i) {
+        threads.emplace_back([&, i]() {
+            for (int j = 0; j < kItemsPerProducer; ++j) {
+                queue.push(std::make_unique<int>(i * kItemsPerProducer + j));
+            }
+        });
+    }
+    for (int i = 0; i < kNumConsumers; ++i) {
+        threads.emplace_back([&]() {
+            std::unique_ptr<int> val;
+            while (total_popped.load(std::memory_order_relaxed) < kTotal) {
+                if (queue.pop(val)) {
+                    seen[*val].fetch_add(1, std::memory_order_relaxed);
+                    total_popped.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    ASSERT_EQ(total_popped, kTotal);
+    for (int i = 0; i < kTotal; ++i) {
+        ASSERT_EQ(seen[i].load(), 1) << "value " << i;
+    }
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net/poll_connection.h"
+#include "scheduler/task.h"
+#include "util/attachment.h"
+
+using namespace xuanqiong;
+using namespace xuanqiong::net;
+
+// the loop of RpcServer::send_fn, counting its rounds. gives up after
+// max_rounds instead of spinning forever
+static Task writer(Connection* conn, int* rounds, int max_rounds) {
+    while (!conn->closed() && *rounds < max_rounds) {
+        co_await WaitWriteAwaiter{conn};
+        co_await conn->async_write();
+        ++*rounds;
+    }
+}
+
+static std::string drain(int fd, size_t size) {
+    std::string data;
+    char buffer[65536];
+    while (data.size() < size) {
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        data.append(buffer, n);
+    }
+    return data;
+}
+
+// a slot open over several tasks: the writer sends what is before it and
+// sleeps, patching the slot wakes it for the rest
+TEST(OutputSlotConnectionTest, WriterSleepsAtOpenSlot) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    PollConnection conn(fds[0], nullptr);
+    auto output_stream = conn.get_output_stream();
+    output_stream.append("head", 4);
+    auto slot = output_stream.reserve_uint32();
+    output_stream.append("body", 4);
+
+    int rounds = 0;
+    auto task = writer(&conn, &rounds, 100);
+    // one round sent the head, the next one waits for the slot
+    EXPECT_EQ(rounds, 1);
+    EXPECT_FALSE(task.done());
+    EXPECT_EQ(drain(fds[1], 4), "head");
+    EXPECT_EQ(conn.write_bytes(), 8u);
+
+    // the task appending to the payload later, then patching the slot
+    output_stream.append("more", 4);
+    EXPECT_EQ(rounds, 1);
+    EXPECT_EQ(conn.patch_length(slot), 8u);
+    EXPECT_EQ(rounds, 2);
+    EXPECT_EQ(conn.write_bytes(), 0u);
+    uint32_t len = 8;
+    EXPECT_EQ(drain(fds[1], 12), std::string(reinterpret_cast<char*>(&len), 4) + "bodymore");
+
+    conn.close();
+    conn.resume_write();
+    EXPECT_TRUE(task.done());
+    ::close(fds[1]);
+}
+
+// an attachment ending on a block boundary leaves a full last block. the
+// slot reserved after it must not sit in that block, which is freed once sent
+TEST(OutputSlotConnectionTest, SlotAfterFullAttachmentBlock) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    PollConnection conn(fds[0], nullptr);
+    auto output_stream = conn.get_output_stream();
+    output_stream.append("head", 4);
+    std::string payload(util::kBlockSize, 'p');
+    util::Attachment attachment;
+    attachment.append(payload.data(), payload.size());
+    output_stream.append(std::move(attachment));
+    auto slot = output_stream.reserve_uint32();
+    output_stream.append("body", 4);
+
+    int rounds = 0;
+    auto task = writer(&conn, &rounds, 100);
+    // head and the whole attachment went out, its block is gone
+    EXPECT_EQ(drain(fds[1], 4 + payload.size()), "head" + payload);
+    EXPECT_EQ(conn.write_bytes(), 8u);
+
+    EXPECT_EQ(conn.patch_length(slot), 4u);
+    EXPECT_EQ(conn.write_bytes(), 0u);
+    uint32_t len = 4;
+    EXPECT_EQ(drain(fds[1], 8), std::string(reinterpret_cast<char*>(&len), 4) + "body");
+
+    conn.close();
+    conn.resume_write();
+    EXPECT_TRUE(task.done());
+    ::close(fds[1]);
+}
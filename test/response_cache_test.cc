@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "util/response_cache.h"
+
+using namespace xuanqiong::util;
+
+constexpr int64_t kTtl = 1000;
+
+TEST(ResponseCacheTest, HitUntilExpired) {
+    ResponseCache cache(1 << 20);
+    EXPECT_EQ(cache.find("key", 0), nullptr);
+    cache.insert("key", "value", 0, kTtl);
+    auto value = cache.find("key", kTtl - 1);
+    ASSERT_NE(value, nullptr);
+    EXPECT_EQ(*value, "value");
+    EXPECT_EQ(cache.find("key", kTtl), nullptr);
+
+    const auto& stats = cache.stats();
+    EXPECT_EQ(stats.hits.load(), 1u);
+    EXPECT_EQ(stats.misses.load(), 2u);
+    EXPECT_EQ(stats.expirations.load(), 1u);
+    EXPECT_EQ(stats.entries.load(), 0u);
+    EXPECT_EQ(stats.bytes.load(), 0u);
+}
+
+TEST(ResponseCacheTest, InsertReplaces) {
+    ResponseCache cache(1 << 20);
+    cache.insert("key", "old", 0, kTtl);
+    cache.insert("key", "new", 0, kTtl);
+    ASSERT_NE(cache.find("key", 0), nullptr);
+    EXPECT_EQ(*cache.find("key", 0), "new");
+    EXPECT_EQ(cache.stats().entries.load(), 1u);
+}
+
+TEST(ResponseCacheTest, EvictsLeastRecentlyUsed) {
+    std::string value(1000, 'x');
+    // room for three entries, not four
+    ResponseCache cache(3 * 1200);
+    cache.insert("a", value, 0, kTtl);
+    cache.insert("b", value, 0, kTtl);
+    cache.insert("c", value, 0, kTtl);
+    // a is used again, b is now the oldest
+    EXPECT_NE(cache.find("a", 0), nullptr);
+    cache.insert("d", value, 0, kTtl);
+
+    EXPECT_NE(cache.find("a", 0), nullptr);
+    EXPECT_EQ(cache.find("b", 0), nullptr);
+    EXPECT_NE(cache.find("c", 0), nullptr);
+    EXPECT_NE(cache.find("d", 0), nullptr);
+    EXPECT_EQ(cache.stats().evictions.load(), 1u);
+    EXPECT_EQ(cache.stats().entries.load(), 3u);
+    EXPECT_LE(cache.stats().bytes.load(), 3u * 1200);
+}
+
+TEST(ResponseCacheTest, SkipsValuesLargerThanTheCache) {
+    ResponseCache cache(1024);
+    cache.insert("small", "value", 0, kTtl);
+    cache.insert("large", std::string(4096, 'x'), 0, kTtl);
+    EXPECT_EQ(cache.find("large", 0), nullptr);
+    // nothing was evicted to make room for it
+    EXPECT_NE(cache.find("small", 0), nullptr);
+    EXPECT_EQ(cache.stats().evictions.load(), 0u);
+}
+
+TEST(ResponseCacheTest, KeysAreBinary) {
+    ResponseCache cache(1 << 20);
+    std::string key1("k\0a", 3), key2("k\0b", 3);
+    cache.insert(key1, "1", 0, kTtl);
+    cache.insert(key2, "2", 0, kTtl);
+    EXPECT_EQ(*cache.find(key1, 0), "1");
+    EXPECT_EQ(*cache.find(key2, 0), "2");
+}
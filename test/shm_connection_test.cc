@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+#include <coroutine>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net/shm_connection.h"
+
+using namespace xuanqiong;
+using namespace xuanqiong::net;
+
+class ShmConnectionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        int fds[2];
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+        client_ = std::make_unique<ShmConnection>(fds[0], nullptr);
+        server_ = std::make_unique<ShmConnection>(fds[1], nullptr);
+        // no coroutines here, a close must have something to resume
+        client_->set_write_handle(std::noop_coroutine().address());
+        server_->set_write_handle(std::noop_coroutine().address());
+    }
+
+    static void append(ShmConnection* conn, const std::string& data) {
+        conn->get_output_stream().append(data.data(), data.size());
+    }
+
+    static std::string take(ShmConnection* conn) {
+        std::string data(conn->read_bytes(), '\0');
+        auto input_stream = conn->get_input_stream();
+        size_t offset = 0;
+        const void* chunk;
+        int size;
+        while (offset < data.size() && input_stream.Next(&chunk, &size)) {
+            memcpy(data.data() + offset, chunk, size);
+            offset += size;
+        }
+        return data;
+    }
+
+    // doorbell bytes waiting on the socket of conn
+    static bool has_doorbell(ShmConnection* conn) {
+        char byte;
+        return recv(conn->fd(), &byte, 1, MSG_DONTWAIT | MSG_PEEK) == 1;
+    }
+
+    std::unique_ptr<ShmConnection> client_;
+    std::unique_ptr<ShmConnection> server_;
+};
+
+TEST_F(ShmConnectionTest, AttachesOnFirstRead) {
+    ASSERT_TRUE(client_->connect(4096));
+    append(client_.get(), "hello");
+    EXPECT_FALSE(client_->async_write().should_suspend);
+    EXPECT_EQ(client_->write_bytes(), 0u);
+
+    EXPECT_FALSE(server_->attached());
+    EXPECT_FALSE(server_->async_read().should_suspend);
+    EXPECT_TRUE(server_->attached());
+    EXPECT_EQ(take(server_.get()), "hello");
+    // the server was not asleep, nothing to wake
+    EXPECT_FALSE(has_doorbell(server_.get()));
+
+    append(server_.get(), "world");
+    EXPECT_FALSE(server_->async_write().should_suspend);
+    EXPECT_FALSE(client_->async_read().should_suspend);
+    EXPECT_EQ(take(client_.get()), "world");
+}
+
+TEST_F(ShmConnectionTest, DoorbellOnlyForSleepingReader) {
+    ASSERT_TRUE(client_->connect(4096));
+    EXPECT_TRUE(server_->async_read().should_suspend);
+
+    append(client_.get(), "ping");
+    client_->async_write();
+    EXPECT_TRUE(has_doorbell(server_.get()));
+    server_->async_read();
+    EXPECT_EQ(take(server_.get()), "ping");
+}
+
+TEST_F(ShmConnectionTest, FullRingBlocksWriterAndWraps) {
+    ASSERT_TRUE(client_->connect(4096));
+    std::string data;
+    for (int i = 0; data.size() < 10000; ++i) {
+        data += std::to_string(i) + ",";
+    }
+    append(client_.get(), data);
+    EXPECT_TRUE(client_->async_write().should_suspend);
+    EXPECT_EQ(client_->write_bytes(), data.size() - 4096);
+
+    std::string received;
+    while (received.size() < data.size()) {
+        EXPECT_FALSE(server_->async_read().should_suspend);
+        received += take(server_.get());
+        // the reader freed space for a writer which asked for it
+        if (client_->write_bytes() > 0) {
+            EXPECT_TRUE(has_doorbell(client_.get()));
+            client_->async_write();
+        }
+    }
+    EXPECT_EQ(received, data);
+}
+
+TEST_F(ShmConnectionTest, RejectsHandshakeWithoutRings) {
+    ASSERT_EQ(send(client_->fd(), "not a handshake!", 16, 0), 16);
+    server_->async_read();
+    EXPECT_TRUE(server_->closed());
+}
+
+TEST_F(ShmConnectionTest, RejectsBadRingSize) {
+    EXPECT_FALSE(client_->connect(5000));
+    EXPECT_FALSE(client_->connect(1024));
+}
+
+// a memfd passed over the socket, with the bytes sent along with it
+static int recv_fd(int sockfd, std::string* data) {
+    char buffer[64];
+    struct iovec iov{buffer, sizeof(buffer)};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(sockfd, &msg, 0);
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    if (n <= 0 || !cmsg || cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    data->assign(buffer, n);
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+static bool send_fd(int sockfd, const std::string& data, int fd) {
+    struct iovec iov{const_cast<char*>(data.data()), data.size()};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return sendmsg(sockfd, &msg, 0) == static_cast<ssize_t>(data.size());
+}
+
+// a client could truncate a segment it did not seal while the server has it
+// mapped. the same handshake with an unsealed copy of the memfd is rejected
+TEST_F(ShmConnectionTest, RejectsHandshakeWithoutSeals) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    ShmConnection real_client(fds[0], nullptr);
+    ASSERT_TRUE(real_client.connect(4096));
+    std::string hello;
+    int sealed = recv_fd(fds[1], &hello);
+    ASSERT_GE(sealed, 0);
+    EXPECT_EQ(fcntl(sealed, F_GET_SEALS) & (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL),
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    struct stat st;
+    ASSERT_EQ(fstat(sealed, &st), 0);
+    std::string contents(st.st_size, '\0');
+    ASSERT_EQ(pread(sealed, contents.data(), contents.size(), 0), st.st_size);
+    int unsealed = memfd_create("xq-shm-test", MFD_CLOEXEC);
+    ASSERT_GE(unsealed, 0);
+    ASSERT_EQ(pwrite(unsealed, contents.data(), contents.size(), 0), st.st_size);
+
+    ASSERT_TRUE(send_fd(client_->fd(), hello, unsealed));
+    server_->async_read();
+    EXPECT_TRUE(server_->closed());
+    EXPECT_FALSE(server_->attached());
+
+    ::close(sealed);
+    ::close(unsealed);
+    ::close(fds[1]);
+}
@@ -0,0 +1,270 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "client/client_channel.h"
+#include "example/echo.pb.h"
+#include "proto/message.pb.h"
+#include "server/rpc_server.h"
+#include "util/service.h"
+
+using namespace xuanqiong;
+
+constexpr static int kDrainPort = 18892;
+constexpr static int kForcePort = 18893;
+constexpr static int kStreamPort = 18896;
+
+// Echo answers with reply_size bytes when set, Echo1 holds its executor
+// for a while so a call is in flight when the shutdown begins
+class BulkEchoService : public EchoService {
+public:
+    void Echo(google::protobuf::RpcController*, const EchoRequest* request,
+              EchoResponse* response, google::protobuf::Closure*) override {
+        if (reply_size > 0) {
+            response->set_message(std::string(reply_size, 'x'));
+        } else {
+            response->set_message(request->message());
+        }
+    }
+
+    void Echo1(google::protobuf::RpcController*, const EchoRequest* request,
+               EchoResponse* response, google::protobuf::Closure*) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        response->set_message(request->message());
+    }
+
+    size_t reply_size = 0;
+};
+
+static int connect_to(int port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < 500; ++i) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+            return fd;
+        }
+        ::close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+// answers every message until the client finishes
+static Task chat(std::shared_ptr<Stream> stream) {
+    EchoRequest request;
+    EchoResponse response;
+    while (co_await stream->read(&request)) {
+        response.set_message(request.message());
+        if (!co_await stream->write(response)) {
+            co_return;
+        }
+    }
+    stream->finish();
+}
+
+// a server on its own thread, shut down by the test
+class ShutdownTest : public ::testing::Test {
+protected:
+    void start_server(int port) {
+        RpcServerOptions options(port);
+        options.sched_policy = SchedPolicy::POLL_POLICY;
+        options.poll_timeout = 1000;
+        options.enable_stats = false;
+        server_ = std::make_unique<RpcServer>(options);
+        server_->register_service("EchoService", &service_);
+        server_->register_stream("EchoService", "Chat", chat);
+        server_thread_ = std::thread([this]() { server_->start(); });
+        // listening once a connection goes through
+        int fd = connect_to(port);
+        ASSERT_GE(fd, 0);
+        ::close(fd);
+    }
+
+    void TearDown() override {
+        if (server_thread_.joinable()) {
+            server_thread_.join();
+        }
+    }
+
+    BulkEchoService service_;
+    std::unique_ptr<RpcServer> server_;
+    std::thread server_thread_;
+};
+
+struct PendingCall {
+    EchoResponse response;
+    RpcController* controller = new RpcController;
+    std::promise<std::pair<int32_t, std::string>> promise;
+
+    void finish() {
+        promise.set_value({controller->ErrorCode(), response.message()});
+    }
+};
+
+static std::future<std::pair<int32_t, std::string>> call(ClientChannel* channel, bool echo1,
+                                                         PendingCall* pending) {
+    EchoService_Stub stub(channel);
+    auto request = new EchoRequest;
+    request->set_message("hello");
+    auto done = google::protobuf::NewCallback(pending, &PendingCall::finish);
+    if (echo1) {
+        stub.Echo1(pending->controller, request, &pending->response, done);
+    } else {
+        stub.Echo(pending->controller, request, &pending->response, done);
+    }
+    return pending->promise.get_future();
+}
+
+// the call in flight is answered, the client learns of the GOAWAY and new
+// calls fail fast, the connection closes as drained
+TEST_F(ShutdownTest, AnswersInFlightCallThenDrains) {
+    start_server(kDrainPort);
+    Scheduler scheduler(SchedulerOptions(1000, SchedPolicy::POLL_POLICY));
+    ClientOptions client_options;
+    client_options.ip = "127.0.0.1";
+    client_options.port = kDrainPort;
+    ClientChannel channel(client_options, scheduler.alloc_executor());
+
+    PendingCall warmup;
+    ASSERT_EQ(call(&channel, false, &warmup).get().first, 0);
+
+    PendingCall slow;
+    auto slow_result = call(&channel, true, &slow);
+    // the handler is running when the shutdown begins
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    auto report = server_->shutdown(std::chrono::seconds(5));
+    EXPECT_EQ(report.connections, 1u);
+    EXPECT_EQ(report.drained, 1u);
+    EXPECT_EQ(report.dropped, 0u);
+
+    ASSERT_EQ(slow_result.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    auto [status, message] = slow_result.get();
+    EXPECT_EQ(status, 0);
+    EXPECT_EQ(message, "hello");
+    // the GOAWAY follows the response on the wire
+    for (int i = 0; i < 500 && !channel.goaway(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_TRUE(channel.goaway());
+
+    PendingCall late;
+    auto late_result = call(&channel, false, &late);
+    ASSERT_EQ(late_result.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(late_result.get().first, proto::StatusCode::UNAVAILABLE);
+
+    channel.close();
+    scheduler.stop();
+}
+
+// a peer that never reads its response keeps the connection busy past the
+// deadline. it is dropped and closed, and shutdown returns
+TEST_F(ShutdownTest, ClosesPeerThatDoesNotRead) {
+    service_.reply_size = 16 << 20;
+    start_server(kForcePort);
+    int fd = connect_to(kForcePort);
+    ASSERT_GE(fd, 0);
+
+    proto::Header header;
+    header.set_magic(MAGIC_NUM);
+    header.set_version(VERSION);
+    header.set_message_type(proto::MessageType::REQUEST);
+    header.set_request_id(1);
+    header.set_service_name("EchoService");
+    header.set_method_name("Echo");
+    EchoRequest request;
+    request.set_message("big");
+    std::string frame;
+    uint32_t len = header.ByteSizeLong();
+    frame.append(reinterpret_cast<char*>(&len), sizeof(len));
+    frame += header.SerializeAsString();
+    len = request.ByteSizeLong();
+    frame.append(reinterpret_cast<char*>(&len), sizeof(len));
+    frame += request.SerializeAsString();
+    ASSERT_EQ(::write(fd, frame.data(), frame.size()), (ssize_t)frame.size());
+    // the response fills both socket buffers, its writer waits for us
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    auto start = std::chrono::steady_clock::now();
+    auto report = server_->shutdown(std::chrono::milliseconds(100));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(3));
+    EXPECT_EQ(report.dropped, 1u);
+    EXPECT_GT(report.unflushed_bytes, 0u);
+
+    // what was written arrives, then the end of the stream
+    timeval timeout{5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char buffer[65536];
+    ssize_t n;
+    while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+    }
+    EXPECT_EQ(n, 0);
+    ::close(fd);
+}
+
+struct StreamResult {
+    std::vector<std::string> replies;
+    int32_t status = -1;
+};
+
+// one message before the shutdown begins, one while it runs, then the end
+static Task chat_client(ClientChannel* channel, StreamResult* result, std::promise<void>* opened,
+                        std::promise<void>* done) {
+    auto stream = channel->open_stream("EchoService", "Chat");
+    EchoRequest request;
+    EchoResponse response;
+    for (auto message : {"before", "during"}) {
+        request.set_message(message);
+        if (!co_await stream->write(request) || !co_await stream->read(&response)) {
+            break;
+        }
+        result->replies.push_back(response.message());
+        if (result->replies.size() == 1) {
+            opened->set_value();
+            // the stream sits between frames while the drain checks it
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+    }
+    stream->finish();
+    while (co_await stream->read(&response)) {}
+    result->status = stream->status();
+    done->set_value();
+}
+
+// an open stream between frames is not idle, the drain waits for its end
+TEST_F(ShutdownTest, WaitsForOpenStream) {
+    start_server(kStreamPort);
+    Scheduler scheduler(SchedulerOptions(1000, SchedPolicy::POLL_POLICY));
+    auto executor = scheduler.alloc_executor();
+    ClientOptions client_options;
+    client_options.ip = "127.0.0.1";
+    client_options.port = kStreamPort;
+    ClientChannel channel(client_options, executor);
+
+    StreamResult result;
+    std::promise<void> opened;
+    std::promise<void> done;
+    executor->spawn([&]() { chat_client(&channel, &result, &opened, &done); });
+    ASSERT_EQ(opened.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    auto report = server_->shutdown(std::chrono::seconds(5));
+    EXPECT_EQ(report.connections, 1u);
+    EXPECT_EQ(report.drained, 1u);
+    EXPECT_EQ(report.dropped, 0u);
+
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(result.replies, (std::vector<std::string>{"before", "during"}));
+    EXPECT_EQ(result.status, 0);
+
+    channel.close();
+    scheduler.stop();
+}
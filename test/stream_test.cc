@@ -0,0 +1,276 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "proto/message.pb.h"
+#include "test/test_server.h"
+
+using namespace xuanqiong;
+
+// pages of 1KiB, four times the window of a stream
+constexpr static int kPages = 1024;
+
+// handler side observations, written on the server executor
+static std::atomic<int> pages_written{0};
+static std::promise<std::pair<int32_t, bool>> aborted_by_client;
+static std::promise<int32_t> held_reset;
+
+// answers every message until the client finishes
+static Task chat(std::shared_ptr<Stream> stream) {
+    EchoRequest request;
+    EchoResponse response;
+    while (co_await stream->read(&request)) {
+        response.set_message("[Chat] " + request.message());
+        if (!co_await stream->write(response)) {
+            co_return;
+        }
+    }
+    stream->finish();
+}
+
+// one request holding a count, then that many pages
+static Task pages(std::shared_ptr<Stream> stream) {
+    EchoRequest request;
+    if (!co_await stream->read(&request)) {
+        co_return;
+    }
+    int count = std::atoi(request.message().c_str());
+    EchoResponse response;
+    for (int i = 0; i < count; ++i) {
+        response.set_message(std::string(1024, 'a' + i % 26));
+        if (!co_await stream->write(response)) {
+            co_return;
+        }
+        pages_written.fetch_add(1);
+    }
+    stream->finish();
+}
+
+// rejects the first message with a status of its own
+static Task reject(std::shared_ptr<Stream> stream) {
+    EchoRequest request;
+    if (co_await stream->read(&request)) {
+        stream->finish(proto::StatusCode::HANDLER_FAILED, "rejected " + request.message());
+    }
+}
+
+// waits for the client, which aborts, then tries to answer
+static Task abortee(std::shared_ptr<Stream> stream) {
+    EchoRequest request;
+    while (co_await stream->read(&request)) {}
+    EchoResponse response;
+    bool wrote = co_await stream->write(response);
+    aborted_by_client.set_value({stream->status(), wrote});
+}
+
+// never finishes, reports how the stream ended
+static Task hold(std::shared_ptr<Stream> stream) {
+    EchoRequest request;
+    while (co_await stream->read(&request)) {}
+    held_reset.set_value(stream->status());
+}
+
+class StreamTest : public RpcTest {
+protected:
+    static void SetUpTestSuite() {
+        start_server([](RpcServer* server) {
+            server->register_stream("EchoService", "Chat", chat);
+            server->register_stream("EchoService", "Pages", pages);
+            server->register_stream("EchoService", "Reject", reject);
+            server->register_stream("EchoService", "Abort", abortee);
+            server->register_stream("EchoService", "Hold", hold);
+        });
+    }
+
+    // run body as a coroutine on the client executor and wait for it
+    template <typename F>
+    void run(F body) {
+        std::promise<void> done;
+        executor_->spawn([this, &body, &done]() { body(channel_, &done); });
+        ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    }
+};
+
+struct ChatResult {
+    std::vector<std::string> replies;
+    bool more = true;
+    int32_t status = -1;
+};
+
+static Task chat_client(ClientChannel* channel, ChatResult* result, std::promise<void>* done) {
+    auto stream = channel->open_stream("EchoService", "Chat");
+    EchoRequest request;
+    EchoResponse response;
+    for (int i = 0; i < 3; ++i) {
+        request.set_message(std::to_string(i));
+        if (!co_await stream->write(request) || !co_await stream->read(&response)) {
+            break;
+        }
+        result->replies.push_back(response.message());
+    }
+    stream->finish();
+    // the server finishes after us, with OK
+    result->more = co_await stream->read(&response);
+    result->status = stream->status();
+    done->set_value();
+}
+
+TEST_F(StreamTest, DataThenEndBothWays) {
+    ChatResult result;
+    run([&](ClientChannel* channel, std::promise<void>* done) { chat_client(channel, &result, done); });
+    EXPECT_EQ(result.replies, (std::vector<std::string>{"[Chat] 0", "[Chat] 1", "[Chat] 2"}));
+    EXPECT_FALSE(result.more);
+    EXPECT_EQ(result.status, 0);
+}
+
+struct PagesResult {
+    std::shared_ptr<Stream> stream;
+    int received = 0;
+    bool intact = true;
+    int32_t status = -1;
+};
+
+static Task ask_pages(ClientChannel* channel, PagesResult* result, std::promise<void>* done) {
+    result->stream = channel->open_stream("EchoService", "Pages");
+    EchoRequest request;
+    request.set_message(std::to_string(kPages));
+    co_await result->stream->write(request);
+    result->stream->finish();
+    done->set_value();
+}
+
+static Task read_pages(PagesResult* result, std::promise<void>* done) {
+    EchoResponse response;
+    while (co_await result->stream->read(&response)) {
+        result->intact = result->intact &&
+            response.message() == std::string(1024, 'a' + result->received % 26);
+        ++result->received;
+    }
+    result->status = result->stream->status();
+    result->stream.reset();
+    done->set_value();
+}
+
+TEST_F(StreamTest, WindowStopsWriterUntilRead) {
+    pages_written = 0;
+    PagesResult result;
+    run([&](ClientChannel* channel, std::promise<void>* done) { ask_pages(channel, &result, done); });
+    // not reading: the server stops once the window is spent
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    int written = pages_written.load();
+    // a window holds 256 pages of body, each frame a few bytes more
+    EXPECT_GT(written, 0);
+    EXPECT_LE(written, int(kStreamWindow / 1024));
+
+    // reading grants the window back, the rest follows
+    run([&](ClientChannel*, std::promise<void>* done) { read_pages(&result, done); });
+    EXPECT_EQ(result.received, kPages);
+    EXPECT_TRUE(result.intact);
+    EXPECT_EQ(result.status, 0);
+    EXPECT_EQ(pages_written.load(), kPages);
+}
+
+struct AbortResult {
+    bool read = true;
+    bool wrote = true;
+    int32_t status = -1;
+    std::string error_text;
+};
+
+static Task reject_client(ClientChannel* channel, AbortResult* result, std::promise<void>* done) {
+    auto stream = channel->open_stream("EchoService", "Reject");
+    EchoRequest request;
+    request.set_message("this");
+    co_await stream->write(request);
+    EchoResponse response;
+    result->read = co_await stream->read(&response);
+    result->status = stream->status();
+    result->error_text = stream->error_text();
+    // our direction ended with theirs
+    result->wrote = co_await stream->write(request);
+    done->set_value();
+}
+
+TEST_F(StreamTest, ServerAbortEndsBothDirections) {
+    AbortResult result;
+    run([&](ClientChannel* channel, std::promise<void>* done) { reject_client(channel, &result, done); });
+    EXPECT_FALSE(result.read);
+    EXPECT_EQ(result.status, proto::StatusCode::HANDLER_FAILED);
+    EXPECT_EQ(result.error_text, "rejected this");
+    EXPECT_FALSE(result.wrote);
+}
+
+static Task abort_client(ClientChannel* channel, AbortResult* result, std::promise<void>* done) {
+    auto stream = channel->open_stream("EchoService", "Abort");
+    EchoRequest request;
+    co_await stream->write(request);
+    stream->finish(proto::StatusCode::CANCELED, "changed my mind");
+    EchoResponse response;
+    result->read = co_await stream->read(&response);
+    done->set_value();
+}
+
+TEST_F(StreamTest, ClientAbortEndsBothDirections) {
+    aborted_by_client = {};
+    auto server_side = aborted_by_client.get_future();
+    AbortResult result;
+    run([&](ClientChannel* channel, std::promise<void>* done) { abort_client(channel, &result, done); });
+    EXPECT_FALSE(result.read);
+    ASSERT_EQ(server_side.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    auto [status, wrote] = server_side.get();
+    EXPECT_EQ(status, proto::StatusCode::CANCELED);
+    EXPECT_FALSE(wrote);
+}
+
+static Task unknown_client(ClientChannel* channel, AbortResult* result, std::promise<void>* done) {
+    auto stream = channel->open_stream("EchoService", "Nope");
+    EchoResponse response;
+    result->read = co_await stream->read(&response);
+    result->status = stream->status();
+    done->set_value();
+}
+
+TEST_F(StreamTest, UnregisteredStreamFailsWithUnknownMethod) {
+    AbortResult result;
+    run([&](ClientChannel* channel, std::promise<void>* done) { unknown_client(channel, &result, done); });
+    EXPECT_FALSE(result.read);
+    EXPECT_EQ(result.status, proto::StatusCode::UNKNOWN_METHOD);
+}
+
+static Task hold_client(ClientChannel* channel, AbortResult* result, std::promise<void>* opened,
+                        std::promise<void>* done) {
+    auto stream = channel->open_stream("EchoService", "Hold");
+    EchoRequest request;
+    co_await stream->write(request);
+    opened->set_value();
+    EchoResponse response;
+    result->read = co_await stream->read(&response);
+    result->status = stream->status();
+    done->set_value();
+}
+
+TEST_F(StreamTest, ConnectionCloseResetsBothEnds) {
+    held_reset = {};
+    auto server_side = held_reset.get_future();
+    AbortResult result;
+    std::promise<void> opened;
+    std::promise<void> done;
+    executor_->spawn([this, &result, &opened, &done]() {
+        hold_client(channel_, &result, &opened, &done);
+    });
+    ASSERT_EQ(opened.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    // the handler has the stream once its first message arrived
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    channel_->close();
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_FALSE(result.read);
+    EXPECT_EQ(result.status, proto::StatusCode::UNAVAILABLE);
+    ASSERT_EQ(server_side.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(server_side.get(), proto::StatusCode::UNAVAILABLE);
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include <coroutine>
+#include <string>
+#include <vector>
+
+#include "scheduler/task.h"
+#include "util/frame_pool.h"
+
+using namespace xuanqiong;
+
+// suspends and leaves the handle for the test to resume
+struct Park {
+    std::coroutine_handle<>* slot;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) noexcept { *slot = handle; }
+    void await_resume() const noexcept {}
+};
+
+struct Flag {
+    bool* set;
+    ~Flag() { *set = true; }
+};
+
+static Task parked(std::coroutine_handle<>* slot, bool* destroyed) {
+    Flag flag{destroyed};
+    co_await Park{slot};
+}
+
+TEST(TaskTest, DetachedTaskFreesFrameWhenDone) {
+    std::coroutine_handle<> handle;
+    bool destroyed = false;
+    parked(&handle, &destroyed);
+    ASSERT_TRUE(handle);
+    EXPECT_FALSE(destroyed);
+    Resumer::resume(handle);
+    EXPECT_TRUE(destroyed);
+}
+
+TEST(TaskTest, HeldTaskKeepsFrameUntilDropped) {
+    std::coroutine_handle<> handle;
+    bool destroyed = false;
+    {
+        auto task = parked(&handle, &destroyed);
+        EXPECT_FALSE(task.done());
+        Resumer::resume(handle);
+        EXPECT_TRUE(task.done());
+        // locals of the coroutine are gone, its frame is not
+        EXPECT_TRUE(destroyed);
+    }
+}
+
+static Task child(std::coroutine_handle<>* slot, std::vector<std::string>* steps) {
+    steps->push_back("child start");
+    co_await Park{slot};
+    steps->push_back("child done");
+}
+
+static Task parent(std::coroutine_handle<>* slot, std::vector<std::string>* steps) {
+    co_await child(slot, steps);
+    steps->push_back("parent resumed");
+}
+
+TEST(TaskTest, AwaitJoinsChild) {
+    std::coroutine_handle<> handle;
+    std::vector<std::string> steps;
+    auto task = parent(&handle, &steps);
+    EXPECT_EQ(steps, std::vector<std::string>{"child start"});
+    Resumer::resume(handle);
+    EXPECT_EQ(steps, (std::vector<std::string>{"child start", "child done", "parent resumed"}));
+    EXPECT_TRUE(task.done());
+}
+
+static Task finished_child(std::vector<std::string>* steps) {
+    steps->push_back("child");
+    co_return;
+}
+
+static Task finished_parent(std::vector<std::string>* steps) {
+    co_await finished_child(steps);
+    steps->push_back("parent");
+}
+
+TEST(TaskTest, AwaitFinishedChildDoesNotSuspend) {
+    std::vector<std::string> steps;
+    auto task = finished_parent(&steps);
+    EXPECT_TRUE(task.done());
+    EXPECT_EQ(steps, (std::vector<std::string>{"child", "parent"}));
+}
+
+static Task waker(std::coroutine_handle<>* self, std::coroutine_handle<> other,
+                  std::vector<std::string>* steps) {
+    co_await Park{self};
+    steps->push_back("waker resumed");
+    // queued, not run inside this coroutine
+    Resumer::resume(other);
+    Resumer::resume(other);
+    steps->push_back("waker done");
+}
+
+static Task sleeper(std::coroutine_handle<>* self, std::vector<std::string>* steps) {
+    co_await Park{self};
+    steps->push_back("sleeper resumed");
+}
+
+TEST(ResumerTest, WakeFromCoroutineRunsAfterItSuspends) {
+    std::vector<std::string> steps;
+    std::coroutine_handle<> sleeper_handle, waker_handle;
+    auto sleeping = sleeper(&sleeper_handle, &steps);
+    auto waking = waker(&waker_handle, sleeper_handle, &steps);
+    Resumer::resume(waker_handle);
+    EXPECT_EQ(steps, (std::vector<std::string>{"waker resumed", "waker done", "sleeper resumed"}));
+    EXPECT_TRUE(sleeping.done());
+    EXPECT_TRUE(waking.done());
+}
+
+TEST(ResumerTest, RunDrainsQueuedResumes) {
+    std::vector<std::string> steps;
+    std::coroutine_handle<> handle;
+    auto task = sleeper(&handle, &steps);
+    Resumer::run([&] {
+        Resumer::resume(handle);
+        steps.push_back("task done");
+    });
+    EXPECT_EQ(steps, (std::vector<std::string>{"task done", "sleeper resumed"}));
+}
+
+static Task noop() {
+    co_return;
+}
+
+TEST(FramePoolTest, FramesAreReused) {
+    noop();
+    auto allocated = util::FramePool::allocated();
+    auto reused = util::FramePool::reused();
+    for (int i = 0; i < 10; ++i) {
+        noop();
+    }
+    EXPECT_EQ(util::FramePool::allocated() - allocated, 10u);
+    EXPECT_EQ(util::FramePool::reused() - reused, 10u);
+}
+
+TEST(FramePoolTest, LargeBlocksBypassPool) {
+    auto reused = util::FramePool::reused();
+    void* ptr = util::FramePool::allocate(util::kMaxPooledFrame + 1);
+    util::FramePool::deallocate(ptr, util::kMaxPooledFrame + 1);
+    ptr = util::FramePool::allocate(util::kMaxPooledFrame + 1);
+    util::FramePool::deallocate(ptr, util::kMaxPooledFrame + 1);
+    EXPECT_EQ(util::FramePool::reused(), reused);
+}
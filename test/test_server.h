@@ -0,0 +1,131 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "client/client_channel.h"
+#include "example/echo.pb.h"
+#include "server/rpc_server.h"
+#include "util/service.h"
+
+namespace xuanqiong {
+
+// outcome of one echo call, as the controller and response left it
+struct CallResult {
+    bool failed = false;
+    int32_t code = -1;
+    std::string error_text;
+    std::string message;
+};
+
+// done of call(), deletes itself once run. kept off the caller's stack, so
+// a call that finishes after the caller gave up does not touch freed memory
+struct PendingCall : public google::protobuf::Closure {
+    EchoResponse response;
+    // deleted by the channel after done
+    RpcController* controller = new RpcController;
+    std::promise<CallResult> promise;
+
+    void Run() override {
+        promise.set_value({controller->Failed(), controller->ErrorCode(), controller->ErrorText(),
+                           response.message()});
+        delete this;
+    }
+};
+
+// one EchoRequest carrying message through channel, a failure of the test
+// if it does not finish within 5s
+inline CallResult call(google::protobuf::RpcChannel* channel,
+                       const google::protobuf::MethodDescriptor* method,
+                       const std::string& message) {
+    auto pending = new PendingCall;
+    auto future = pending->promise.get_future();
+    auto request = new EchoRequest;
+    request->set_message(message);
+    channel->CallMethod(method, pending->controller, request, &pending->response, pending);
+    if (future.wait_for(std::chrono::seconds(5)) != std::future_status::ready) {
+        ADD_FAILURE() << "no response for " << method->full_name();
+        return {};
+    }
+    return future.get();
+}
+
+inline CallResult call(google::protobuf::RpcChannel* channel, const std::string& method_name,
+                       const std::string& message) {
+    return call(channel, EchoService::descriptor()->FindMethodByName(method_name), message);
+}
+
+// one server per test suite on an abstract unix socket of its own, a client
+// scheduler and channel per test. a suite registers its services and
+// streams in SetUpTestSuite through start_server()
+class RpcTest : public ::testing::Test {
+protected:
+    static void start_server(const std::function<void(RpcServer*)>& configure,
+                             int num_executors = 1) {
+        static std::atomic<int> next_id{0};
+        endpoint_ = std::format("unix-abstract:xq-test-{}-{}", ::getpid(), next_id++);
+        RpcServerOptions options(0);
+        options.endpoints = {endpoint_};
+        options.sched_policy = SchedPolicy::POLL_POLICY;
+        options.poll_timeout = 1000;
+        options.num_executors = num_executors;
+        options.enable_stats = false;
+        server_ = new RpcServer(options);
+        configure(server_);
+        server_thread_ = std::thread([]() { server_->start(); });
+    }
+
+    static void TearDownTestSuite() {
+        if (!server_) {
+            return;
+        }
+        server_->shutdown(std::chrono::seconds(1));
+        server_thread_.join();
+        delete server_;
+        server_ = nullptr;
+    }
+
+    void SetUp() override {
+        scheduler_ = std::make_unique<Scheduler>(SchedulerOptions(1000, SchedPolicy::POLL_POLICY));
+        executor_ = scheduler_->alloc_executor();
+        channel_ = connect();
+    }
+
+    void TearDown() override {
+        for (auto& channel : channels_) {
+            channel->close();
+        }
+        scheduler_->stop();
+        scheduler_->join();
+        channels_.clear();
+        scheduler_.reset();
+    }
+
+    // another connection to the server, on the same client executor
+    ClientChannel* connect() {
+        ClientOptions client_options;
+        client_options.endpoint = endpoint_;
+        channels_.push_back(std::make_unique<ClientChannel>(client_options, executor_));
+        return channels_.back().get();
+    }
+
+    static inline RpcServer* server_ = nullptr;
+    static inline std::thread server_thread_;
+    static inline std::string endpoint_;
+
+    std::unique_ptr<Scheduler> scheduler_;
+    Executor* executor_ = nullptr;
+    std::vector<std::unique_ptr<ClientChannel>> channels_;
+    ClientChannel* channel_ = nullptr;
+};
+
+} // namespace xuanqiong
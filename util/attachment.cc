@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "util/attachment.h"
+
+namespace xuanqiong::util {
+
+Attachment::~Attachment() {
+    clear();
+}
+
+Attachment::Attachment(Attachment&& other) noexcept
+    : first_block_(std::exchange(other.first_block_, nullptr)),
+      last_block_(std::exchange(other.last_block_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {}
+
+Attachment& Attachment::operator=(Attachment&& other) noexcept {
+    if (this != &other) {
+        clear();
+        first_block_ = std::exchange(other.first_block_, nullptr);
+        last_block_ = std::exchange(other.last_block_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+void Attachment::append(const void* data, size_t size) {
+    auto ptr = static_cast<const uint8_t*>(data);
+    size_ += size;
+    while (size > 0) {
+        if (!last_block_ || last_block_->end == kBlockSize) {
+            auto block = new BufferBlock;
+            if (last_block_) {
+                last_block_->next = block;
+            } else {
+                first_block_ = block;
+            }
+            last_block_ = block;
+        }
+        size_t n = std::min<size_t>(size, kBlockSize - last_block_->end);
+        memcpy(last_block_->data + last_block_->end, ptr, n);
+        last_block_->end += n;
+        ptr += n;
+        size -= n;
+    }
+}
+
+void Attachment::append_block(BufferBlock* block) {
+    if (last_block_) {
+        last_block_->next = block;
+    } else {
+        first_block_ = block;
+    }
+    last_block_ = block;
+    size_ += block->end - block->begin;
+}
+
+void Attachment::clear() {
+    while (first_block_) {
+        delete std::exchange(first_block_, first_block_->next);
+    }
+    last_block_ = nullptr;
+    size_ = 0;
+}
+
+std::string Attachment::to_string() const {
+    std::string data;
+    data.reserve(size_);
+    for (auto block = first_block_; block; block = block->next) {
+        data.append(reinterpret_cast<const char*>(block->data + block->begin), block->end - block->begin);
+    }
+    return data;
+}
+
+} // namespace xuanqiong::util
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <sys/types.h>
+
+#include "util/common.h"
+#include "util/buffer_block.h"
+
+namespace xuanqiong::util {
+
+// len bytes of fd from offset on, sent by the connection straight from the
+// page cache. whoever holds the region owns fd and closes it once sent
+struct FileRegion {
+    int fd = -1;
+    off_t offset = 0;
+    size_t len = 0;
+};
+
+class InputBuffer;
+class OutputBuffer;
+
+// bytes carried after the body of a frame, outside protobuf. a chain of
+// BufferBlocks: whole blocks move from the input buffer into it and from it
+// into the output buffer without being copied
+class Attachment {
+public:
+    Attachment() = default;
+    ~Attachment();
+
+    Attachment(Attachment&& other) noexcept;
+    Attachment& operator=(Attachment&& other) noexcept;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    void append(const void* data, size_t size);
+    void clear();
+
+    // blocks in order, each holds data[begin, end)
+    const BufferBlock* first_block() const { return first_block_; }
+
+    std::string to_string() const;
+
+private:
+    friend class InputBuffer;
+    friend class OutputBuffer;
+
+    // link block in at the end, appends continue after its end
+    void append_block(BufferBlock* block);
+
+    BufferBlock* first_block_ = nullptr;
+    BufferBlock* last_block_ = nullptr;
+    size_t size_ = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(Attachment);
+};
+
+} // namespace xuanqiong::util
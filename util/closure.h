@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace xuanqiong::util {
+
+// inline capture storage of a Closure, sized so that a MPMCQueue slot
+// (closure + ready flag) still fits in two cache lines
+constexpr static size_t kClosureStorage = 104;
+
+// move-only void() task, the callable is always stored inline.
+// spawning a closure never touches the heap: captures that do not fit
+// are rejected at compile time instead of silently allocating.
+class Closure {
+public:
+    Closure() noexcept = default;
+
+    template <typename F>
+        requires (!std::is_same_v<std::decay_t<F>, Closure>
+                  && std::is_invocable_r_v<void, std::decay_t<F>&>)
+    Closure(F&& fn) noexcept {
+        using Fn = std::decay_t<F>;
+        static_assert(sizeof(Fn) <= kClosureStorage, "closure captures are too large");
+        static_assert(alignof(Fn) <= alignof(std::max_align_t), "closure is over-aligned");
+        static_assert(std::is_nothrow_move_constructible_v<Fn>,
+                      "closure captures must be nothrow movable");
+        ::new (static_cast<void*>(storage_)) Fn(std::forward<F>(fn));
+        ops_ = &kOps<Fn>;
+    }
+
+    Closure(Closure&& other) noexcept {
+        move_from(other);
+    }
+
+    Closure& operator=(Closure&& other) noexcept {
+        if (this != &other) {
+            reset();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    ~Closure() { reset(); }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+    void operator()() { ops_->invoke(storage_); }
+
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* fn);
+        // move construct dst from src, then destroy src
+        void (*relocate)(void* dst, void* src) noexcept;
+        void (*destroy)(void* fn) noexcept;
+    };
+
+    template <typename Fn>
+    static constexpr Ops kOps = {
+        [](void* fn) { (*static_cast<Fn*>(fn))(); },
+        [](void* dst, void* src) noexcept {
+            ::new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        },
+        [](void* fn) noexcept { static_cast<Fn*>(fn)->~Fn(); },
+    };
+
+    void move_from(Closure& other) noexcept {
+        if (other.ops_) {
+            other.ops_->relocate(storage_, other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[kClosureStorage];
+    const Ops* ops_ = nullptr;
+
+    Closure(const Closure&) = delete;
+    Closure& operator=(const Closure&) = delete;
+};
+
+} // namespace xuanqiong::util
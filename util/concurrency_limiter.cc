@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cmath>
+
+#include "util/concurrency_limiter.h"
+
+namespace xuanqiong::util {
+
+ConcurrencyLimiter::ConcurrencyLimiter(const ConcurrencyLimiterOptions& options)
+    : options_(options) {
+    int initial = options.adaptive ? options.initial_limit : options.max_limit;
+    initial = std::clamp(initial, std::min(options.min_limit, options.max_limit), options.max_limit);
+    limit_.store(initial, std::memory_order_relaxed);
+    estimate_ = initial;
+}
+
+bool ConcurrencyLimiter::try_acquire() {
+    if (!enabled()) {
+        return true;
+    }
+    int inflight = inflight_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (inflight > limit_.load(std::memory_order_relaxed)) {
+        inflight_.fetch_sub(1, std::memory_order_relaxed);
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void ConcurrencyLimiter::release(int64_t latency_ns) {
+    if (!enabled()) {
+        return;
+    }
+    int inflight = inflight_.fetch_sub(1, std::memory_order_relaxed);
+    if (!options_.adaptive || latency_ns < 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+    window_sum_ns_ += latency_ns;
+    window_max_inflight_ = std::max(window_max_inflight_, inflight);
+    if (++window_count_ < options_.window) {
+        return;
+    }
+    update(static_cast<double>(window_sum_ns_) / window_count_);
+    window_sum_ns_ = 0;
+    window_count_ = 0;
+    window_max_inflight_ = 0;
+}
+
+void ConcurrencyLimiter::update(double short_ns) {
+    short_ns = std::max(short_ns, 1.0);
+    if (long_ns_ == 0) {
+        long_ns_ = short_ns;
+    } else {
+        long_ns_ = long_ns_ * 0.95 + short_ns * 0.05;
+    }
+    // latency dropped well below the baseline, e.g. after a burst ended,
+    // so let the baseline catch up faster
+    if (long_ns_ > short_ns * 2) {
+        long_ns_ *= 0.9;
+    }
+
+    double gradient = std::clamp(options_.tolerance * long_ns_ / short_ns, 0.5, 1.0);
+    double next = estimate_ * gradient + std::sqrt(estimate_);
+    // the limit is not what holds requests back, do not grow it
+    if (window_max_inflight_ * 2 < estimate_) {
+        next = std::min(next, estimate_);
+    }
+    estimate_ = estimate_ * (1 - options_.smoothing) + next * options_.smoothing;
+    // max_limit is the hard cap, also when it is below min_limit
+    double floor = std::min(options_.min_limit, options_.max_limit);
+    estimate_ = std::clamp(estimate_, floor, static_cast<double>(options_.max_limit));
+    limit_.store(static_cast<int>(estimate_), std::memory_order_relaxed);
+}
+
+} // namespace xuanqiong::util
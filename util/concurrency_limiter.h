@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "util/common.h"
+
+namespace xuanqiong::util {
+
+struct ConcurrencyLimiterOptions {
+    // hard cap on in-flight requests, 0 disables the limiter
+    int max_limit = 0;
+    // adapt the limit to observed latency, otherwise it stays at max_limit
+    bool adaptive = false;
+    int initial_limit = 64;
+    int min_limit = 4;
+    // latency samples per limit update
+    int window = 64;
+    // latency may grow by this factor before the limit shrinks
+    double tolerance = 1.5;
+    // weight of a freshly computed limit against the current one
+    double smoothing = 0.2;
+};
+
+// in-flight request limit in the style of gradient2: the limit is scaled by
+// long-term latency / short-term latency, so it backs off as soon as
+// queueing delay shows up, and grows by sqrt(limit) while latency is flat.
+// try_acquire/release may be called from any thread
+class ConcurrencyLimiter {
+public:
+    explicit ConcurrencyLimiter(const ConcurrencyLimiterOptions& options);
+    ~ConcurrencyLimiter() = default;
+
+    bool enabled() const { return options_.max_limit > 0; }
+
+    // false if the request must be rejected
+    bool try_acquire();
+    // one admitted request is done. latency_ns < 0 means no sample,
+    // e.g. the connection went away before the response was written
+    void release(int64_t latency_ns);
+
+    int limit() const { return limit_.load(std::memory_order_relaxed); }
+    int inflight() const { return inflight_.load(std::memory_order_relaxed); }
+    uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); }
+
+private:
+    // mutex_ held
+    void update(double short_ns);
+
+    ConcurrencyLimiterOptions options_;
+    std::atomic<int> limit_;
+    std::atomic<int> inflight_{0};
+    std::atomic<uint64_t> rejected_{0};
+
+    // latency window, samples racing with an update are dropped
+    std::mutex mutex_;
+    int64_t window_sum_ns_ = 0;
+    int window_count_ = 0;
+    int window_max_inflight_ = 0;
+    double long_ns_ = 0;
+    double estimate_;
+
+    DISALLOW_COPY_AND_ASSIGN(ConcurrencyLimiter);
+};
+
+} // namespace xuanqiong::util
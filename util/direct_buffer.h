@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#include "util/buffer_block.h"
+
+namespace xuanqiong::util {
+
+// O_DIRECT wants the buffer, offset and length aligned to the logical
+// block size of the device, 4096 covers every device we run on
+constexpr static size_t kDirectAlign = 4096;
+
+// buffer for O_DIRECT file io. the size is rounded up to whole BufferBlock
+// sizes, which are a multiple of kDirectAlign, and the data is aligned
+class DirectBuffer {
+public:
+    static_assert(kBlockSize % kDirectAlign == 0);
+
+    DirectBuffer() = default;
+    explicit DirectBuffer(size_t size)
+        : size_((size + kBlockSize - 1) / kBlockSize * kBlockSize) {
+        if (size_ > 0) {
+            data_ = static_cast<uint8_t*>(std::aligned_alloc(kDirectAlign, size_));
+            if (!data_) {
+                throw std::bad_alloc();
+            }
+        }
+    }
+
+    DirectBuffer(DirectBuffer&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+    DirectBuffer& operator=(DirectBuffer&& other) noexcept {
+        if (this != &other) {
+            std::free(data_);
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    ~DirectBuffer() { std::free(data_); }
+
+    uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+
+    DirectBuffer(const DirectBuffer&) = delete;
+    DirectBuffer& operator=(const DirectBuffer&) = delete;
+};
+
+} // namespace xuanqiong::util
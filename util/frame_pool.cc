@@ -0,0 +1,80 @@
+#include <bit>
+#include <new>
+
+#include "util/frame_pool.h"
+
+namespace xuanqiong::util {
+
+constexpr static size_t kMinClassShift = 8;     // 256 bytes
+constexpr static size_t kNumClasses = std::bit_width(kMaxPooledFrame) - kMinClassShift;
+
+namespace {
+
+struct FreeFrame {
+    FreeFrame* next;
+};
+
+struct ThreadFrames {
+    FreeFrame* heads[kNumClasses] = {};
+    size_t counts[kNumClasses] = {};
+    uint64_t reused = 0;
+    uint64_t allocated = 0;
+
+    ~ThreadFrames() {
+        for (auto head : heads) {
+            while (head) {
+                auto next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    }
+};
+
+thread_local ThreadFrames frames;
+
+} // namespace
+
+static size_t size_class(size_t size) {
+    if (size <= (1 << kMinClassShift)) {
+        return 0;
+    }
+    return std::bit_width(size - 1) - kMinClassShift;
+}
+
+void* FramePool::allocate(size_t size) {
+    ++frames.allocated;
+    if (size > kMaxPooledFrame) {
+        return ::operator new(size);
+    }
+    size_t index = size_class(size);
+    if (auto frame = frames.heads[index]) {
+        frames.heads[index] = frame->next;
+        --frames.counts[index];
+        ++frames.reused;
+        return frame;
+    }
+    return ::operator new(size_t(1) << (index + kMinClassShift));
+}
+
+void FramePool::deallocate(void* ptr, size_t size) noexcept {
+    size_t index = size_class(size);
+    if (size > kMaxPooledFrame || frames.counts[index] >= kMaxCachedFrames) {
+        ::operator delete(ptr);
+        return;
+    }
+    auto frame = static_cast<FreeFrame*>(ptr);
+    frame->next = frames.heads[index];
+    frames.heads[index] = frame;
+    ++frames.counts[index];
+}
+
+uint64_t FramePool::reused() {
+    return frames.reused;
+}
+
+uint64_t FramePool::allocated() {
+    return frames.allocated;
+}
+
+} // namespace xuanqiong::util
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xuanqiong::util {
+
+// frames up to this size are pooled, larger ones go to operator new
+constexpr static size_t kMaxPooledFrame = 32 * 1024;
+// frames kept per size class and thread, the rest is freed
+constexpr static size_t kMaxCachedFrames = 128;
+
+// free lists of coroutine frames in power of two size classes, one set per
+// thread. an executor is one thread, so the frames of the coroutines of its
+// connections are recycled there instead of going through malloc for each
+// connection. a frame freed on another thread joins the lists of that one
+class FramePool {
+public:
+    static void* allocate(size_t size);
+    static void deallocate(void* ptr, size_t size) noexcept;
+
+    // frames of this thread handed out from a free list, and in total
+    static uint64_t reused();
+    static uint64_t allocated();
+};
+
+} // namespace xuanqiong::util
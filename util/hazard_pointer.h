@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+
+#include "util/common.h"
+
+namespace xuanqiong::util {
+
+// max number of threads which can hold a hazard pointer at the same time
+constexpr static int kMaxHazardThreads = 256;
+
+namespace detail {
+
+inline std::atomic<bool> g_hazard_index_used[kMaxHazardThreads];
+
+// claims a hazard slot index on first use, releases it on thread exit
+struct HazardThreadIndex {
+    int index = -1;
+
+    HazardThreadIndex() {
+        for (int i = 0; i < kMaxHazardThreads; ++i) {
+            bool expect = false;
+            if (g_hazard_index_used[i].compare_exchange_strong(expect, true,
+                    std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                index = i;
+                return;
+            }
+        }
+        error("more than {} threads use hazard pointers", kMaxHazardThreads);
+        std::abort();
+    }
+
+    ~HazardThreadIndex() {
+        g_hazard_index_used[index].store(false, std::memory_order_release);
+    }
+};
+
+} // namespace detail
+
+// small index of the calling thread in [0, kMaxHazardThreads)
+inline int hazard_thread_index() {
+    thread_local detail::HazardThreadIndex thread_index;
+    return thread_index.index;
+}
+
+// one hazard pointer per thread, owned by a single lock-free structure
+template <typename T>
+class HazardPointers {
+public:
+    HazardPointers() = default;
+
+    // load src and publish it, the returned pointer is not reclaimed until clear()
+    T* protect(const std::atomic<T*>& src) {
+        auto& slot = slots_[hazard_thread_index()].ptr;
+        T* ptr = src.load(std::memory_order_acquire);
+        while (true) {
+            // seq_cst store/load pair: either the reclaimer sees the hazard,
+            // or we see the updated src
+            slot.store(ptr, std::memory_order_seq_cst);
+            T* cur = src.load(std::memory_order_seq_cst);
+            if (cur == ptr) {
+                return ptr;
+            }
+            ptr = cur;
+        }
+    }
+
+    void clear() {
+        slots_[hazard_thread_index()].ptr.store(nullptr, std::memory_order_release);
+    }
+
+    // call after ptr is unreachable from every shared root
+    bool is_protected(const T* ptr) const {
+        for (const auto& slot : slots_) {
+            if (slot.ptr.load(std::memory_order_seq_cst) == ptr) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<T*> ptr{nullptr};
+    };
+    Slot slots_[kMaxHazardThreads];
+
+    DISALLOW_COPY_AND_ASSIGN(HazardPointers);
+};
+
+} // namespace xuanqiong::util
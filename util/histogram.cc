@@ -0,0 +1,63 @@
+#include <algorithm>
+
+#include "util/histogram.h"
+
+namespace xuanqiong::util {
+
+void HistogramSnapshot::merge(const Histogram& histogram) {
+    for (int i = 0; i < kHistBuckets; ++i) {
+        counts_[i] += histogram.counts_[i].load(std::memory_order_relaxed);
+    }
+    count_ += histogram.count_.load(std::memory_order_relaxed);
+    sum_ += histogram.sum_.load(std::memory_order_relaxed);
+    max_ = std::max(max_, histogram.max_.load(std::memory_order_relaxed));
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other) {
+    for (int i = 0; i < kHistBuckets; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+}
+
+void HistogramSnapshot::record(uint64_t value, uint64_t n) {
+    counts_[hist_bucket_index(value)] += n;
+    count_ += n;
+    sum_ += value * n;
+    max_ = std::max(max_, value);
+}
+
+uint64_t HistogramSnapshot::percentile(double q) const {
+    // buckets are read without a lock, so count_ may be slightly ahead
+    uint64_t total = 0;
+    for (auto n : counts_) {
+        total += n;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    auto rank = static_cast<uint64_t>(q * total + 0.5);
+    rank = std::clamp<uint64_t>(rank, 1, total);
+    uint64_t seen = 0;
+    for (int i = 0; i < kHistBuckets; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min(hist_bucket_upper(i), max_);
+        }
+    }
+    return max_;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> HistogramSnapshot::buckets() const {
+    std::vector<std::pair<uint64_t, uint64_t>> result;
+    for (int i = 0; i < kHistBuckets; ++i) {
+        if (counts_[i] > 0) {
+            result.emplace_back(hist_bucket_upper(i), counts_[i]);
+        }
+    }
+    return result;
+}
+
+} // namespace xuanqiong::util
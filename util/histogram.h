@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "util/common.h"
+
+namespace xuanqiong::util {
+
+// monotonic timestamp in nanoseconds
+inline int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// HDR-style log-linear bucketing: values below kHistSubBuckets are exact,
+// above that every power of two is split into kHistSubBuckets / 2 buckets,
+// which bounds the relative error to ~3%.
+constexpr static int kHistSubBits = 5;
+constexpr static int kHistSubBuckets = 1 << kHistSubBits;
+constexpr static int kHistHalfBuckets = kHistSubBuckets / 2;
+// values are clamped to 2^36 - 1 (~68s in nanoseconds)
+constexpr static int kHistMaxBits = 36;
+constexpr static int kHistBuckets = (kHistMaxBits - kHistSubBits) * kHistHalfBuckets
+                                  + kHistSubBuckets;
+constexpr static uint64_t kHistMaxValue = (1ULL << kHistMaxBits) - 1;
+
+inline int hist_bucket_index(uint64_t value) {
+    if (value > kHistMaxValue) {
+        value = kHistMaxValue;
+    }
+    if (value < kHistSubBuckets) {
+        return static_cast<int>(value);
+    }
+    int exp = std::bit_width(value) - kHistSubBits;
+    return exp * kHistHalfBuckets + static_cast<int>(value >> exp);
+}
+
+// smallest value which falls into bucket index
+inline uint64_t hist_bucket_lower(int index) {
+    if (index < kHistSubBuckets) {
+        return index;
+    }
+    int exp = index / kHistHalfBuckets - 1;
+    return static_cast<uint64_t>(index - exp * kHistHalfBuckets) << exp;
+}
+
+inline uint64_t hist_bucket_upper(int index) {
+    if (index < kHistSubBuckets) {
+        return index;
+    }
+    return hist_bucket_lower(index + 1) - 1;
+}
+
+// lock-free histogram with a single writer (the owning executor thread)
+// and any number of concurrent readers
+class Histogram {
+public:
+    Histogram() = default;
+
+    void record(uint64_t value) {
+        bump(counts_[hist_bucket_index(value)], 1);
+        bump(count_, 1);
+        bump(sum_, value);
+        if (value > max_.load(std::memory_order_relaxed)) {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    friend class HistogramSnapshot;
+
+    // single writer, a plain load + store avoids a locked instruction
+    static void bump(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, kHistBuckets> counts_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+
+    DISALLOW_COPY_AND_ASSIGN(Histogram);
+};
+
+// plain copy of one or more histograms, merged on demand
+class HistogramSnapshot {
+public:
+    HistogramSnapshot() : counts_(kHistBuckets, 0) {}
+
+    void merge(const Histogram& histogram);
+    void merge(const HistogramSnapshot& other);
+    void record(uint64_t value, uint64_t n = 1);
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0; }
+
+    // value at quantile q in [0, 1], the upper bound of the matching bucket
+    uint64_t percentile(double q) const;
+
+    // non-empty buckets as (bucket upper bound, count)
+    std::vector<std::pair<uint64_t, uint64_t>> buckets() const;
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+} // namespace xuanqiong::util
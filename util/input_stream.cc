@@ -38,25 +38,24 @@ bool InputBuffer::fetch_uint32(uint32_t* value) {
     if (sizeof(uint32_t) > read_bytes_) {
         return false;
     }
+    skip_consumed_block();
     size_t copy_len = std::min(cur_block_->end - cur_block_->begin, (int)sizeof(uint32_t));
     memcpy(value, cur_block_->data + cur_block_->begin, copy_len);
     // info("begin: {}, end: {}, copy_len: {}", cur_block_->begin, cur_block_->end, copy_len);
     cur_block_->begin += copy_len;
     if (copy_len < sizeof(uint32_t)) {
         cur_block_ = cur_block_->next;
-        memcpy(value + copy_len,
+        memcpy(reinterpret_cast<uint8_t*>(value) + copy_len,
             cur_block_->data + cur_block_->begin, sizeof(uint32_t) - copy_len);
         cur_block_->begin += sizeof(uint32_t) - copy_len;
     }
-    if (cur_block_->begin == kBlockSize && cur_block_->next) {
-        cur_block_ = cur_block_->next;
-    }
     consumed_bytes_ += sizeof(int32_t);
     read_bytes_ -= sizeof(int32_t);
     return true;
 }
 
 bool InputBuffer::next(const void** data, int* size) {
+    skip_consumed_block();
     if (cur_block_->begin == cur_block_->end || limit_ == 0) {
         return false;
     }
@@ -65,9 +64,6 @@ bool InputBuffer::next(const void** data, int* size) {
     limit_ -= limit_ == INT32_MAX ? 0 : *size;
     cur_block_->begin += *size;
     consumed_bytes_ += *size;
-    if (cur_block_->begin == kBlockSize && cur_block_->next) {
-        cur_block_ = cur_block_->next;
-    }
     read_bytes_ -= *size;
     return true;
 }
@@ -88,21 +84,48 @@ void InputBuffer::back_up(int n) {
 }
 
 bool InputBuffer::skip(int n) {
-    if (n > byte_count()) {
+    if (static_cast<size_t>(n) > read_bytes_) {
         return false;
     }
     while (n > 0) {
+        skip_consumed_block();
         int to_skip = std::min(n, cur_block_->end - cur_block_->begin);
         cur_block_->begin += to_skip;
         n -= to_skip;
         consumed_bytes_ += to_skip;
         read_bytes_ -= to_skip;
+    }
+    return true;
+}
 
-        if (cur_block_->begin == kBlockSize && cur_block_->next) {
-            cur_block_ = cur_block_->next;
+void InputBuffer::cut(size_t n, Attachment* out) {
+    n = std::min(n, read_bytes_);
+    while (n > 0) {
+        skip_consumed_block();
+        // nothing backs up past cur_block_, the blocks before it can go
+        while (first_block_ != cur_block_) {
+            auto block = first_block_;
+            first_block_ = first_block_->next;
+            delete block;
         }
+        size_t avail = cur_block_->end - cur_block_->begin;
+        size_t take = std::min(avail, n);
+        // a full block is never the one receiving, hand it over as is
+        if (out && avail <= n && cur_block_->end == kBlockSize && cur_block_ != last_block_) {
+            auto block = cur_block_;
+            first_block_ = cur_block_ = block->next;
+            block->next = nullptr;
+            out->append_block(block);
+        } else {
+            if (out) {
+                out->append(cur_block_->data + cur_block_->begin, take);
+            }
+            cur_block_->begin += take;
+        }
+        n -= take;
+        consumed_bytes_ += take;
+        read_bytes_ -= take;
     }
-    return true;
 }
 
 } // namespace xuanqiong::util
@@ -3,6 +3,7 @@
 #include <google/protobuf/io/zero_copy_stream.h>
 
 #include "util/common.h"
+#include "util/attachment.h"
 #include "util/buffer_block.h"
 
 namespace xuanqiong::util {
@@ -21,6 +22,10 @@ public:
 
     bool fetch_uint32(uint32_t* value);
 
+    // move the next n bytes into out, whole blocks without a copy, or drop
+    // them if out is null. n must not exceed bytes()
+    void cut(size_t n, Attachment* out);
+
 private:
     friend class NetInputStream;
 
@@ -40,6 +45,14 @@ private:
 
     int64_t byte_count() const { return consumed_bytes_; }
 
+    // step past a fully consumed block. done lazily, before the next read,
+    // so that back_up() still sees the block returned by the last next()
+    void skip_consumed_block() {
+        if (cur_block_->begin == kBlockSize && cur_block_->next) {
+            cur_block_ = cur_block_->next;
+        }
+    }
+
     size_t read_bytes_;       // size read from fd
     size_t consumed_bytes_;   // size consumed by ZeroCopyInputStream
 
@@ -63,6 +76,10 @@ public:
         return input_buffer_->fetch_uint32(value);
     }
 
+    void cut(size_t n, Attachment* out) {
+        input_buffer_->cut(n, out);
+    }
+
     void push_limit(int limit) {
         input_buffer_->push_limit(limit);
     }
@@ -0,0 +1,49 @@
+// spdlog headers go first, util/logging.h defines macros named like its methods
+#include "spdlog/spdlog.h"
+#include "spdlog/async.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include <chrono>
+
+#include "util/logging.h"
+
+namespace xuanqiong::util {
+
+constexpr static size_t kLogQueueSize = 8192;
+
+static std::shared_ptr<spdlog::logger> create_logger() {
+    spdlog::init_thread_pool(kLogQueueSize, 1);
+    auto sink = std::make_shared<spdlog::sinks::stderr_color_sink_mt>();
+    auto logger = std::make_shared<spdlog::async_logger>(
+        "xuanqiong", std::move(sink), spdlog::thread_pool(),
+        spdlog::async_overflow_policy::overrun_oldest);
+    logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] [%t] %v");
+    logger->set_level(static_cast<spdlog::level::level_enum>(XQ_LOG_LEVEL));
+    logger->flush_on(spdlog::level::warn);
+    // registered so that the pool is drained at exit
+    spdlog::register_logger(logger);
+    return logger;
+}
+
+spdlog::logger* logger() {
+    static auto instance = create_logger();
+    return instance.get();
+}
+
+bool LogRateLimiter::allow(uint64_t* suppressed) {
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    auto start = window_start_ns_.load(std::memory_order_relaxed);
+    if (now - start >= kLogRateWindowNs &&
+            window_start_ns_.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        window_count_.store(0, std::memory_order_relaxed);
+    }
+    if (window_count_.fetch_add(1, std::memory_order_relaxed) < kLogRateBurst) {
+        *suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+} // namespace xuanqiong::util
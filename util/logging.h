@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// spdlog must be seen before the level macros below are defined
+#include "spdlog/logger.h"
+
+// compile-time level filter, SPDLOG_LEVEL_TRACE (0) .. SPDLOG_LEVEL_OFF (6),
+// calls below it compile to nothing
+#ifndef XQ_LOG_LEVEL
+#define XQ_LOG_LEVEL SPDLOG_LEVEL_INFO
+#endif
+
+namespace xuanqiong::util {
+
+// process-wide async logger, messages are formatted on the caller and
+// written by a background thread. a full queue drops the oldest message
+// instead of blocking the caller
+spdlog::logger* logger();
+
+// admits kLogRateBurst messages per second from one call site,
+// the rest are counted and reported with the next admitted message
+constexpr static uint32_t kLogRateBurst = 10;
+constexpr static int64_t kLogRateWindowNs = 1'000'000'000;
+
+class LogRateLimiter {
+public:
+    LogRateLimiter() = default;
+
+    // returns false if the message should be dropped, otherwise
+    // *suppressed is the number dropped since the last admitted one
+    bool allow(uint64_t* suppressed);
+
+private:
+    std::atomic<int64_t> window_start_ns_{0};
+    std::atomic<uint32_t> window_count_{0};
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+} // namespace xuanqiong::util
+
+#define XQ_LOG(lvl, ...)                                                            \
+    do {                                                                            \
+        if constexpr (lvl >= XQ_LOG_LEVEL) {                                        \
+            ::xuanqiong::util::logger()->log(                                       \
+                static_cast<spdlog::level::level_enum>(lvl), __VA_ARGS__);          \
+        }                                                                           \
+    } while (0)
+
+// rate limited per call site, for errors which may repeat on every event
+#define XQ_LOG_LIMITED(lvl, ...)                                                    \
+    do {                                                                            \
+        if constexpr (lvl >= XQ_LOG_LEVEL) {                                        \
+            static ::xuanqiong::util::LogRateLimiter xq_limiter;                    \
+            uint64_t xq_suppressed = 0;                                             \
+            if (xq_limiter.allow(&xq_suppressed)) {                                 \
+                auto xq_logger = ::xuanqiong::util::logger();                       \
+                auto xq_level = static_cast<spdlog::level::level_enum>(lvl);        \
+                if (xq_suppressed > 0) {                                            \
+                    xq_logger->log(xq_level, "{} similar messages suppressed",      \
+                                   xq_suppressed);                                  \
+                }                                                                   \
+                xq_logger->log(xq_level, __VA_ARGS__);                              \
+            }                                                                       \
+        }                                                                           \
+    } while (0)
+
+#define trace(...) XQ_LOG(SPDLOG_LEVEL_TRACE, __VA_ARGS__)
+#define debug(...) XQ_LOG(SPDLOG_LEVEL_DEBUG, __VA_ARGS__)
+#define info(...) XQ_LOG(SPDLOG_LEVEL_INFO, __VA_ARGS__)
+#define warn(...) XQ_LOG_LIMITED(SPDLOG_LEVEL_WARN, __VA_ARGS__)
+#define error(...) XQ_LOG_LIMITED(SPDLOG_LEVEL_ERROR, __VA_ARGS__)
@@ -1,18 +1,28 @@
 #pragma once
 
+#include <array>
 #include <vector>
+#include <deque>
+#include <mutex>
 #include <atomic>
 #include <memory>
 #include <thread>
 #include <cassert>
 
 #include "util/common.h"
+#include "util/hazard_pointer.h"
 
 namespace xuanqiong::util {
 
 constexpr static int CACHE_LINE = 64;
 constexpr static int CHUNK_SIZE = 4096;
+// reclaimed chunks kept for reuse instead of being deleted
+constexpr static int MAX_FREE_CHUNKS = 2;
 
+// unbounded lock-free queue made of a linked list of chunks.
+// a chunk is retired once all its slots are read, and reclaimed (recycled)
+// when no hazard pointer refers to it. chunks are reclaimed strictly in
+// list order, so protecting a chunk also protects every chunk after it.
 template<typename T>
 class MPMCQueue {
     struct Slot {
@@ -22,10 +32,9 @@ class MPMCQueue {
 
     struct Chunk {
         alignas(CACHE_LINE) std::array<Slot, CHUNK_SIZE> slots;
-        const size_t begin_index;
+        size_t begin_index;
         std::atomic<Chunk*> next{nullptr};
         std::atomic<int> read_count{0};
-        std::atomic<int> ref_count{0};
 
         Chunk(size_t begin_index) : begin_index(begin_index) {}
         ~Chunk() = default;
@@ -47,6 +56,12 @@ public:
             delete curr;
             curr = next;
         }
+        for (auto chunk : retired_chunks_) {
+            delete chunk;
+        }
+        for (auto chunk : free_chunks_) {
+            delete chunk;
+        }
     }
 
     bool push(auto&& value);
@@ -54,12 +69,27 @@ public:
     bool pop(T& value);
 
 private:
+    // take a chunk from the free list, or allocate one
+    Chunk* alloc_chunk(size_t begin_index);
+    // give back a chunk which was never published
+    void recycle_chunk(Chunk* chunk);
+    // chunk is unreachable from head_chunk_/tail_chunk_, reclaim it when safe
+    void retire_chunk(Chunk* chunk);
+
     alignas(CACHE_LINE) std::atomic<Chunk*> head_chunk_;
     alignas(CACHE_LINE) std::atomic<size_t> head_index_;
 
     alignas(CACHE_LINE) std::atomic<Chunk*> tail_chunk_;
     alignas(CACHE_LINE) std::atomic<size_t> tail_index_;
 
+    HazardPointers<Chunk> hazards_;
+
+    // slow path, taken once per CHUNK_SIZE items
+    alignas(CACHE_LINE) std::mutex reclaim_mutex_;
+    std::deque<Chunk*> retired_chunks_;     // sorted by begin_index
+    size_t reclaim_index_ = 0;              // begin_index of next chunk to reclaim
+    std::vector<Chunk*> free_chunks_;
+
     DISALLOW_COPY_AND_ASSIGN(MPMCQueue);
 };
 
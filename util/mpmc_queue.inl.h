@@ -1,76 +1,150 @@
+// spin on a slot/link which another thread is about to publish
+inline void mpmc_spin_wait(int& spins) {
+    if (++spins > 64) {
+        std::this_thread::yield();
+    }
+}
+
 template <typename T>
 bool MPMCQueue<T>::push(auto&& value) {
-    while (true) {
-        auto tail_chunk = tail_chunk_.load(std::memory_order_acquire);
-        auto tail_idx = tail_index_.load(std::memory_order_acquire);
+    // protect the tail chunk before taking an index, so the index is never
+    // located before the chunk
+    auto write_chunk = hazards_.protect(tail_chunk_);
+    auto write_idx = tail_index_.fetch_add(1, std::memory_order_acq_rel);
 
-        if (tail_index_.compare_exchange_weak(tail_idx, tail_idx + 1,
-                std::memory_order_release, std::memory_order_relaxed)) {
-            auto write_idx = tail_idx;
-            auto write_chunk = tail_chunk;
-            if (tail_idx >= tail_chunk->begin_index + CHUNK_SIZE) {
-                auto next_chunk = new Chunk(tail_chunk->begin_index + CHUNK_SIZE);
-                if (tail_chunk_.compare_exchange_strong(
-                        tail_chunk, next_chunk,
-                        std::memory_order_release,
-                        std::memory_order_relaxed)) {
-                    tail_chunk->next.store(next_chunk, std::memory_order_release);
-                } else {
-                    delete next_chunk;
-                }
-                while (write_chunk->begin_index + CHUNK_SIZE <= write_idx) {
-                    while (!write_chunk->next.load(std::memory_order_acquire)) {}
-                    write_chunk = write_chunk->next.load(std::memory_order_acquire);
-                }
+    while (write_chunk->begin_index + CHUNK_SIZE <= write_idx) {
+        auto next_chunk = write_chunk->next.load(std::memory_order_acquire);
+        if (!next_chunk) {
+            auto new_chunk = alloc_chunk(write_chunk->begin_index + CHUNK_SIZE);
+            if (write_chunk->next.compare_exchange_strong(next_chunk, new_chunk,
+                    std::memory_order_acq_rel, std::memory_order_acquire)) {
+                next_chunk = new_chunk;
+            } else {
+                recycle_chunk(new_chunk);
             }
-            auto& write_slot = write_chunk->slots[write_idx - write_chunk->begin_index];
-            write_slot.value = std::forward<decltype(value)>(value);
-            write_slot.ready.store(true, std::memory_order_release);
-            return true;
         }
+        // help to move tail forward, it never moves backward.
+        // cas on head/tail are seq_cst to pair with the hazard pointer scan
+        auto expect = write_chunk;
+        tail_chunk_.compare_exchange_strong(expect, next_chunk);
+        write_chunk = next_chunk;
     }
+
+    auto& write_slot = write_chunk->slots[write_idx - write_chunk->begin_index];
+    write_slot.value = std::forward<decltype(value)>(value);
+    write_slot.ready.store(true, std::memory_order_release);
+    hazards_.clear();
+    return true;
 }
 
 template <typename T>
 bool MPMCQueue<T>::pop(T& value) {
     while (true) {
-        auto head_chunk = head_chunk_.load(std::memory_order_acquire);
+        auto head_chunk = hazards_.protect(head_chunk_);
+
+        // head chunk is fully read, move head forward and retire it
+        if (head_chunk->read_count.load(std::memory_order_acquire) == CHUNK_SIZE) {
+            auto next_chunk = head_chunk->next.load(std::memory_order_acquire);
+            if (next_chunk) {
+                auto expect = head_chunk;
+                if (head_chunk_.compare_exchange_strong(expect, next_chunk)) {
+                    // drop our own hazard first, it would block the reclaim
+                    hazards_.clear();
+                    retire_chunk(head_chunk);
+                }
+                continue;
+            }
+        }
+
         auto head_idx = head_index_.load(std::memory_order_acquire);
-        if (head_idx == tail_index_.load(std::memory_order_acquire)) {
+        if (head_idx >= tail_index_.load(std::memory_order_acquire)) {
+            hazards_.clear();
             return false;  // empty
         }
-        if (head_chunk->read_count.load(std::memory_order_acquire) == CHUNK_SIZE
-                && head_chunk->ref_count.load(std::memory_order_acquire) == 0) {
-            if (!head_chunk->next.load(std::memory_order_acquire)) continue;
-            if (head_chunk_.compare_exchange_weak(
-                head_chunk, head_chunk->next.load(std::memory_order_acquire),
-                std::memory_order_release, std::memory_order_relaxed)) {
-                delete head_chunk;
-            }
+        if (!head_index_.compare_exchange_weak(head_idx, head_idx + 1,
+                std::memory_order_acq_rel, std::memory_order_relaxed)) {
             continue;
         }
 
-        head_chunk->ref_count.fetch_add(1, std::memory_order_acquire);
-
-        if (head_index_.compare_exchange_weak(head_idx, head_idx + 1,
-                std::memory_order_acquire, std::memory_order_relaxed)) {
-            auto read_idx = head_idx;
-            auto read_chunk = head_chunk;
-            while (read_chunk->begin_index + CHUNK_SIZE <= read_idx) {
-                while (!read_chunk->next.load(std::memory_order_acquire)) {}
-                read_chunk = read_chunk->next.load(std::memory_order_acquire);
-            }
-            if (read_chunk != head_chunk) {
-                head_chunk->ref_count.fetch_sub(1, std::memory_order_release);
+        int spins = 0;
+        auto read_chunk = head_chunk;
+        while (read_chunk->begin_index + CHUNK_SIZE <= head_idx) {
+            auto next_chunk = read_chunk->next.load(std::memory_order_acquire);
+            if (!next_chunk) {
+                mpmc_spin_wait(spins);  // producer is linking the next chunk
+                continue;
             }
-            auto& slot = read_chunk->slots[read_idx - read_chunk->begin_index];
-            while (!slot.ready.load(std::memory_order_acquire)) {}
-            value = std::move(slot.value);
-            read_chunk->read_count.fetch_add(1, std::memory_order_release);
-            if (read_chunk == head_chunk) {
-                head_chunk->ref_count.fetch_sub(1, std::memory_order_release);
-            }
-            return true;
+            read_chunk = next_chunk;
+        }
+
+        auto& slot = read_chunk->slots[head_idx - read_chunk->begin_index];
+        while (!slot.ready.load(std::memory_order_acquire)) {
+            mpmc_spin_wait(spins);  // producer took the index, value not stored yet
+        }
+        value = std::move(slot.value);
+        // every slot is read exactly once, reset it for chunk reuse
+        slot.ready.store(false, std::memory_order_relaxed);
+        read_chunk->read_count.fetch_add(1, std::memory_order_release);
+        hazards_.clear();
+        return true;
+    }
+}
+
+template <typename T>
+typename MPMCQueue<T>::Chunk* MPMCQueue<T>::alloc_chunk(size_t begin_index) {
+    Chunk* chunk = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(reclaim_mutex_);
+        if (!free_chunks_.empty()) {
+            chunk = free_chunks_.back();
+            free_chunks_.pop_back();
+        }
+    }
+    if (!chunk) {
+        return new Chunk(begin_index);
+    }
+    chunk->begin_index = begin_index;
+    chunk->next.store(nullptr, std::memory_order_relaxed);
+    chunk->read_count.store(0, std::memory_order_relaxed);
+    return chunk;
+}
+
+template <typename T>
+void MPMCQueue<T>::recycle_chunk(Chunk* chunk) {
+    std::lock_guard<std::mutex> lock(reclaim_mutex_);
+    if (free_chunks_.size() < MAX_FREE_CHUNKS) {
+        free_chunks_.push_back(chunk);
+    } else {
+        delete chunk;
+    }
+}
+
+template <typename T>
+void MPMCQueue<T>::retire_chunk(Chunk* chunk) {
+    // tail may still lag on this chunk, after this cas it never points to it again
+    auto expect = chunk;
+    tail_chunk_.compare_exchange_strong(expect, chunk->next.load(std::memory_order_acquire));
+
+    std::lock_guard<std::mutex> lock(reclaim_mutex_);
+    auto iter = retired_chunks_.begin();
+    while (iter != retired_chunks_.end() && (*iter)->begin_index < chunk->begin_index) {
+        ++iter;
+    }
+    retired_chunks_.insert(iter, chunk);
+
+    // reclaim in list order, a thread holding an earlier chunk may still
+    // walk into the later ones
+    while (!retired_chunks_.empty()) {
+        auto oldest = retired_chunks_.front();
+        if (oldest->begin_index != reclaim_index_ || hazards_.is_protected(oldest)) {
+            break;
+        }
+        retired_chunks_.pop_front();
+        reclaim_index_ += CHUNK_SIZE;
+        if (free_chunks_.size() < MAX_FREE_CHUNKS) {
+            free_chunks_.push_back(oldest);
+        } else {
+            delete oldest;
         }
     }
 }
@@ -1,11 +1,13 @@
 #include <unistd.h>
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 #include "util/output_stream.h"
 
 namespace xuanqiong::util {
 
-OutputBuffer::OutputBuffer() : to_write_bytes_(0), total_bytes_(0) {
+OutputBuffer::OutputBuffer() : to_write_bytes_(0), total_bytes_(0), sent_bytes_(0) {
     cur_block_ = new BufferBlock;
     last_block_ = cur_block_;
 }
@@ -55,12 +57,78 @@ void OutputBuffer::append(const void* data, int size) {
     }
 }
 
-std::vector<iovec> OutputBuffer::get_iovecs() {
+void OutputBuffer::append(Attachment&& attachment) {
+    if (attachment.empty()) {
+        attachment.clear();
+        return;
+    }
+    // blocks may be partly filled from here on, send_add() steps over them
+    to_write_bytes_ += attachment.size_;
+    last_block_->next = std::exchange(attachment.first_block_, nullptr);
+    last_block_ = std::exchange(attachment.last_block_, nullptr);
+    attachment.size_ = 0;
+}
+
+uint8_t* OutputBuffer::append_region(int size) {
+    if (size > kBlockSize - last_block_->end) {
+        return nullptr;
+    }
+    auto region = last_block_->data + last_block_->end;
+    last_block_->end += size;
+    to_write_bytes_ += size;
+    if (last_block_->end == kBlockSize) {
+        last_block_->next = new BufferBlock;
+        last_block_ = last_block_->next;
+    }
+    return region;
+}
+
+OutputSlot OutputBuffer::reserve_uint32() {
+    // a full last block, left by next() or an attachment, is freed once
+    // sent, which the bytes before the slot may be. start the slot after it
+    if (last_block_->end == kBlockSize) {
+        last_block_->next = new BufferBlock;
+        last_block_ = last_block_->next;
+    }
+    OutputSlot slot{last_block_, last_block_->end, sent_bytes_ + to_write_bytes_};
+    open_slots_.push_back(slot.position);
+    uint32_t placeholder = 0;
+    append(&placeholder, sizeof(placeholder));
+    return slot;
+}
+
+void OutputBuffer::patch_uint32(OutputSlot slot, uint32_t value) {
+    std::erase(open_slots_, slot.position);
+    auto bytes = reinterpret_cast<const uint8_t*>(&value);
+    for (size_t i = 0; i < sizeof(value); ++i) {
+        if (slot.offset == kBlockSize) {
+            slot.block = slot.block->next;
+            slot.offset = 0;
+        }
+        slot.block->data[slot.offset++] = bytes[i];
+    }
+}
+
+uint32_t OutputBuffer::patch_length(OutputSlot slot) {
+    uint32_t length = sent_bytes_ + to_write_bytes_ - slot.position - sizeof(uint32_t);
+    patch_uint32(slot, length);
+    return length;
+}
+
+size_t OutputBuffer::sendable() const {
+    if (open_slots_.empty()) {
+        return to_write_bytes_;
+    }
+    return open_slots_.front() - sent_bytes_;
+}
+
+std::vector<iovec> OutputBuffer::get_iovecs(size_t max_bytes) {
     std::vector<iovec> iovs;
-    for (auto block = cur_block_; block && iovs.size() < IOV_MAX; block = block->next) {
+    for (auto block = cur_block_; block && iovs.size() < IOV_MAX && max_bytes > 0; block = block->next) {
         void* data = block->data + block->begin;
-        size_t size = size_t(block->end - block->begin);
+        size_t size = std::min(size_t(block->end - block->begin), max_bytes);
         iovs.emplace_back(data, size);
+        max_bytes -= size;
     }
     return iovs;
 }
@@ -69,11 +137,14 @@ void OutputBuffer::send_add(int nwrite) {
     if (nwrite <= 0) return;
     int left = nwrite;
     to_write_bytes_ -= nwrite;
+    sent_bytes_ += nwrite;
     while (left > 0) {
         int cur_write = std::min(left, cur_block_->end - cur_block_->begin);
         left -= cur_write;
         cur_block_->begin += cur_write;
-        if (cur_block_->begin == kBlockSize) {
+        // full blocks, and attachment blocks which end early, are done
+        if (cur_block_->begin == kBlockSize ||
+                (cur_block_->begin == cur_block_->end && cur_block_ != last_block_)) {
             if (!cur_block_->next) {
                 last_block_->next = new BufferBlock;
                 last_block_ = last_block_->next;
@@ -1,27 +1,58 @@
 #pragma once
 
 #include <sys/uio.h>
+#include <vector>
 #include <google/protobuf/io/zero_copy_stream.h>
 
 #include "util/common.h"
+#include "util/attachment.h"
 #include "util/buffer_block.h"
 
 namespace xuanqiong::util {
 
+// position of bytes reserved in an OutputBuffer, filled in later
+struct OutputSlot {
+    BufferBlock* block;
+    int offset;
+    // offset of the slot in all bytes ever appended to the buffer
+    size_t position;
+};
+
 class OutputBuffer {
 public:
     OutputBuffer();
     ~OutputBuffer();
 
     void append(const void* data, int size);
+    // link the blocks of attachment in after the bytes so far, no copy
+    void append(Attachment&& attachment);
+
+    // size bytes appended for the caller to fill in place, null if they do
+    // not fit in the current block
+    uint8_t* append_region(int size);
+
+    // append a placeholder uint32_t for a length only known once the bytes
+    // after it are written, the slot may span two blocks. nothing from the
+    // slot on is sendable until it is patched, so the bytes behind it may
+    // be appended over several tasks while the output before it is flushed
+    OutputSlot reserve_uint32();
+    void patch_uint32(OutputSlot slot, uint32_t value);
+    // patch slot with the bytes appended after it, returns them. the
+    // writer of a connection is not woken, see Connection::patch_length
+    uint32_t patch_length(OutputSlot slot);
 
     // write data to fd, use writev
     // int write_to(int fd);
-    std::vector<iovec> get_iovecs();
+    // the first max_bytes at most
+    std::vector<iovec> get_iovecs(size_t max_bytes = SIZE_MAX);
     void send_add(int send_bytes);
 
     // data size in bytes to write
     size_t bytes() const { return to_write_bytes_; }
+    // of those, the bytes before the first slot not patched yet
+    size_t sendable() const;
+    // bytes sent since the buffer was created
+    size_t sent_bytes() const { return sent_bytes_; }
 
 private:
     friend class NetOutputStream;
@@ -37,6 +68,9 @@ private:
 
     size_t to_write_bytes_;    // size to write to fd
     size_t total_bytes_;       // total size from ZeroCopyOutputStream
+    size_t sent_bytes_;        // size written to fd so far
+    // positions of the slots not patched yet, oldest first
+    std::vector<size_t> open_slots_;
 
     DISALLOW_COPY_AND_ASSIGN(OutputBuffer);
 };
@@ -50,6 +84,26 @@ public:
         output_buffer_->append(data, size);
     }
 
+    void append(util::Attachment&& attachment) {
+        output_buffer_->append(std::move(attachment));
+    }
+
+    uint8_t* append_region(int size) {
+        return output_buffer_->append_region(size);
+    }
+
+    OutputSlot reserve_uint32() {
+        return output_buffer_->reserve_uint32();
+    }
+
+    void patch_uint32(OutputSlot slot, uint32_t value) {
+        output_buffer_->patch_uint32(slot, value);
+    }
+
+    uint32_t patch_length(OutputSlot slot) {
+        return output_buffer_->patch_length(slot);
+    }
+
     bool Next(void** data, int* size) override {
         return output_buffer_->next(data, size);
     }
@@ -0,0 +1,62 @@
+#include <iterator>
+
+#include "util/response_cache.h"
+
+namespace xuanqiong::util {
+
+// list node, index node and string headers of one entry
+constexpr static size_t kEntryOverhead = 128;
+
+size_t ResponseCache::charge(const Entry& entry) {
+    return entry.key.size() + entry.value.size() + kEntryOverhead;
+}
+
+const std::string* ResponseCache::find(std::string_view key, int64_t now_ns) {
+    auto iter = index_.find(key);
+    if (iter == index_.end()) {
+        add(stats_.misses, 1);
+        return nullptr;
+    }
+    auto entry = iter->second;
+    if (entry->expire_ns <= now_ns) {
+        erase(entry);
+        add(stats_.expirations, 1);
+        add(stats_.misses, 1);
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, entry);
+    add(stats_.hits, 1);
+    return &entry->value;
+}
+
+void ResponseCache::insert(std::string key, std::string value, int64_t now_ns, int64_t ttl_ns) {
+    auto iter = index_.find(key);
+    if (iter != index_.end()) {
+        erase(iter->second);
+    }
+    lru_.push_front({std::move(key), std::move(value), now_ns + ttl_ns});
+    auto size = charge(lru_.front());
+    if (size > max_bytes_) {
+        lru_.pop_front();
+        return;
+    }
+    index_[lru_.front().key] = lru_.begin();
+    bytes_ += size;
+    add(stats_.entries, 1);
+    add(stats_.bytes, size);
+    while (bytes_ > max_bytes_) {
+        erase(std::prev(lru_.end()));
+        add(stats_.evictions, 1);
+    }
+}
+
+void ResponseCache::erase(Iterator iter) {
+    auto size = charge(*iter);
+    bytes_ -= size;
+    add(stats_.entries, -1);
+    add(stats_.bytes, -static_cast<int64_t>(size));
+    index_.erase(iter->key);
+    lru_.erase(iter);
+}
+
+} // namespace xuanqiong::util
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "util/common.h"
+
+namespace xuanqiong::util {
+
+// which responses the server keeps, see RpcServerOptions::cache
+struct ResponseCacheOptions {
+    // "service/method" -> time to live in milliseconds. only for methods
+    // whose response depends on nothing but the request
+    std::unordered_map<std::string, int64_t> methods;
+    // memory of the cache of one executor, keys included
+    size_t max_bytes = 64 << 20;
+};
+
+// counters of one cache, only the owning thread writes
+struct ResponseCacheStats {
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};     // pushed out by max_bytes
+    std::atomic<uint64_t> expirations{0};   // found past their ttl
+    std::atomic<uint64_t> entries{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+// serialized responses by request key, the least recently used goes first
+// once max_bytes is reached. not thread safe, the server keeps one per
+// executor. handlers run to completion on their executor, so identical
+// requests there never run concurrently: the first one fills the cache and
+// the ones behind it hit
+class ResponseCache {
+public:
+    explicit ResponseCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+    ~ResponseCache() = default;
+
+    // the response cached for key, null if there is none or it expired.
+    // valid until the next insert
+    const std::string* find(std::string_view key, int64_t now_ns);
+
+    // keep value for key until now_ns + ttl_ns, replacing an older one.
+    // values that would take more than max_bytes are not kept
+    void insert(std::string key, std::string value, int64_t now_ns, int64_t ttl_ns);
+
+    const ResponseCacheStats& stats() const { return stats_; }
+
+private:
+    struct Entry {
+        std::string key;
+        std::string value;
+        int64_t expire_ns;
+    };
+    using Iterator = std::list<Entry>::iterator;
+
+    // bytes an entry is charged against max_bytes
+    static size_t charge(const Entry& entry);
+    void erase(Iterator iter);
+
+    static void add(std::atomic<uint64_t>& counter, int64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    size_t max_bytes_;
+    size_t bytes_ = 0;
+    // most recently used first
+    std::list<Entry> lru_;
+    // the keys point into lru_
+    std::unordered_map<std::string_view, Iterator> index_;
+    ResponseCacheStats stats_;
+
+    DISALLOW_COPY_AND_ASSIGN(ResponseCache);
+};
+
+} // namespace xuanqiong::util
@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <deque>
+
+#include "util/resumer.h"
+
+namespace xuanqiong::util {
+
+thread_local bool Resumer::running_ = false;
+
+// coroutines woken while another one ran, in order
+static thread_local std::deque<std::coroutine_handle<>> ready;
+
+void Resumer::resume(std::coroutine_handle<> handle) {
+    if (running_) {
+        // woken twice before it ran, once is enough
+        if (std::find(ready.begin(), ready.end(), handle) == ready.end()) {
+            ready.push_back(handle);
+        }
+        return;
+    }
+    running_ = true;
+    handle.resume();
+    drain();
+    running_ = false;
+}
+
+void Resumer::drain() {
+    while (!ready.empty()) {
+        auto handle = ready.front();
+        ready.pop_front();
+        handle.resume();
+    }
+}
+
+std::coroutine_handle<> Resumer::next() noexcept {
+    if (ready.empty()) {
+        return std::noop_coroutine();
+    }
+    auto handle = ready.front();
+    ready.pop_front();
+    return handle;
+}
+
+} // namespace xuanqiong::util
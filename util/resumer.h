@@ -0,0 +1,38 @@
+#pragma once
+
+#include <coroutine>
+
+namespace xuanqiong::util {
+
+// resumes the coroutines of this thread one after another instead of
+// inside each other. a resume() from a running coroutine, e.g. the read
+// side waking the write side, is queued and runs once the caller suspends,
+// either by symmetric transfer from its awaiter or from the outermost
+// resume(). executors run their tasks through run() for the same reason
+class Resumer {
+public:
+    static void resume(std::coroutine_handle<> handle);
+
+    template <typename F>
+    static void run(F&& fn) {
+        if (running_) {
+            fn();
+            return;
+        }
+        running_ = true;
+        fn();
+        drain();
+        running_ = false;
+    }
+
+    // for await_suspend: the queued coroutine to transfer to, or a noop
+    // handle which returns to whoever resumed the suspending one
+    static std::coroutine_handle<> next() noexcept;
+
+private:
+    static void drain();
+
+    static thread_local bool running_;
+};
+
+} // namespace xuanqiong::util
@@ -1,12 +1,31 @@
+#include <unistd.h>
+#include <utility>
+
 #include "util/service.h"
 
 namespace xuanqiong {
 
+// a file the server never took is closed here
+static void close_region(util::FileRegion* region) {
+  if (region->fd >= 0) {
+    ::close(region->fd);
+  }
+  *region = {};
+}
+
+RpcController::~RpcController() {
+  close_region(&response_file_);
+}
+
 void RpcController::Reset() {
   failed_ = false;
   canceled_ = false;
+  error_code_ = 0;
   error_text_.clear();
   timeout_ms_ = -1;
+  close_region(&response_file_);
+  request_attachment_.clear();
+  response_attachment_.clear();
 }
 
 void RpcController::StartCancel() {
@@ -22,4 +41,18 @@ void RpcController::SetFailed(const std::string& reason) {
   error_text_ = reason;
 }
 
+void RpcController::SetFailed(int32_t code, const std::string& reason) {
+  SetFailed(reason);
+  error_code_ = code;
+}
+
+void RpcController::set_response_file(const util::FileRegion& region) {
+  close_region(&response_file_);
+  response_file_ = region;
+}
+
+util::FileRegion RpcController::take_response_file() {
+  return std::exchange(response_file_, {});
+}
+
 }  // namespace xuanqiong
@@ -4,12 +4,14 @@
 #include <functional>
 #include <google/protobuf/service.h>
 
+#include "util/attachment.h"
+
 namespace xuanqiong {
 
 class RpcController : public google::protobuf::RpcController {
 public:
     RpcController() = default;
-    ~RpcController() override = default;
+    ~RpcController() override;
 
     void Reset() override;
     bool Failed() const override { return failed_; }
@@ -21,14 +23,34 @@ public:
     void NotifyOnCancel(google::protobuf::Closure* callback) override;
 
     void SetFailed(const std::string& reason) override;
+    // proto::StatusCode of the failure, 0 if not set
+    void SetFailed(int32_t code, const std::string& reason);
+    int32_t ErrorCode() const { return error_code_; }
     void SetTimeout(int64_t ms);
     int64_t timeout_ms() const { return timeout_ms_; }
 
+    // server side: send region after the response body and its attachment,
+    // straight from the page cache where the transport allows. the server
+    // closes region.fd
+    void set_response_file(const util::FileRegion& region);
+    util::FileRegion take_response_file();
+
+    // raw bytes sent after the body, outside protobuf. the client fills
+    // the request attachment and the handler reads it, the handler fills
+    // the response attachment and the client reads it. blocks move to and
+    // from the connection buffers without a copy
+    util::Attachment& request_attachment() { return request_attachment_; }
+    util::Attachment& response_attachment() { return response_attachment_; }
+
 private:
     bool failed_{false};
     bool canceled_{false};
+    int32_t error_code_ = 0;
     std::string error_text_;
     int64_t timeout_ms_ = -1;  // -1 表示无超时
+    util::FileRegion response_file_;
+    util::Attachment request_attachment_;
+    util::Attachment response_attachment_;
 };
 
 }  // namespace xuanqiong
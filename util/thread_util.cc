@@ -0,0 +1,79 @@
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#include <dirent.h>
+#endif
+#include <cstring>
+#include <format>
+
+#include "util/common.h"
+#include "util/thread_util.h"
+
+namespace xuanqiong::util {
+
+void set_thread_name(const std::string& name) {
+#ifdef __APPLE__
+    pthread_setname_np(name.c_str());
+#else
+    // the name is limited to 16 bytes including the terminator
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#endif
+}
+
+bool set_thread_affinity(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        error("pthread_setaffinity_np failed: {}", strerror(ret));
+        return false;
+    }
+    return true;
+#else
+    // macOS has no hard affinity
+    return false;
+#endif
+}
+
+int cpu_numa_node(int cpu) {
+#ifdef __linux__
+    // /sys/devices/system/cpu/cpuN contains a nodeM link
+    auto path = std::format("/sys/devices/system/cpu/cpu{}", cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return -1;
+    }
+    int node = -1;
+    while (auto entry = readdir(dir)) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0'
+                && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+#else
+    return -1;
+#endif
+}
+
+int cpus_numa_node(const std::vector<int>& cpus) {
+    int node = -1;
+    for (int cpu : cpus) {
+        int cpu_node = cpu_numa_node(cpu);
+        if (cpu_node == -1 || (node != -1 && cpu_node != node)) {
+            return -1;
+        }
+        node = cpu_node;
+    }
+    return node;
+}
+
+} // namespace xuanqiong::util
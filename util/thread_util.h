@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace xuanqiong::util {
+
+// name the calling thread, linux truncates it to 15 characters
+void set_thread_name(const std::string& name);
+
+// pin the calling thread to cpus, false if it failed or is unsupported
+bool set_thread_affinity(const std::vector<int>& cpus);
+
+// numa node of a cpu, -1 if unknown
+int cpu_numa_node(int cpu);
+
+// numa node shared by all cpus, -1 if they span nodes or it is unknown
+int cpus_numa_node(const std::vector<int>& cpus);
+
+} // namespace xuanqiong::util